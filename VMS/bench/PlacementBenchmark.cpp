@@ -0,0 +1,156 @@
+// Benchmark: several concurrent x264 encodes with their streaming threads
+// left to the scheduler vs. pinned to cores chosen by CpuPlacement, the way
+// StreamManager places live streams. Sources are not live, so each pipeline
+// encodes as fast as it can and aggregate frames/s is the throughput.
+//
+// Build with -DVMS_BUILD_BENCHMARKS=ON and run
+// ./placement_benchmark [streams] [frames] [width] [height]
+
+#include "CpuPlacement.h"
+#include <gst/gst.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchStream {
+    GstElement* pipeline{nullptr};
+    std::vector<int> cpus;
+    std::vector<pid_t> threads;
+    std::mutex mutex;
+    double seconds{0};
+};
+
+struct RunResult {
+    double fps;
+    double cpuSeconds;
+    double slowest;
+    double fastest;
+};
+
+// Same trunk as GStreamerPipeline: convert, queue, then encode on the queue's thread
+std::string pipelineDescription(int frames, int width, int height) {
+    std::ostringstream description;
+    description << "videotestsrc is-live=false pattern=ball num-buffers=" << frames
+                << " ! video/x-raw,width=" << width << ",height=" << height << ",framerate=30/1"
+                << " ! videoconvert ! queue"
+                << " ! x264enc speed-preset=ultrafast tune=zerolatency threads=1 key-int-max=30"
+                << " ! fakesink sync=false";
+    return description.str();
+}
+
+GstBusSyncReply onSyncMessage(GstBus* bus, GstMessage* message, gpointer data) {
+    (void)bus;
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        GstElement* owner;
+        gst_message_parse_stream_status(message, &type, &owner);
+        if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+            BenchStream* stream = static_cast<BenchStream*>(data);
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            stream->threads.push_back(currentThreadId());
+            if (!stream->cpus.empty()) {
+                pinCurrentThread(stream->cpus);
+            }
+        }
+    }
+    return GST_BUS_PASS;
+}
+
+bool run(bool pinned, int streamCount, int frames, int width, int height, RunResult& result) {
+    CpuPlacement placement(CpuTopology::detect());
+    std::vector<std::unique_ptr<BenchStream>> streams;
+    for (int i = 0; i < streamCount; ++i) {
+        auto stream = std::make_unique<BenchStream>();
+        GError* error = nullptr;
+        stream->pipeline = gst_parse_launch(pipelineDescription(frames, width, height).c_str(), &error);
+        if (!stream->pipeline) {
+            std::cerr << "Failed to build pipeline: " << (error ? error->message : "unknown") << std::endl;
+            g_clear_error(&error);
+            return false;
+        }
+        if (pinned) {
+            // Source/convert thread plus one x264 thread, one stream's worth of load
+            stream->cpus = placement.place(i, 2, 1.0);
+        }
+        GstBus* bus = gst_element_get_bus(stream->pipeline);
+        gst_bus_set_sync_handler(bus, &onSyncMessage, stream.get(), NULL);
+        gst_object_unref(bus);
+        streams.push_back(std::move(stream));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& stream : streams) {
+        gst_element_set_state(stream->pipeline, GST_STATE_PLAYING);
+    }
+    bool ok = true;
+    for (auto& stream : streams) {
+        GstBus* bus = gst_element_get_bus(stream->pipeline);
+        GstMessage* message = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                         static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+        // Streams finish in any order; waiting in order still sees each EOS time
+        stream->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!message || GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+            ok = false;
+        }
+        if (message) {
+            gst_message_unref(message);
+        }
+        gst_object_unref(bus);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result = RunResult{0, 0, 0, 1e9};
+    for (auto& stream : streams) {
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            for (pid_t tid : stream->threads) {
+                result.cpuSeconds += threadCpuSeconds(tid);
+            }
+        }
+        result.slowest = std::max(result.slowest, stream->seconds);
+        result.fastest = std::min(result.fastest, stream->seconds);
+        gst_element_set_state(stream->pipeline, GST_STATE_NULL);
+        gst_object_unref(stream->pipeline);
+    }
+    result.fps = elapsed > 0 ? static_cast<double>(streamCount) * frames / elapsed : 0;
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    gst_init(&argc, &argv);
+    int streams = argc > 1 ? std::atoi(argv[1]) : 8;
+    int frames = argc > 2 ? std::atoi(argv[2]) : 300;
+    int width = argc > 3 ? std::atoi(argv[3]) : 1920;
+    int height = argc > 4 ? std::atoi(argv[4]) : 1080;
+    if (streams <= 0) streams = 8;
+    if (frames <= 0) frames = 300;
+
+    std::cout << "topology:     " << CpuTopology::detect().describe() << std::endl;
+    std::cout << "workload:     " << streams << " x " << frames << " frames of "
+              << width << "x" << height << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    // Alternate so thermal or frequency drift does not favour one mode
+    for (bool pinned : {false, true, false, true}) {
+        RunResult result{};
+        if (!run(pinned, streams, frames, width, height, result)) {
+            std::cerr << "Benchmark pipeline failed" << std::endl;
+            return 1;
+        }
+        std::cout << (pinned ? "pinned:       " : "unpinned:     ") << result.fps << " frames/s, "
+                  << result.cpuSeconds << " CPU s, streams done in " << result.fastest
+                  << "-" << result.slowest << " s" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Micro-benchmark: compile-time route table vs. the per-request std::regex
+// matching that HttpServer::handleRequest used before the router existed.
+//
+// Build with -DVMS_BUILD_BENCHMARKS=ON and run ./router_benchmark [iterations]
+
+#include "Router.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The old dispatch: a fresh std::regex for every request that reaches it
+int regexDispatch(const std::string& path) {
+    if (path == "/api/streams") return 1;
+    if (path.find("/api/stream/") == 0) {
+        std::regex streamRegex("/api/stream/(\\d+)/(start|stop|status)");
+        std::smatch matches;
+        if (std::regex_match(path, matches, streamRegex)) {
+            return std::stoi(matches[1].str()) + 2;
+        }
+        return 0;
+    }
+    if (path.find("/stream/") == 0) {
+        std::regex streamRegex("/stream/(\\d+)(?:/(\\w+))?");
+        std::smatch matches;
+        if (std::regex_match(path, matches, streamRegex)) {
+            return std::stoi(matches[1].str()) + 3;
+        }
+    }
+    return 0;
+}
+
+int routerDispatch(const std::string& path) {
+    RouteMatch match = matchRoute("GET", path);
+    switch (match.id) {
+        case RouteId::ApiStreams: return 1;
+        case RouteId::ApiStreamStart:
+        case RouteId::ApiStreamStop:
+        case RouteId::ApiStreamStatus: return match.intParam(0) + 2;
+        case RouteId::StreamMjpeg:
+        case RouteId::StreamPage: return match.intParam(0) + 3;
+        // Endpoints added after the regex dispatch was retired
+        case RouteId::ApiStreamViewers:
+        case RouteId::ApiStreamEncoder:
+        case RouteId::ApiStreamKeyframe:
+        case RouteId::ApiStreamRenditions:
+        case RouteId::ApiStreamDestinations:
+        case RouteId::ApiStreamDestinationAdd:
+        case RouteId::ApiStreamDestinationRemove:
+        case RouteId::HlsPlaylist:
+        case RouteId::HlsInit:
+        case RouteId::HlsSegment:
+        case RouteId::HlsPart:
+        case RouteId::WsStream: return 0;
+        case RouteId::None: return 0;
+    }
+    return 0;
+}
+
+template <typename Dispatch>
+double nanosPerCall(Dispatch dispatch, const std::vector<std::string>& paths, long iterations, long& checksum) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        checksum += dispatch(paths[i % paths.size()]);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 200000;
+    if (iterations <= 0) iterations = 200000;
+
+    // Mix seen from a dashboard: status polls dominate, plus control and views
+    const std::vector<std::string> paths = {
+        "/api/streams",
+        "/api/stream/3/status",
+        "/api/stream/7/status",
+        "/api/stream/0/start",
+        "/api/stream/5/stop",
+        "/stream/2",
+        "/stream/4/mjpeg",
+        "/index.html",
+    };
+
+    long regexChecksum = 0;
+    long routerChecksum = 0;
+    double regexNs = nanosPerCall(regexDispatch, paths, iterations, regexChecksum);
+    double routerNs = nanosPerCall(routerDispatch, paths, iterations, routerChecksum);
+
+    std::cout << "iterations:   " << iterations << std::endl;
+    std::cout << "std::regex:   " << regexNs << " ns/request" << std::endl;
+    std::cout << "route table:  " << routerNs << " ns/request" << std::endl;
+    std::cout << "speedup:      " << (routerNs > 0 ? regexNs / routerNs : 0) << "x" << std::endl;
+
+    if (regexChecksum != routerChecksum) {
+        std::cerr << "Mismatch between regex and router results" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -39,6 +39,7 @@ case $OS in
         sudo apt-get install -y \
             build-essential \
             cmake \
+            curl \
             pkg-config \
             libgstreamer1.0-dev \
             libgstreamer-plugins-base1.0-dev \
@@ -50,6 +51,8 @@ case $OS in
             gstreamer1.0-libav \
             gstreamer1.0-tools \
             libssl-dev \
+            zlib1g-dev \
+            libbrotli-dev \
             libglib2.0-dev \
             libxml2-dev
         ;;
@@ -61,6 +64,7 @@ case $OS in
                 gcc-c++ \
                 make \
                 cmake \
+                curl \
                 pkgconfig \
                 gstreamer1-devel \
                 gstreamer1-plugins-base-devel \
@@ -70,6 +74,8 @@ case $OS in
                 gstreamer1-plugins-ugly \
                 gstreamer1-libav \
                 openssl-devel \
+                zlib-devel \
+                brotli-devel \
                 glib2-devel \
                 libxml2-devel
         else
@@ -78,6 +84,7 @@ case $OS in
                 gcc-c++ \
                 make \
                 cmake \
+                curl \
                 pkgconfig \
                 gstreamer1-devel \
                 gstreamer1-plugins-base-devel \
@@ -87,6 +94,8 @@ case $OS in
                 gstreamer1-plugins-ugly \
                 gstreamer1-libav \
                 openssl-devel \
+                zlib-devel \
+                brotli-devel \
                 glib2-devel \
                 libxml2-devel
         fi
@@ -99,11 +108,24 @@ case $OS in
         echo "  - pkg-config"
         echo "  - GStreamer 1.0 development libraries"
         echo "  - OpenSSL development libraries"
+        echo "  - zlib development libraries (brotli optional)"
         echo "  - GLib development libraries"
         exit 1
         ;;
 esac
 
+# hls.js for the LL-HLS player, served locally from web/vendor. Pinned to one
+# release; without it browsers other than Safari fall back to WebSocket/MSE.
+HLS_JS_VERSION=1.5.20
+HLS_JS_DIR="$(dirname "$0")/web/vendor"
+echo "Fetching hls.js $HLS_JS_VERSION..."
+mkdir -p "$HLS_JS_DIR"
+if ! curl -fsSL -o "$HLS_JS_DIR/hls.min.js" \
+        "https://cdn.jsdelivr.net/npm/hls.js@$HLS_JS_VERSION/dist/hls.min.js"; then
+    rm -f "$HLS_JS_DIR/hls.min.js"
+    echo "Warning: could not download hls.js; the player will use WebSocket/MSE"
+fi
+
 echo ""
 echo "Dependencies installed successfully!"
 echo ""
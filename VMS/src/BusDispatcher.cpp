@@ -0,0 +1,73 @@
+#include "BusDispatcher.h"
+#include <iostream>
+#include <future>
+
+BusDispatcher::BusDispatcher() {
+    m_context = g_main_context_new();
+    m_loop = g_main_loop_new(m_context, FALSE);
+}
+
+BusDispatcher::~BusDispatcher() {
+    stop();
+    g_main_loop_unref(m_loop);
+    g_main_context_unref(m_context);
+}
+
+void BusDispatcher::start() {
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_thread = std::thread(&BusDispatcher::run, this);
+    std::cout << "GStreamer bus dispatcher started" << std::endl;
+}
+
+void BusDispatcher::stop() {
+    if (m_thread.joinable()) {
+        // Quit from inside the loop so it cannot race with run() starting up
+        g_main_context_invoke(m_context, [](gpointer loop) -> gboolean {
+            g_main_loop_quit(static_cast<GMainLoop*>(loop));
+            return G_SOURCE_REMOVE;
+        }, m_loop);
+        m_thread.join();
+    }
+}
+
+GSource* BusDispatcher::addWatch(GstElement* pipeline, GstBusFunc callback, gpointer data) {
+    // Same as gst_bus_add_watch(), but attached to our context instead of
+    // the calling thread's default one
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GSource* watch = gst_bus_create_watch(bus);
+    g_source_set_callback(watch, G_SOURCE_FUNC(callback), data, NULL);
+    g_source_attach(watch, m_context);
+    gst_object_unref(bus);
+    return watch;
+}
+
+void BusDispatcher::removeWatch(GSource* watch) {
+    if (!watch) {
+        return;
+    }
+    g_source_destroy(watch);
+    g_source_unref(watch);
+    // A dispatch that started before the destroy may still be running
+    sync();
+}
+
+void BusDispatcher::run() {
+    g_main_context_push_thread_default(m_context);
+    g_main_loop_run(m_loop);
+    g_main_context_pop_thread_default(m_context);
+}
+
+void BusDispatcher::sync() {
+    if (!m_thread.joinable() || m_thread.get_id() == std::this_thread::get_id()) {
+        return;
+    }
+    std::promise<void> done;
+    std::future<void> dispatched = done.get_future();
+    g_main_context_invoke(m_context, [](gpointer data) -> gboolean {
+        static_cast<std::promise<void>*>(data)->set_value();
+        return G_SOURCE_REMOVE;
+    }, &done);
+    dispatched.wait();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <thread>
+
+// Runs one GMainLoop on a private GMainContext and dispatches the bus
+// messages of every pipeline from that single thread. The loop sleeps in
+// poll() until a message arrives, so idle pipelines cost no wakeups.
+class BusDispatcher {
+public:
+    BusDispatcher();
+    ~BusDispatcher();
+
+    void start();
+    void stop();
+
+    // Deliver messages of `pipeline`'s bus to `callback` on the dispatcher
+    // thread. Returns the watch to pass to removeWatch().
+    GSource* addWatch(GstElement* pipeline, GstBusFunc callback, gpointer data);
+    // After this returns the callback is not running and will not run again
+    void removeWatch(GSource* watch);
+
+private:
+    GMainContext* m_context;
+    GMainLoop* m_loop;
+    std::thread m_thread;
+
+    void run();
+    // Block until everything already queued on the context has been dispatched
+    void sync();
+};
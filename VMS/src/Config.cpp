@@ -0,0 +1,340 @@
+#include "Config.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <charconv>
+#include <algorithm>
+
+namespace {
+
+const char* const X264_PRESETS[] = {
+    "ultrafast", "superfast", "veryfast", "faster", "fast",
+    "medium", "slow", "slower", "veryslow", "placebo"
+};
+const char* const X264_TUNES[] = { "stillimage", "fastdecode", "zerolatency" };
+
+struct Entry {
+    int streamId;
+    std::string_view key;
+    std::string_view value;
+    int line;
+};
+
+std::string_view trim(std::string_view text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) return std::string_view();
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+// "value  # comment" -> "value"
+std::string_view stripComment(std::string_view value) {
+    for (size_t i = 0; i < value.size(); ++i) {
+        if ((value[i] == '#' || value[i] == ';') && (i == 0 || value[i - 1] == ' ' || value[i - 1] == '\t')) {
+            return trim(value.substr(0, i));
+        }
+    }
+    return trim(value);
+}
+
+bool parseInt(std::string_view text, int min, int max, int& value) {
+    int parsed = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) return false;
+    if (parsed < min || parsed > max) return false;
+    value = parsed;
+    return true;
+}
+
+// "540, 270" or "none"
+bool parseHeights(std::string_view text, std::vector<int>& heights) {
+    std::vector<int> parsed;
+    if (text != "none") {
+        while (!text.empty()) {
+            size_t comma = text.find(',');
+            int height = 0;
+            if (!parseInt(trim(text.substr(0, comma)), 16, 4320, height)) return false;
+            parsed.push_back(height);
+            text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+        }
+    }
+    heights = std::move(parsed);
+    return true;
+}
+
+// "10.0.0.5:5004, 239.1.1.1:5004, [ff15::1]:5004" or "none"
+bool parseDestinations(std::string_view text, std::vector<RtpDestination>& destinations) {
+    std::vector<RtpDestination> parsed;
+    if (text != "none") {
+        while (!text.empty()) {
+            size_t comma = text.find(',');
+            std::string_view entry = trim(text.substr(0, comma));
+            size_t colon = entry.rfind(':');
+            if (colon == std::string_view::npos) return false;
+            RtpDestination destination;
+            std::string_view host = entry.substr(0, colon);
+            if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+                host = host.substr(1, host.size() - 2);
+            }
+            destination.host = std::string(host);
+            if (destination.host.empty() || !parseInt(entry.substr(colon + 1), 1, 65535, destination.port)) return false;
+            parsed.push_back(destination);
+            text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+        }
+    }
+    destinations = std::move(parsed);
+    return true;
+}
+
+bool parseBool(std::string_view text, bool& value) {
+    if (text == "true" || text == "yes" || text == "on" || text == "1") {
+        value = true;
+        return true;
+    }
+    if (text == "false" || text == "no" || text == "off" || text == "0") {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+bool parseAdmission(std::string_view text, AdmissionPolicy& value) {
+    if (text == "off") value = AdmissionPolicy::Off;
+    else if (text == "reject") value = AdmissionPolicy::Reject;
+    else if (text == "queue") value = AdmissionPolicy::Queue;
+    else if (text == "downgrade") value = AdmissionPolicy::Downgrade;
+    else return false;
+    return true;
+}
+
+bool parseEgress(std::string_view text, RtpEgress& value) {
+    if (text == "udpsink") value = RtpEgress::UdpSink;
+    else if (text == "sendmmsg") value = RtpEgress::SendMmsg;
+    else if (text == "gso") value = RtpEgress::Gso;
+    else return false;
+    return true;
+}
+
+bool isTune(std::string_view value) {
+    // Flags combine with '+', e.g. "zerolatency+fastdecode"
+    while (!value.empty()) {
+        size_t plus = value.find('+');
+        std::string_view token = value.substr(0, plus);
+        bool known = false;
+        for (const char* tune : X264_TUNES) {
+            if (token == tune) known = true;
+        }
+        if (!known) return false;
+        value = plus == std::string_view::npos ? std::string_view() : value.substr(plus + 1);
+    }
+    return true;
+}
+
+// Returns false on a bad value; unknown keys are ignored
+bool applyProfileKey(StreamProfile& profile, std::string_view key, std::string_view value) {
+    if (key == "width") return parseInt(value, 16, 7680, profile.width);
+    if (key == "height") return parseInt(value, 16, 4320, profile.height);
+    if (key == "framerate") return parseInt(value, 1, 240, profile.framerate);
+    if (key == "bitrate") return parseInt(value, 16, 100000, profile.bitrate);
+    if (key == "gop") return parseInt(value, 1, 1000, profile.keyIntMax);
+    if (key == "encoder_threads") return parseInt(value, 0, 64, profile.encoderThreads);
+    if (key == "source_pattern") return parseInt(value, 0, 25, profile.sourcePattern);
+    if (key == "sink_port") return parseInt(value, 1, 65535, profile.sinkPort);
+    if (key == "renditions") return parseHeights(value, profile.renditionHeights);
+    if (key == "rendition_port_step") return parseInt(value, 1, 10000, profile.renditionPortStep);
+    if (key == "rtp_egress") return parseEgress(value, profile.rtpEgress);
+    if (key == "rtp_pacing") return parseBool(value, profile.rtpPacing);
+    if (key == "hls") return parseBool(value, profile.hls);
+    if (key == "destinations") return parseDestinations(value, profile.destinations);
+    if (key == "multicast_ttl") return parseInt(value, 0, 255, profile.multicastTtl);
+    if (key == "multicast_interface") {
+        profile.multicastInterface = std::string(value);
+        return true;
+    }
+    if (key == "encoder_preset") {
+        profile.encoderPreset = std::string(value);
+        return isEncoderPreset(value);
+    }
+    if (key == "encoder_tune") {
+        profile.encoderTune = std::string(value);
+        return isTune(value);
+    }
+    if (key == "sink_host") {
+        profile.sinkHost = std::string(value);
+        return !value.empty();
+    }
+    return true;
+}
+
+bool applyGlobalKey(VmsConfig& config, std::string_view section, std::string_view key,
+                    std::string_view value) {
+    if (section == "server") {
+        if (key == "host") {
+            config.host = std::string(value);
+            return !value.empty();
+        }
+        if (key == "port") return parseInt(value, 1, 65535, config.port);
+        if (key == "cache_control") {
+            config.cacheControl = std::string(value);
+            return !value.empty();
+        }
+        if (key == "cache_control_immutable") {
+            config.cacheControlImmutable = std::string(value);
+            return !value.empty();
+        }
+    } else if (section == "performance") {
+        if (key == "thread_pool_size") return parseInt(value, 1, 256, config.httpThreads);
+        if (key == "cpu_pinning") return parseBool(value, config.cpuPinning);
+        if (key == "admission") return parseAdmission(value, config.admission);
+        if (key == "encode_budget") return parseInt(value, 1, 100, config.encodeBudgetPercent);
+        if (key == "rtp_monitor") return parseBool(value, config.rtpMonitor);
+    } else if (section == "streams") {
+        if (key == "count") return parseInt(value, 0, 256, config.streamCount);
+        if (key == "base_port") return parseInt(value, 1, 65535, config.basePort);
+        if (key == "codec") return value == "h264";
+        // Older key names for the resolution
+        if (key == "resolution_width") key = "width";
+        if (key == "resolution_height") key = "height";
+        return applyProfileKey(config.defaults, key, value);
+    } else if (section == "gstreamer") {
+        return applyProfileKey(config.defaults, key, value);
+    }
+    return true;
+}
+
+std::string lineError(int line, const std::string& message) {
+    return "line " + std::to_string(line) + ": " + message;
+}
+
+} // namespace
+
+bool isEncoderPreset(std::string_view name) {
+    for (const char* preset : X264_PRESETS) {
+        if (name == preset) return true;
+    }
+    return false;
+}
+
+bool StreamProfile::operator==(const StreamProfile& other) const {
+    return width == other.width && height == other.height && framerate == other.framerate &&
+           bitrate == other.bitrate && encoderPreset == other.encoderPreset &&
+           encoderTune == other.encoderTune && encoderThreads == other.encoderThreads &&
+           keyIntMax == other.keyIntMax && sourcePattern == other.sourcePattern &&
+           sinkHost == other.sinkHost && sinkPort == other.sinkPort &&
+           renditionHeights == other.renditionHeights && renditionPortStep == other.renditionPortStep &&
+           rtpEgress == other.rtpEgress && rtpPacing == other.rtpPacing &&
+           destinations == other.destinations && multicastTtl == other.multicastTtl &&
+           multicastInterface == other.multicastInterface && hls == other.hls;
+}
+
+std::vector<Rendition> StreamProfile::renditions() const {
+    // Scaled encodes get proportionally fewer bits, but never starve
+    constexpr int MIN_RENDITION_BITRATE = 100;
+    std::vector<Rendition> ladder;
+    ladder.push_back(Rendition{std::to_string(height) + "p", width, height, bitrate, sinkPort});
+    for (size_t i = 0; i < renditionHeights.size(); ++i) {
+        if (renditionHeights[i] >= height) {
+            continue;
+        }
+        Rendition rendition;
+        // Even sizes for 4:2:0
+        rendition.height = renditionHeights[i] & ~1;
+        rendition.width = (width * rendition.height / height) & ~1;
+        rendition.name = std::to_string(rendition.height) + "p";
+        double scale = static_cast<double>(rendition.width) * rendition.height / (static_cast<double>(width) * height);
+        rendition.bitrate = std::max(MIN_RENDITION_BITRATE, static_cast<int>(bitrate * scale));
+        // Port follows the configured position so a skipped entry does not move the others
+        rendition.port = sinkPort + static_cast<int>(i + 1) * renditionPortStep;
+        ladder.push_back(rendition);
+    }
+    return ladder;
+}
+
+StreamProfile VmsConfig::profileFor(int streamId) const {
+    auto it = overrides.find(streamId);
+    StreamProfile profile = it != overrides.end() ? it->second : defaults;
+    if (profile.sinkPort == 0) {
+        profile.sinkPort = basePort + streamId;
+    }
+    return profile;
+}
+
+bool ConfigLoader::loadFile(const std::string& path, VmsConfig& config, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::ostringstream content;
+    content << file.rdbuf();
+    if (!parse(content.str(), config, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool ConfigLoader::parse(std::string_view text, VmsConfig& config, std::string& error) {
+    VmsConfig result;
+    std::vector<Entry> streamEntries;
+    std::string_view section;
+    int streamId = -1;
+    int lineNumber = 0;
+
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view line = trim(text.substr(0, newline));
+        text = newline == std::string_view::npos ? std::string_view() : text.substr(newline + 1);
+        ++lineNumber;
+
+        if (line.empty() || line.front() == '#' || line.front() == ';') {
+            continue;
+        }
+
+        if (line.front() == '[') {
+            if (line.back() != ']') {
+                error = lineError(lineNumber, "unterminated section header");
+                return false;
+            }
+            section = trim(line.substr(1, line.size() - 2));
+            streamId = -1;
+            // Per-stream overrides: [stream.3]
+            if (section.compare(0, 7, "stream.") == 0 &&
+                !parseInt(section.substr(7), 0, 65535, streamId)) {
+                error = lineError(lineNumber, "invalid stream section [" + std::string(section) + "]");
+                return false;
+            }
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string_view::npos) {
+            error = lineError(lineNumber, "expected key = value");
+            return false;
+        }
+        std::string_view key = trim(line.substr(0, equals));
+        std::string_view value = stripComment(line.substr(equals + 1));
+
+        if (streamId >= 0) {
+            // Applied after the pass so they override defaults declared later
+            streamEntries.push_back(Entry{streamId, key, value, lineNumber});
+            continue;
+        }
+        if (!applyGlobalKey(result, section, key, value)) {
+            error = lineError(lineNumber, "invalid value for " + std::string(key) + ": '" + std::string(value) + "'");
+            return false;
+        }
+    }
+
+    for (const Entry& entry : streamEntries) {
+        auto it = result.overrides.emplace(entry.streamId, result.defaults).first;
+        if (!applyProfileKey(it->second, entry.key, entry.value)) {
+            error = lineError(entry.line, "invalid value for " + std::string(entry.key) + ": '" +
+                              std::string(entry.value) + "'");
+            return false;
+        }
+    }
+
+    config = std::move(result);
+    return true;
+}
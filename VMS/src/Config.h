@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <vector>
+
+// One encoded output of a stream. The first is the full-size encode on the
+// stream's own port; scaled ones follow, each with its own encoder and port.
+struct Rendition {
+    std::string name;                           // "540p"
+    int width{0};
+    int height{0};
+    int bitrate{0};                             // kbit/s
+    int port{0};
+};
+
+// A receiver of a stream's RTP; the host may be a multicast group
+struct RtpDestination {
+    std::string host;
+    int port{0};
+
+    bool operator==(const RtpDestination& other) const { return host == other.host && port == other.port; }
+};
+
+// How a stream's RTP packets leave the process: the stock udpsink (a system
+// call per packet), or RtpSender with a frame's packets batched by sendmmsg
+// or handed to the kernel as UDP GSO segments
+enum class RtpEgress { UdpSink, SendMmsg, Gso };
+
+// Everything one stream's pipeline is built from. Two streams with equal
+// profiles produce identical pipelines, so a config reload only restarts
+// streams whose profile changed.
+struct StreamProfile {
+    int width{1920};
+    int height{1080};
+    int framerate{30};
+    int bitrate{2000};                          // kbit/s
+    std::string encoderPreset{"ultrafast"};     // x264enc speed-preset nick
+    std::string encoderTune{"zerolatency"};     // x264enc tune flags, '+'-separated
+    int encoderThreads{1};
+    int keyIntMax{30};                          // GOP length in frames
+    int sourcePattern{0};                       // videotestsrc pattern
+    std::string sinkHost{"127.0.0.1"};          // unicast host or multicast group
+    int sinkPort{0};                            // 0: base_port + stream id
+    std::vector<RtpDestination> destinations;   // more receivers of the full-size RTP
+    int multicastTtl{1};                        // hops multicast packets may take
+    std::string multicastInterface;             // e.g. "eth0"; empty: routing table decides
+    std::vector<int> renditionHeights;          // scaled renditions, e.g. {540, 270}
+    int renditionPortStep{100};                 // rendition N sends to sinkPort + N * step
+    RtpEgress rtpEgress{RtpEgress::Gso};
+    bool rtpPacing{true};                       // spread a frame's packets out instead of bursting them
+    bool hls{true};                             // LL-HLS output for browsers
+    
+    // The ladder, full size first. Heights not below the stream's own are
+    // skipped; bitrate scales with the pixel count.
+    std::vector<Rendition> renditions() const;
+
+    bool operator==(const StreamProfile& other) const;
+    bool operator!=(const StreamProfile& other) const { return !(*this == other); }
+};
+
+// What StreamManager does with a stream that does not fit the encode budget
+enum class AdmissionPolicy { Off, Reject, Queue, Downgrade };
+
+// x264 speed-preset nick, "ultrafast" ... "placebo"
+bool isEncoderPreset(std::string_view name);
+
+struct VmsConfig {
+    std::string host{"0.0.0.0"};
+    int port{8080};
+    int httpThreads{4};                         // [performance] thread_pool_size
+    std::string cacheControl{"no-cache"};       // web assets at their plain URLs
+    std::string cacheControlImmutable{"public, max-age=31536000, immutable"};   // fingerprinted URLs
+    bool cpuPinning{true};                      // [performance] cpu_pinning
+    AdmissionPolicy admission{AdmissionPolicy::Downgrade};  // [performance] admission
+    int encodeBudgetPercent{85};                // [performance] encode_budget, % of usable CPUs
+    bool rtpMonitor{false};                     // [performance] rtp_monitor
+
+    int streamCount{8};
+    int basePort{8081};
+    StreamProfile defaults;                     // from [streams] and [gstreamer]
+    std::map<int, StreamProfile> overrides;     // [stream.N] sections, defaults already applied
+
+    // Fully resolved profile for a stream, including its sink port
+    StreamProfile profileFor(int streamId) const;
+};
+
+// Reads the INI-style config/vms.conf: "[section]" headers, "key = value"
+// lines, comments starting with '#' or ';' (also after a value). Keys this
+// program does not use are ignored; malformed values are errors so a typo
+// cannot silently fall back to a default.
+class ConfigLoader {
+public:
+    static constexpr const char* DEFAULT_PATH = "config/vms.conf";
+
+    static bool loadFile(const std::string& path, VmsConfig& config, std::string& error);
+    static bool parse(std::string_view text, VmsConfig& config, std::string& error);
+};
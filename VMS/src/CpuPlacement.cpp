@@ -0,0 +1,259 @@
+#include "CpuPlacement.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+std::string readFirstLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// Shared CPU list of the highest cache level, e.g. "L3:0-7"; empty if unknown
+std::string lastLevelCache(const std::string& cpuDir) {
+    int bestLevel = -1;
+    std::string shared;
+    for (int index = 0;; ++index) {
+        std::string cacheDir = cpuDir + "/cache/index" + std::to_string(index);
+        std::string level = readFirstLine(cacheDir + "/level");
+        if (level.empty()) {
+            break;
+        }
+        int value = std::atoi(level.c_str());
+        if (value >= bestLevel) {
+            bestLevel = value;
+            shared = readFirstLine(cacheDir + "/shared_cpu_list");
+        }
+    }
+    return shared.empty() ? std::string() : "L" + std::to_string(bestLevel) + ":" + shared;
+}
+
+} // namespace
+
+CpuTopology CpuTopology::detect(const std::string& sysfsRoot) {
+    CpuTopology topology;
+
+    std::vector<int> online = parseCpuList(readFirstLine(sysfsRoot + "/online"));
+    if (online.empty()) {
+        for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu) {
+            online.push_back(static_cast<int>(cpu));
+        }
+    }
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    // Logical CPUs with the same sibling list are one physical core
+    std::map<std::string, size_t> coreBySiblings;
+    std::map<std::string, int> domainByCache;
+    for (int cpu : online) {
+        if (haveMask && (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))) {
+            continue;
+        }
+        std::string cpuDir = sysfsRoot + "/cpu" + std::to_string(cpu);
+        std::string siblings = readFirstLine(cpuDir + "/topology/thread_siblings_list");
+        if (siblings.empty()) {
+            siblings = std::to_string(cpu);
+        }
+        std::string cache = lastLevelCache(cpuDir);
+        if (cache.empty()) {
+            cache = "package:" + readFirstLine(cpuDir + "/topology/physical_package_id");
+        }
+        int domain = domainByCache.emplace(cache, static_cast<int>(domainByCache.size())).first->second;
+
+        auto core = coreBySiblings.find(siblings);
+        if (core == coreBySiblings.end()) {
+            coreBySiblings.emplace(siblings, topology.m_cores.size());
+            CpuCore entry;
+            entry.cpus.push_back(cpu);
+            entry.cacheDomain = domain;
+            topology.m_cores.push_back(entry);
+        } else {
+            topology.m_cores[core->second].cpus.push_back(cpu);
+        }
+    }
+    topology.m_cacheDomainCount = static_cast<int>(domainByCache.size());
+    return topology;
+}
+
+int CpuTopology::cpuCount() const {
+    size_t cpus = 0;
+    for (const CpuCore& core : m_cores) {
+        cpus += core.cpus.size();
+    }
+    return static_cast<int>(cpus);
+}
+
+std::string CpuTopology::describe() const {
+    std::ostringstream text;
+    text << cpuCount() << " CPUs, " << m_cores.size() << " cores, " << m_cacheDomainCount << " cache domain(s)";
+    return text.str();
+}
+
+CpuPlacement::CpuPlacement(CpuTopology topology)
+    : m_topology(std::move(topology)), m_load(m_topology.cores().size(), 0.0) {
+}
+
+std::vector<int> CpuPlacement::place(int streamId, int coreCount, double cost) {
+    release(streamId);
+    const std::vector<CpuCore>& cores = m_topology.cores();
+    if (cores.empty()) {
+        return {};
+    }
+    coreCount = std::max(1, coreCount);
+
+    // Least loaded cores of each cache domain; prefer a domain that can hold
+    // the whole stream, then the lowest average load
+    Assignment best{{}, cost};
+    size_t bestShortfall = 0;
+    double bestLoad = 0;
+    for (int domain = 0; domain < m_topology.cacheDomainCount(); ++domain) {
+        std::vector<size_t> candidates;
+        for (size_t i = 0; i < cores.size(); ++i) {
+            if (cores[i].cacheDomain == domain) {
+                candidates.push_back(i);
+            }
+        }
+        if (candidates.empty()) {
+            continue;
+        }
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [this](size_t a, size_t b) { return m_load[a] < m_load[b]; });
+        size_t shortfall = candidates.size() < static_cast<size_t>(coreCount) ? coreCount - candidates.size() : 0;
+        candidates.resize(coreCount - shortfall);
+        double load = 0;
+        for (size_t core : candidates) {
+            load += m_load[core];
+        }
+        load /= candidates.size();
+        if (best.cores.empty() || shortfall < bestShortfall ||
+            (shortfall == bestShortfall && load < bestLoad)) {
+            best.cores = candidates;
+            bestShortfall = shortfall;
+            bestLoad = load;
+        }
+    }
+
+    addLoad(best, 1.0);
+    m_assignments[streamId] = best;
+
+    std::vector<int> cpus;
+    for (size_t core : best.cores) {
+        cpus.insert(cpus.end(), cores[core].cpus.begin(), cores[core].cpus.end());
+    }
+    std::sort(cpus.begin(), cpus.end());
+    return cpus;
+}
+
+void CpuPlacement::updateCost(int streamId, double cost) {
+    auto it = m_assignments.find(streamId);
+    if (it == m_assignments.end()) {
+        return;
+    }
+    addLoad(it->second, -1.0);
+    it->second.cost = cost;
+    addLoad(it->second, 1.0);
+}
+
+void CpuPlacement::release(int streamId) {
+    auto it = m_assignments.find(streamId);
+    if (it == m_assignments.end()) {
+        return;
+    }
+    addLoad(it->second, -1.0);
+    m_assignments.erase(it);
+}
+
+void CpuPlacement::addLoad(const Assignment& assignment, double sign) {
+    if (assignment.cores.empty()) {
+        return;
+    }
+    double share = sign * assignment.cost / assignment.cores.size();
+    for (size_t core : assignment.cores) {
+        m_load[core] = std::max(0.0, m_load[core] + share);
+    }
+}
+
+std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    std::istringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        int first = 0;
+        int last = 0;
+        int fields = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (fields < 1 || first < 0) {
+            continue;
+        }
+        if (fields == 1) {
+            last = first;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::string formatCpuList(const std::vector<int>& cpus) {
+    std::ostringstream text;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            ++j;
+        }
+        text << (i > 0 ? "," : "") << cpus[i];
+        if (j > i) {
+            text << "-" << cpus[j];
+        }
+        i = j + 1;
+    }
+    return text.str();
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return !cpus.empty() && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+pid_t currentThreadId() {
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+double threadCpuSeconds(pid_t tid) {
+    std::string stat = readFirstLine("/proc/self/task/" + std::to_string(tid) + "/stat");
+    // The command name may contain spaces; fields resume after its ')'
+    size_t end = stat.rfind(')');
+    if (end == std::string::npos) {
+        return 0.0;
+    }
+    std::istringstream fields(stat.substr(end + 1));
+    std::string field;
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    // state is field 3; utime and stime are fields 14 and 15
+    for (int index = 3; index <= 15 && fields >> field; ++index) {
+        if (index == 14) {
+            utime = std::stoull(field);
+        } else if (index == 15) {
+            stime = std::stoull(field);
+        }
+    }
+    return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+
+// One physical core: the logical CPUs (SMT siblings) that share it and the
+// last-level cache domain it belongs to
+struct CpuCore {
+    std::vector<int> cpus;
+    int cacheDomain{0};
+};
+
+// Cores this process may run on, read from sysfs and filtered by the
+// process affinity mask (cpusets, taskset)
+class CpuTopology {
+public:
+    static CpuTopology detect(const std::string& sysfsRoot = "/sys/devices/system/cpu");
+
+    const std::vector<CpuCore>& cores() const { return m_cores; }
+    int cacheDomainCount() const { return m_cacheDomainCount; }
+    int cpuCount() const;
+    std::string describe() const;
+
+private:
+    std::vector<CpuCore> m_cores;
+    int m_cacheDomainCount{0};
+};
+
+// Assigns each stream a set of whole physical cores inside one cache domain,
+// choosing the least loaded ones. Load is the expected or measured CPU cost
+// of the streams already placed there, in cores busy (1.0 = one core).
+// Not thread-safe; StreamManager calls it under its stream lock.
+class CpuPlacement {
+public:
+    explicit CpuPlacement(CpuTopology topology);
+
+    // Logical CPUs for the stream's threads; empty if there is no topology
+    std::vector<int> place(int streamId, int coreCount, double cost);
+    // Replace a placed stream's cost with a measured one
+    void updateCost(int streamId, double cost);
+    void release(int streamId);
+
+    const CpuTopology& topology() const { return m_topology; }
+
+private:
+    struct Assignment {
+        std::vector<size_t> cores;      // indexes into m_topology.cores()
+        double cost;
+    };
+
+    CpuTopology m_topology;
+    std::vector<double> m_load;         // per core
+    std::map<int, Assignment> m_assignments;
+
+    void addLoad(const Assignment& assignment, double sign);
+};
+
+// "0-3,8,10-11" <-> {0,1,2,3,8,10,11}
+std::vector<int> parseCpuList(const std::string& text);
+std::string formatCpuList(const std::vector<int>& cpus);
+
+// Restrict the calling thread to `cpus`; threads it creates inherit the mask
+bool pinCurrentThread(const std::vector<int>& cpus);
+pid_t currentThreadId();
+// User + system CPU time a thread of this process has used; 0 once it exited
+double threadCpuSeconds(pid_t tid);
@@ -0,0 +1,144 @@
+#include "EncoderCostModel.h"
+#include "CpuPlacement.h"
+#include <gst/gst.h>
+#include <iostream>
+#include <sstream>
+#include <mutex>
+#include <vector>
+#include <ctime>
+
+namespace {
+// Before anything is measured: one core per 1080p30 stream (conversion plus
+// an ultrafast x264 encode)
+constexpr double DEFAULT_CORES_PER_PIXEL = 1.0 / (1920.0 * 1080.0 * 30.0);
+// Long enough to amortise encoder setup, short enough not to delay startup
+constexpr int CALIBRATION_FRAMES = 60;
+constexpr int CALIBRATION_TIMEOUT_SECONDS = 30;
+// Weight of a new measurement from a running stream
+constexpr double OBSERVE_WEIGHT = 0.25;
+
+double processCpuSeconds() {
+    timespec now{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Streaming threads of the calibration pipeline, collected like
+// GStreamerPipeline does for live streams. Task threads are pooled, so each
+// one's CPU time is taken relative to when it entered.
+struct CalibrationThreads {
+    std::mutex mutex;
+    std::vector<std::pair<pid_t, double>> entered;
+};
+
+GstBusSyncReply recordStreamingThread(GstBus* bus, GstMessage* message, gpointer data) {
+    (void)bus;
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        GstElement* owner;
+        gst_message_parse_stream_status(message, &type, &owner);
+        if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+            auto* threads = static_cast<CalibrationThreads*>(data);
+            std::lock_guard<std::mutex> lock(threads->mutex);
+            pid_t tid = currentThreadId();
+            threads->entered.emplace_back(tid, threadCpuSeconds(tid));
+        }
+    }
+    return GST_BUS_PASS;
+}
+}
+
+EncoderCostModel::EncoderCostModel() : m_fallbackCoresPerPixel(DEFAULT_CORES_PER_PIXEL) {
+}
+
+bool EncoderCostModel::calibrate(const StreamProfile& profile) {
+    // The live trunk, minus the live source and the outputs
+    std::ostringstream description;
+    description << "videotestsrc is-live=false pattern=" << profile.sourcePattern
+                << " num-buffers=" << CALIBRATION_FRAMES
+                << " ! video/x-raw,width=" << profile.width << ",height=" << profile.height
+                << ",framerate=" << profile.framerate << "/1"
+                << " ! videoconvert"
+                << " ! x264enc speed-preset=" << profile.encoderPreset << " tune=" << profile.encoderTune
+                << " threads=" << profile.encoderThreads << " key-int-max=" << profile.keyIntMax
+                << " bitrate=" << profile.bitrate
+                << " ! fakesink sync=false";
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(description.str().c_str(), &error);
+    if (!pipeline) {
+        std::cerr << "Encoder calibration failed: " << (error ? error->message : "unknown error") << std::endl;
+        g_clear_error(&error);
+        return false;
+    }
+
+    CalibrationThreads threads;
+    GstBus* bus = gst_element_get_bus(pipeline);
+    gst_bus_set_sync_handler(bus, &recordStreamingThread, &threads, NULL);
+    double cpuStart = processCpuSeconds();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstMessage* message = gst_bus_timed_pop_filtered(bus, CALIBRATION_TIMEOUT_SECONDS * GST_SECOND,
+                                                     static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    // With one encoder thread the single streaming thread does everything,
+    // which is what GStreamerPipeline::cpuSeconds() counts for a live trunk.
+    // Otherwise x264 adds worker threads only process CPU time can see.
+    double cpuSeconds = 0;
+    if (profile.encoderThreads == 1) {
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        for (const auto& thread : threads.entered) {
+            cpuSeconds += threadCpuSeconds(thread.first) - thread.second;
+        }
+    } else {
+        cpuSeconds = processCpuSeconds() - cpuStart;
+    }
+    bool finished = message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+    if (message) {
+        gst_message_unref(message);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+    gst_object_unref(bus);
+    gst_object_unref(pipeline);
+    if (!finished) {
+        std::cerr << "Encoder calibration did not finish for " << profile.width << "x" << profile.height
+                  << " " << profile.encoderPreset << std::endl;
+        return false;
+    }
+
+    // CPU per frame times frames per second = cores busy when live
+    double cores = cpuSeconds / CALIBRATION_FRAMES * profile.framerate;
+    m_coresPerPixel[settingsKey(profile)] = cores / pixelRate(profile);
+    m_fallbackCoresPerPixel = cores / pixelRate(profile);
+    std::cout << "Encoder cost for " << profile.width << "x" << profile.height << "@" << profile.framerate
+              << " " << profile.encoderPreset << ": " << cores << " cores" << std::endl;
+    return true;
+}
+
+double EncoderCostModel::cost(const StreamProfile& profile) const {
+    auto it = m_coresPerPixel.find(settingsKey(profile));
+    double coresPerPixel = it != m_coresPerPixel.end() ? it->second : m_fallbackCoresPerPixel;
+    return coresPerPixel * ladderPixelRate(profile);
+}
+
+void EncoderCostModel::observe(const StreamProfile& profile, double cores) {
+    double measured = cores / ladderPixelRate(profile);
+    auto inserted = m_coresPerPixel.emplace(settingsKey(profile), measured);
+    if (!inserted.second) {
+        inserted.first->second += OBSERVE_WEIGHT * (measured - inserted.first->second);
+    }
+}
+
+std::string EncoderCostModel::settingsKey(const StreamProfile& profile) {
+    return profile.encoderPreset + "/" + profile.encoderTune + "/" + std::to_string(profile.encoderThreads);
+}
+
+double EncoderCostModel::pixelRate(const StreamProfile& profile) {
+    return static_cast<double>(profile.width) * profile.height * profile.framerate;
+}
+
+double EncoderCostModel::ladderPixelRate(const StreamProfile& profile) {
+    double pixels = 0;
+    for (const Rendition& rendition : profile.renditions()) {
+        pixels += static_cast<double>(rendition.width) * rendition.height;
+    }
+    return pixels * profile.framerate;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include "Config.h"
+
+// Predicts how many cores a live stream keeps busy. For one set of encoder
+// settings (preset, tune, threads) cost grows linearly with the pixel rate,
+// so the model keeps cores per pixel/s for each setting it has seen, from
+// a short benchmark encode at startup and from running streams afterwards.
+// A stream with scaled renditions costs the sum over its ladder.
+class EncoderCostModel {
+public:
+    EncoderCostModel();
+
+    // Encode a burst of frames of `profile` as fast as possible and record
+    // its cost. Needs gst_init(). Single-threaded encodes are timed on their
+    // streaming thread, like a live trunk; others use process CPU time, so
+    // run it while nothing else is busy.
+    bool calibrate(const StreamProfile& profile);
+    // Cores the profile is expected to use while live
+    double cost(const StreamProfile& profile) const;
+    // Blend in what a running stream with this profile actually uses
+    void observe(const StreamProfile& profile, double cores);
+
+private:
+    std::map<std::string, double> m_coresPerPixel;      // by encoder settings
+    double m_fallbackCoresPerPixel;                     // for settings never seen
+
+    static std::string settingsKey(const StreamProfile& profile);
+    static double pixelRate(const StreamProfile& profile);
+    static double ladderPixelRate(const StreamProfile& profile);
+};
@@ -0,0 +1,228 @@
+#include "Fmp4Muxer.h"
+#include <cstdio>
+
+namespace {
+constexpr uint32_t TRACK_ID = 1;
+// trun: data-offset, sample duration, size, flags and composition offset present
+constexpr uint32_t TRUN_FLAGS = 0x000001 | 0x000100 | 0x000200 | 0x000400 | 0x000800;
+// tfhd: moof-relative data offsets (default-base-is-moof)
+constexpr uint32_t TFHD_FLAGS = 0x020000;
+// Sample flags: a sync sample depends on nothing; others depend on earlier
+// samples and are not sync samples
+constexpr uint32_t KEYFRAME_FLAGS = 0x02000000;
+constexpr uint32_t DELTA_FRAME_FLAGS = 0x01010000;
+
+// Appends big-endian fields and nested boxes whose sizes are patched in
+// when they are closed
+class BoxWriter {
+public:
+    explicit BoxWriter(std::string& out) : m_out(out) {}
+
+    void u8(uint8_t value) { m_out.push_back(static_cast<char>(value)); }
+    void u16(uint16_t value) { u8(value >> 8); u8(value & 0xff); }
+    void u32(uint32_t value) { u16(value >> 16); u16(value & 0xffff); }
+    void u64(uint64_t value) { u32(value >> 32); u32(value & 0xffffffff); }
+    void zeros(size_t count) { m_out.append(count, '\0'); }
+    void bytes(std::string_view data) { m_out.append(data); }
+
+    size_t open(const char* type) {
+        size_t start = m_out.size();
+        u32(0);
+        m_out.append(type, 4);
+        return start;
+    }
+    size_t openFull(const char* type, uint8_t version, uint32_t flags) {
+        size_t start = open(type);
+        u32((static_cast<uint32_t>(version) << 24) | flags);
+        return start;
+    }
+    void close(size_t start) { patch(start, static_cast<uint32_t>(m_out.size() - start)); }
+    void patch(size_t at, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            m_out[at + i] = static_cast<char>(value >> (24 - 8 * i));
+        }
+    }
+    size_t size() const { return m_out.size(); }
+
+    // Unity transformation matrix of mvhd and tkhd
+    void matrix() {
+        const uint32_t values[] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+        for (uint32_t value : values) u32(value);
+    }
+
+private:
+    std::string& m_out;
+};
+}
+
+Fmp4Muxer::Fmp4Muxer(int width, int height, std::string avcC) : m_avcC(std::move(avcC)) {
+    BoxWriter box(m_initSegment);
+
+    size_t ftyp = box.open("ftyp");
+    box.bytes("iso6");
+    box.u32(0);
+    box.bytes("iso6isomavc1mp41");
+    box.close(ftyp);
+
+    size_t moov = box.open("moov");
+    size_t mvhd = box.openFull("mvhd", 0, 0);
+    box.u32(0);                                 // creation and modification time
+    box.u32(0);
+    box.u32(1000);                              // movie timescale
+    box.u32(0);                                 // duration: unknown, fragments follow
+    box.u32(0x00010000);                        // rate 1.0
+    box.u16(0x0100);                            // volume 1.0
+    box.zeros(10);
+    box.matrix();
+    box.zeros(24);
+    box.u32(TRACK_ID + 1);                      // next track id
+    box.close(mvhd);
+
+    size_t trak = box.open("trak");
+    size_t tkhd = box.openFull("tkhd", 0, 0x000003);    // enabled, in movie
+    box.u32(0);
+    box.u32(0);
+    box.u32(TRACK_ID);
+    box.u32(0);
+    box.u32(0);                                 // duration
+    box.zeros(8);
+    box.u16(0);                                 // layer
+    box.u16(0);                                 // alternate group
+    box.u16(0);                                 // volume: video
+    box.u16(0);
+    box.matrix();
+    box.u32(static_cast<uint32_t>(width) << 16);
+    box.u32(static_cast<uint32_t>(height) << 16);
+    box.close(tkhd);
+
+    size_t mdia = box.open("mdia");
+    size_t mdhd = box.openFull("mdhd", 0, 0);
+    box.u32(0);
+    box.u32(0);
+    box.u32(TIMESCALE);
+    box.u32(0);
+    box.u16(0x55c4);                            // language "und"
+    box.u16(0);
+    box.close(mdhd);
+    size_t hdlr = box.openFull("hdlr", 0, 0);
+    box.u32(0);
+    box.bytes("vide");
+    box.zeros(12);
+    box.bytes(std::string_view("VideoHandler", 13));    // with the terminator
+    box.close(hdlr);
+
+    size_t minf = box.open("minf");
+    size_t vmhd = box.openFull("vmhd", 0, 1);
+    box.zeros(8);                               // graphics mode and opcolor
+    box.close(vmhd);
+    size_t dinf = box.open("dinf");
+    size_t dref = box.openFull("dref", 0, 0);
+    box.u32(1);
+    size_t url = box.openFull("url ", 0, 1);    // media is in this file
+    box.close(url);
+    box.close(dref);
+    box.close(dinf);
+
+    size_t stbl = box.open("stbl");
+    size_t stsd = box.openFull("stsd", 0, 0);
+    box.u32(1);
+    size_t avc1 = box.open("avc1");
+    box.zeros(6);
+    box.u16(1);                                 // data reference index
+    box.zeros(16);
+    box.u16(static_cast<uint16_t>(width));
+    box.u16(static_cast<uint16_t>(height));
+    box.u32(0x00480000);                        // 72 dpi
+    box.u32(0x00480000);
+    box.u32(0);
+    box.u16(1);                                 // frames per sample
+    box.zeros(32);                              // compressor name
+    box.u16(0x0018);                            // depth
+    box.u16(0xffff);
+    size_t avcc = box.open("avcC");
+    box.bytes(m_avcC);
+    box.close(avcc);
+    box.close(avc1);
+    box.close(stsd);
+    // Sample tables stay empty; every sample is described by its fragment
+    for (const char* table : {"stts", "stsc", "stco"}) {
+        size_t empty = box.openFull(table, 0, 0);
+        box.u32(0);
+        box.close(empty);
+    }
+    size_t stsz = box.openFull("stsz", 0, 0);
+    box.u32(0);
+    box.u32(0);
+    box.close(stsz);
+    box.close(stbl);
+    box.close(minf);
+    box.close(mdia);
+    box.close(trak);
+
+    size_t mvex = box.open("mvex");
+    size_t trex = box.openFull("trex", 0, 0);
+    box.u32(TRACK_ID);
+    box.u32(1);                                 // sample description index
+    box.u32(0);
+    box.u32(0);
+    box.u32(0);
+    box.close(trex);
+    box.close(mvex);
+    box.close(moov);
+}
+
+std::string Fmp4Muxer::codecString() const {
+    // Profile, constraint flags and level straight from the avcC header
+    if (m_avcC.size() < 4) {
+        return "avc1.42e01f";
+    }
+    char codec[16];
+    std::snprintf(codec, sizeof(codec), "avc1.%02x%02x%02x", static_cast<uint8_t>(m_avcC[1]),
+                  static_cast<uint8_t>(m_avcC[2]), static_cast<uint8_t>(m_avcC[3]));
+    return codec;
+}
+
+std::string Fmp4Muxer::fragment(const std::vector<Fmp4Sample>& samples) {
+    size_t payload = 0;
+    for (const Fmp4Sample& sample : samples) {
+        payload += sample.data.size();
+    }
+    std::string out;
+    out.reserve(payload + 120 + 16 * samples.size());
+    BoxWriter box(out);
+
+    size_t moof = box.open("moof");
+    size_t mfhd = box.openFull("mfhd", 0, 0);
+    box.u32(m_sequence++);
+    box.close(mfhd);
+    size_t traf = box.open("traf");
+    size_t tfhd = box.openFull("tfhd", 0, TFHD_FLAGS);
+    box.u32(TRACK_ID);
+    box.close(tfhd);
+    size_t tfdt = box.openFull("tfdt", 1, 0);
+    box.u64(samples.empty() ? 0 : static_cast<uint64_t>(samples.front().decodeTime));
+    box.close(tfdt);
+    // Version 1: signed composition offsets
+    size_t trun = box.openFull("trun", 1, TRUN_FLAGS);
+    box.u32(static_cast<uint32_t>(samples.size()));
+    size_t dataOffset = box.size();
+    box.u32(0);                                 // patched once the moof size is known
+    for (const Fmp4Sample& sample : samples) {
+        box.u32(sample.duration);
+        box.u32(static_cast<uint32_t>(sample.data.size()));
+        box.u32(sample.keyframe ? KEYFRAME_FLAGS : DELTA_FRAME_FLAGS);
+        box.u32(static_cast<uint32_t>(sample.compositionOffset));
+    }
+    box.close(trun);
+    box.close(traf);
+    box.close(moof);
+    // Sample data starts right after the mdat header
+    box.patch(dataOffset, static_cast<uint32_t>(box.size() - moof + 8));
+
+    size_t mdat = box.open("mdat");
+    for (const Fmp4Sample& sample : samples) {
+        box.bytes(sample.data);
+    }
+    box.close(mdat);
+    return out;
+}
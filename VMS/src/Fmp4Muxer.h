@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// One H.264 access unit in AVC form (length-prefixed NAL units), timed in
+// units of Fmp4Muxer::TIMESCALE
+struct Fmp4Sample {
+    std::string data;
+    int64_t decodeTime{0};
+    int32_t compositionOffset{0};   // presentation minus decode time
+    uint32_t duration{0};
+    bool keyframe{false};
+};
+
+// Writes fragmented MP4 (ISO BMFF) for a single H.264 track: an init
+// segment (ftyp + moov) built from the avcC record, then any number of
+// moof + mdat fragments. Output is plain bytes, so the same fragments can
+// back HLS parts and MSE appends alike.
+class Fmp4Muxer {
+public:
+    static constexpr uint32_t TIMESCALE = 90000;
+    // Nanoseconds (GStreamer time) to TIMESCALE ticks, rounded
+    static int64_t toTicks(int64_t ns) {
+        return ns / 1000000000 * TIMESCALE + ((ns % 1000000000) * 9 + 50000) / 100000;
+    }
+
+    // avcC is the decoder configuration record (h264parse's codec_data)
+    Fmp4Muxer(int width, int height, std::string avcC);
+
+    const std::string& initSegment() const { return m_initSegment; }
+    const std::string& avcC() const { return m_avcC; }
+    // RFC 6381 codecs parameter, e.g. "avc1.42c01f"
+    std::string codecString() const;
+    // One moof + mdat holding the samples in decode order
+    std::string fragment(const std::vector<Fmp4Sample>& samples);
+
+private:
+    std::string m_avcC;
+    std::string m_initSegment;
+    uint32_t m_sequence{1};
+};
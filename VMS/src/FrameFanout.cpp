@@ -0,0 +1,98 @@
+#include "FrameFanout.h"
+#include <algorithm>
+
+FrameFanout::FrameFanout() {
+}
+
+FrameFanout::~FrameFanout() {
+    close();
+}
+
+bool FrameFanout::subscribe(const std::shared_ptr<Subscriber>& subscriber) {
+    DemandListener listener;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed) {
+            return false;
+        }
+        m_subscribers.push_back(subscriber);
+        m_subscriberCount = m_subscribers.size();
+        if (m_subscribers.size() == 1) {
+            listener = m_demandListener;
+        }
+    }
+    if (listener) {
+        listener();
+    }
+    return true;
+}
+
+void FrameFanout::setDemandListener(DemandListener listener) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_demandListener = std::move(listener);
+}
+
+void FrameFanout::unsubscribe(const Subscriber* subscriber) {
+    DemandListener listener;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t before = m_subscribers.size();
+        m_subscribers.erase(std::remove_if(m_subscribers.begin(), m_subscribers.end(),
+                                           [subscriber](const std::shared_ptr<Subscriber>& s) {
+                                               return s.get() == subscriber;
+                                           }),
+                            m_subscribers.end());
+        m_subscriberCount = m_subscribers.size();
+        if (before > 0 && m_subscribers.empty() && !m_closed) {
+            listener = m_demandListener;
+        }
+    }
+    if (listener) {
+        listener();
+    }
+}
+
+void FrameFanout::publish(std::shared_ptr<const EncodedFrame> frame) {
+    // Deliver outside the lock so a subscriber may unsubscribe concurrently
+    std::vector<std::shared_ptr<Subscriber>> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed || m_subscribers.empty()) {
+            return;
+        }
+        subscribers = m_subscribers;
+    }
+    for (const auto& subscriber : subscribers) {
+        subscriber->onFrame(frame);
+    }
+}
+
+void FrameFanout::close() {
+    std::vector<std::shared_ptr<Subscriber>> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed) {
+            return;
+        }
+        m_closed = true;
+        subscribers.swap(m_subscribers);
+        m_subscriberCount = 0;
+    }
+    for (const auto& subscriber : subscribers) {
+        subscriber->onFrame(nullptr);
+    }
+}
+
+std::vector<ViewerStats> FrameFanout::viewerStats() {
+    std::vector<std::shared_ptr<Subscriber>> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        subscribers = m_subscribers;
+    }
+    std::vector<ViewerStats> stats;
+    stats.reserve(subscribers.size());
+    for (const auto& subscriber : subscribers) {
+        stats.push_back(subscriber->stats());
+    }
+    return stats;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// Boundary separating the parts of a multipart/x-mixed-replace MJPEG response
+inline constexpr char MJPEG_BOUNDARY[] = "vmsframe";
+
+// One encoded unit (e.g. a multipart JPEG part), serialized once and shared
+// read-only by every viewer it is delivered to.
+struct EncodedFrame {
+    std::string data;
+    uint64_t sequence{0};
+    // Decodable on its own. A viewer may skip to any independent frame, but
+    // after skipping a dependent one it waits for the next independent one.
+    bool independent{true};
+};
+
+// Delivery counters of one viewer, as reported by the API
+struct ViewerStats {
+    uint64_t id{0};
+    std::string peer;
+    double connectedSeconds{0};
+    uint64_t framesDelivered{0};
+    uint64_t framesDropped{0};      // replaced by a newer frame before they could be sent
+    double deliveredFps{0};
+    double droppedFps{0};
+};
+
+// Distributes frames produced on a GStreamer streaming thread to any number
+// of viewers. publish() never blocks on a viewer: subscribers only record the
+// frame and schedule their own delivery.
+class FrameFanout {
+public:
+    class Subscriber {
+    public:
+        virtual ~Subscriber() = default;
+        // Called on the producer thread; a null frame means the stream ended
+        virtual void onFrame(const std::shared_ptr<const EncodedFrame>& frame) = 0;
+        // May be called from any thread
+        virtual ViewerStats stats() const = 0;
+    };
+
+    FrameFanout();
+    ~FrameFanout();
+
+    // Returns false if the stream has already ended
+    bool subscribe(const std::shared_ptr<Subscriber>& subscriber);
+    // Called outside the lock on the thread that changed the subscribers,
+    // when the first viewer arrives or the last one leaves, so a producer can
+    // start and stop work on demand. Calls may overlap: act on
+    // subscriberCount(), not on which transition fired.
+    using DemandListener = std::function<void()>;
+    void setDemandListener(DemandListener listener);
+    void unsubscribe(const Subscriber* subscriber);
+
+    void publish(std::shared_ptr<const EncodedFrame> frame);
+    // Tell every subscriber the stream ended and refuse new ones
+    void close();
+    
+    std::vector<ViewerStats> viewerStats();
+
+    // Producers check this to skip encoding while nobody is watching
+    size_t subscriberCount() const { return m_subscriberCount.load(std::memory_order_relaxed); }
+    uint64_t nextSequence() { return m_sequence.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    std::vector<std::shared_ptr<Subscriber>> m_subscribers;
+    std::mutex m_mutex;
+    std::atomic<size_t> m_subscriberCount{0};
+    std::atomic<uint64_t> m_sequence{0};
+    bool m_closed{false};
+    DemandListener m_demandListener;        // guarded by m_mutex
+};
@@ -1,11 +1,106 @@
 #include "GStreamerPipeline.h"
+#include "CpuPlacement.h"
+#include "RtpSender.h"
+#include <gst/video/video.h>
 #include <iostream>
 #include <sstream>
+#include <cstdlib>
+#include <algorithm>
 
-GStreamerPipeline::GStreamerPipeline(int streamId, int port, int width, int height, int framerate)
-    : m_streamId(streamId), m_port(port), m_width(width), m_height(height), m_framerate(framerate),
-      m_pipeline(nullptr), m_source(nullptr), m_videoconvert(nullptr), m_encoder(nullptr),
-      m_payloader(nullptr), m_udpsink(nullptr), m_running(false) {
+namespace {
+constexpr int MJPEG_QUALITY = 80;
+
+// A detached branch on its way out; holds its own references so it can
+// outlive both removeBranch() and the pipeline object
+struct BranchUnlink {
+    GstElement* pipeline;
+    GstElement* tee;
+    GstPad* teePad;
+    GstElement* bin;
+    bool unlinked{false};
+};
+
+void releaseBranchUnlink(gpointer data) {
+    auto* unlink = static_cast<BranchUnlink*>(data);
+    gst_object_unref(unlink->bin);
+    gst_object_unref(unlink->teePad);
+    gst_object_unref(unlink->tee);
+    gst_object_unref(unlink->pipeline);
+    delete unlink;
+}
+}
+
+// One round of encoder restarts. Each encoder's idle probe swaps it on its own
+// streaming thread; the round holds one extra count for startReopen() itself,
+// so whoever finishes last, probe or caller, does so with no locks held.
+struct GStreamerPipeline::EncoderReopen {
+    GStreamerPipeline* pipeline;
+    StreamProfile profile;                  // the stream's profile once this round succeeds
+    StreamProfile previous;                 // what is committed while it runs
+    ProfileCallback done;
+    bool rollback{false};                   // this round puts switched encoders back
+    std::vector<Encoder> encoders;          // referenced until the round is gone
+    std::vector<StreamProfile> targets;     // per encoder: settings to switch to
+    std::vector<StreamProfile> fallbacks;   // per encoder: settings it ran before
+    std::vector<char> switched;             // per encoder, written by its probe only
+    std::atomic<size_t> pending{0};
+    std::atomic<bool> failed{false};
+    
+    ~EncoderReopen() {
+        for (const Encoder& encoder : encoders) {
+            gst_object_unref(encoder.feed);
+            gst_object_unref(encoder.encoder);
+        }
+    }
+};
+
+// Lets the MSE fanout's demand listener reach the pipeline until stop()
+// cuts it off; an attach or detach in progress finishes before stop() goes on
+struct GStreamerPipeline::AvcDemand {
+    std::mutex mutex;
+    GStreamerPipeline* pipeline;
+};
+
+struct GStreamerPipeline::EncoderSwap {
+    std::shared_ptr<EncoderReopen> reopen;
+    size_t index;
+};
+
+// An appsink's sender plus the packets of the frame it is collecting. The
+// payloader may push a frame in several lists (one per NAL unit); packets are
+// held until the RTP marker bit ends the access unit, then leave together.
+struct GStreamerPipeline::RtpOutput {
+    RtpOutput(RtpEgress mode, int multicastTtl, const std::string& multicastInterface)
+        : sender(mode, multicastTtl, multicastInterface) {}
+    ~RtpOutput() { release(); }
+    
+    RtpSender sender;
+    std::vector<GstSample*> samples;
+    std::vector<GstBuffer*> buffers;
+    std::vector<GstMapInfo> maps;
+    std::vector<iovec> packets;
+    
+    void release() {
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            gst_buffer_unmap(buffers[i], &maps[i]);
+        }
+        for (GstSample* sample : samples) {
+            gst_sample_unref(sample);
+        }
+        samples.clear();
+        buffers.clear();
+        maps.clear();
+        packets.clear();
+    }
+};
+
+GStreamerPipeline::GStreamerPipeline(int streamId, const StreamProfile& profile, BusDispatcher& busDispatcher)
+    : m_streamId(streamId), m_profile(profile),
+      m_pipeline(nullptr), m_source(nullptr), m_videoconvert(nullptr), m_rawTee(nullptr),
+      m_encodeQueue(nullptr), m_encoder(nullptr), m_encodedTee(nullptr),
+      m_payloader(nullptr), m_rtpSink(nullptr),
+      m_mjpegQueue(nullptr), m_jpegEncoder(nullptr), m_mjpegSink(nullptr),
+      m_mjpegFanout(std::make_shared<FrameFanout>()), m_running(false), m_busDispatcher(busDispatcher) {
 }
 
 GStreamerPipeline::~GStreamerPipeline() {
@@ -29,34 +124,65 @@ bool GStreamerPipeline::initialize() {
     m_source = gst_element_factory_make("videotestsrc", name.c_str());
     name = std::string("videoconvert-") + std::to_string(m_streamId);
     m_videoconvert = gst_element_factory_make("videoconvert", name.c_str());
+    name = std::string("rawtee-") + std::to_string(m_streamId);
+    m_rawTee = gst_element_factory_make("tee", name.c_str());
+    name = std::string("encodequeue-") + std::to_string(m_streamId);
+    m_encodeQueue = gst_element_factory_make("queue", name.c_str());
     name = std::string("encoder-") + std::to_string(m_streamId);
     m_encoder = gst_element_factory_make("x264enc", name.c_str());
-    name = std::string("payloader-") + std::to_string(m_streamId);
-    m_payloader = gst_element_factory_make("rtph264pay", name.c_str());
-    name = std::string("udpsink-") + std::to_string(m_streamId);
-    m_udpsink = gst_element_factory_make("udpsink", name.c_str());
+    name = std::string("encodedtee-") + std::to_string(m_streamId);
+    m_encodedTee = gst_element_factory_make("tee", name.c_str());
     
-    if (!m_source || !m_videoconvert || !m_encoder || !m_payloader || !m_udpsink) {
+    if (!m_source || !m_videoconvert || !m_rawTee || !m_encodeQueue || !m_encoder || !m_encodedTee) {
         std::cerr << "Failed to create GStreamer elements for stream " << m_streamId << std::endl;
         return false;
     }
     
-    // Configure source - use pattern 2 for moving test pattern
-    // Available patterns: 0=solid color, 1=smpte, 2=color bars, 3=ball, 4=smpte75, 5=zone plate, 6=gamut, 7=chroma zone plate, 8=solid color, 9=black, 10=white, 11=red, 12=green, 13=blue, 14=checkers-1, 15=checkers-2, 16=checkers-4, 17=checkers-8, 18=circular, 19=blink, 20=smpte100, 21=bar, 22=pinwheel, 23=spokes, 24=gradient, 25=colors
+    // Configure source from the stream profile (source_pattern in vms.conf)
+    // Available patterns: 0=smpte, 1=snow, 2=black, 3=white, 4=red, 5=green, 6=blue, 7=checkers-1, 8=checkers-2, 9=checkers-4, 10=checkers-8, 11=circular, 12=blink, 13=smpte75, 14=zone-plate, 15=gamut, 16=chroma-zone-plate, 17=solid-color, 18=ball, 19=smpte100, 20=bar, 21=pinwheel, 22=spokes, 23=gradient, 24=colors, 25=smpte-rp-219
     g_object_set(m_source,
-                 "pattern", 2,  // 2 = SMPTE color bars with moving elements
+                 "pattern", m_profile.sourcePattern,
                  "is-live", TRUE,
                  NULL);
     
-    // Configure encoder (more deterministic across multiple instances)
-    g_object_set(m_encoder,
-                 "bitrate", 2000,
-                 "speed-preset", 1,          // ultrafast
-                 "tune", 0x00000004,         // zerolatency bitflag explicitly
-                 "byte-stream", TRUE,
-                 "key-int-max", 30,
-                 "threads", 1,
-                 NULL);
+    // Configure encoder from the stream profile (more deterministic across multiple instances)
+    configureEncoder(m_encoder, m_profile);
+    m_encoders.push_back(Encoder{m_encodeQueue, m_encoder, m_encodeQueue});
+    
+    // Tees keep running when a branch is being swapped out or none is attached
+    g_object_set(m_rawTee, "allow-not-linked", TRUE, NULL);
+    g_object_set(m_encodedTee, "allow-not-linked", TRUE, NULL);
+    
+    // Add the shared trunk to the pipeline and link it
+    gst_bin_add_many(GST_BIN(m_pipeline), m_source, m_videoconvert, m_rawTee,
+                     m_encodeQueue, m_encoder, m_encodedTee, NULL);
+    GstCaps* caps = gst_caps_new_simple("video/x-raw",
+                                        "width", G_TYPE_INT, m_profile.width,
+                                        "height", G_TYPE_INT, m_profile.height,
+                                        "framerate", GST_TYPE_FRACTION, m_profile.framerate, 1,
+                                        NULL);
+    bool sourceLinked = gst_element_link_filtered(m_source, m_videoconvert, caps);
+    gst_caps_unref(caps);
+    if (!sourceLinked ||
+        !gst_element_link_many(m_videoconvert, m_rawTee, NULL) ||
+        !gst_element_link_many(m_rawTee, m_encodeQueue, m_encoder, m_encodedTee, NULL)) {
+        std::cerr << "Failed to link GStreamer elements for stream " << m_streamId << std::endl;
+        return false;
+    }
+    
+    // RTP/UDP output branch
+    name = std::string("rtpqueue-") + std::to_string(m_streamId);
+    GstElement* rtpQueue = gst_element_factory_make("queue", name.c_str());
+    name = std::string("payloader-") + std::to_string(m_streamId);
+    m_payloader = gst_element_factory_make("rtph264pay", name.c_str());
+    // Configured extra receivers get the full-size stream
+    std::vector<RtpDestination> destinations{RtpDestination{m_profile.sinkHost, m_profile.sinkPort}};
+    destinations.insert(destinations.end(), m_profile.destinations.begin(), m_profile.destinations.end());
+    m_rtpSink = createRtpSink(std::to_string(m_streamId), destinations, m_profile.bitrate);
+    if (!rtpQueue || !m_payloader || !m_rtpSink) {
+        std::cerr << "Failed to create RTP output for stream " << m_streamId << std::endl;
+        return false;
+    }
     
     // Configure payloader
     g_object_set(m_payloader,
@@ -64,25 +190,92 @@ bool GStreamerPipeline::initialize() {
                  "config-interval", 1,
                  NULL);
     
-    // Configure UDP sink to localhost
-    g_object_set(m_udpsink,
-                 "host", "127.0.0.1",
-                 "port", m_port,
+    name = std::string("rtp-branch-") + std::to_string(m_streamId);
+    if (addBranch(Tap::Encoded, createBranch(name, {rtpQueue, m_payloader, m_rtpSink})) < 0) {
+        std::cerr << "Failed to attach RTP output for stream " << m_streamId << std::endl;
+        return false;
+    }
+    
+    std::vector<Rendition> ladder = m_profile.renditions();
+    for (size_t i = 1; i < ladder.size(); ++i) {
+        if (!addRendition(i, ladder[i])) {
+            std::cerr << "Failed to attach " << ladder[i].name << " rendition for stream " << m_streamId << std::endl;
+            return false;
+        }
+    }
+    
+    // MJPEG output branch
+    name = std::string("mjpegqueue-") + std::to_string(m_streamId);
+    m_mjpegQueue = gst_element_factory_make("queue", name.c_str());
+    name = std::string("jpegenc-") + std::to_string(m_streamId);
+    m_jpegEncoder = gst_element_factory_make("jpegenc", name.c_str());
+    name = std::string("mjpegsink-") + std::to_string(m_streamId);
+    m_mjpegSink = gst_element_factory_make("appsink", name.c_str());
+    if (!m_mjpegQueue || !m_jpegEncoder || !m_mjpegSink) {
+        std::cerr << "Failed to create MJPEG output for stream " << m_streamId << std::endl;
+        return false;
+    }
+    
+    // MJPEG branch keeps only the newest raw frame so a slow JPEG encode never
+    // backs up into the H.264 branch
+    g_object_set(m_mjpegQueue,
+                 "leaky", 2,                 // downstream: drop older buffers
+                 "max-size-buffers", 1,
+                 "max-size-bytes", 0,
+                 "max-size-time", (guint64)0,
+                 NULL);
+    g_object_set(m_jpegEncoder, "quality", MJPEG_QUALITY, NULL);
+    g_object_set(m_mjpegSink,
                  "sync", FALSE,
+                 "max-buffers", 1,
+                 "drop", TRUE,
                  NULL);
+    GstAppSinkCallbacks callbacks{};
+    callbacks.new_sample = &GStreamerPipeline::onMjpegSample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(m_mjpegSink), &callbacks, this, NULL);
     
-    // Add elements to pipeline
-    gst_bin_add_many(GST_BIN(m_pipeline), m_source, m_videoconvert, m_encoder, m_payloader, m_udpsink, NULL);
+    // Skip JPEG encoding entirely while there are no MJPEG viewers
+    GstPad* mjpegPad = gst_element_get_static_pad(m_mjpegQueue, "sink");
+    gst_pad_add_probe(mjpegPad, GST_PAD_PROBE_TYPE_BUFFER, &GStreamerPipeline::mjpegGateProbe,
+                      m_mjpegFanout.get(), NULL);
+    gst_object_unref(mjpegPad);
     
-    // Link elements
-    if (!gst_element_link_many(m_source, m_videoconvert, m_encoder, m_payloader, m_udpsink, NULL)) {
-        std::cerr << "Failed to link GStreamer elements for stream " << m_streamId << std::endl;
+    name = std::string("mjpeg-branch-") + std::to_string(m_streamId);
+    if (addBranch(Tap::Raw, createBranch(name, {m_mjpegQueue, m_jpegEncoder, m_mjpegSink})) < 0) {
+        std::cerr << "Failed to attach MJPEG output for stream " << m_streamId << std::endl;
         return false;
     }
     
-    // Start bus watch thread to log errors/states
+    // fMP4 for MSE viewers and LL-HLS. HLS needs every frame from the start;
+    // for MSE alone the branch comes and goes with the viewers.
+    m_mse = std::make_shared<MseStreamer>(m_profile.framerate);
+    if (m_profile.hls) {
+        m_hls = std::make_shared<HlsPackager>(static_cast<double>(m_profile.keyIntMax) / m_profile.framerate,
+                                              m_profile.framerate);
+        if (addAvcOutput() < 0) {
+            std::cerr << "Failed to attach fMP4 output for stream " << m_streamId << std::endl;
+            return false;
+        }
+    } else {
+        m_avcDemand = std::make_shared<AvcDemand>();
+        m_avcDemand->pipeline = this;
+        std::shared_ptr<AvcDemand> demand = m_avcDemand;
+        m_mse->fanout()->setDemandListener([demand] {
+            std::lock_guard<std::mutex> lock(demand->mutex);
+            if (demand->pipeline) {
+                demand->pipeline->updateAvcOutput();
+            }
+        });
+    }
+    
+    // Log errors/states from the shared bus dispatcher thread
     m_running = true;
-    m_busThread = std::thread(&GStreamerPipeline::busWatch, this);
+    m_busWatch = m_busDispatcher.addWatch(m_pipeline, &GStreamerPipeline::busCallback, this);
+    
+    // Catch streaming threads as they start so they can be pinned and measured
+    GstBus* bus = gst_element_get_bus(m_pipeline);
+    gst_bus_set_sync_handler(bus, &GStreamerPipeline::syncBusHandler, this, NULL);
+    gst_object_unref(bus);
     
     // Start pipeline
     GstStateChangeReturn ret = gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
@@ -114,20 +307,61 @@ bool GStreamerPipeline::initialize() {
         return false;
     }
     
-    std::cout << "GStreamer pipeline started for stream " << m_streamId << " on port " << m_port << std::endl;
+    std::cout << "GStreamer pipeline started for stream " << m_streamId << " on port " << m_profile.sinkPort
+              << " (" << m_profile.width << "x" << m_profile.height << "@" << m_profile.framerate
+              << ", " << m_profile.bitrate << " kbit/s, " << m_profile.encoderPreset
+              << (m_cpus.empty() ? std::string() : ", CPUs " + formatCpuList(m_cpus)) << ")" << std::endl;
     
     return true;
 }
 
 void GStreamerPipeline::stop() {
+    std::lock_guard<std::mutex> encoderLock(m_encoderMutex);
+    if (m_avcDemand) {
+        // Viewers coming or going no longer touch the branches from here on
+        std::lock_guard<std::mutex> lock(m_avcDemand->mutex);
+        m_avcDemand->pipeline = nullptr;
+        m_avcBranch = -1;
+    }
     if (m_pipeline) {
         m_running = false;
         
         // Stop pipeline
         gst_element_set_state(m_pipeline, GST_STATE_NULL);
+        
+        // Streaming threads are joined; nothing posts synchronously any more
+        GstBus* bus = gst_element_get_bus(m_pipeline);
+        gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+        gst_object_unref(bus);
+        
+        {
+            std::lock_guard<std::mutex> lock(m_branchMutex);
+            for (auto& branch : m_branches) {
+                gst_object_unref(branch.second.teePad);
+            }
+            m_branches.clear();
+        }
+        m_encoders.clear();
+        
+        // Streaming threads are gone, so the senders have no more callers
+        for (const auto& output : m_rtpOutputs) {
+            RtpSender::Stats stats = output->sender.stats();
+            std::cout << "RTP egress for stream " << m_streamId << ": " << stats.packets << " packets in "
+                      << stats.syscalls << " system calls, " << stats.errors << " dropped" << std::endl;
+        }
+        m_rtpOutputs.clear();
+        m_udpSinks.clear();
 
-        if (m_busThread.joinable()) {
-            m_busThread.join();
+        m_busDispatcher.removeWatch(m_busWatch);
+        m_busWatch = nullptr;
+        
+        // No more samples can arrive; end every viewer's response
+        m_mjpegFanout->close();
+        if (m_mse) {
+            m_mse->close();
+        }
+        if (m_hls) {
+            m_hls->close();
         }
         
         // Clean up
@@ -140,7 +374,7 @@ void GStreamerPipeline::stop() {
 
 std::string GStreamerPipeline::getStreamUrl() {
     std::ostringstream url;
-    url << "udp://127.0.0.1:" << m_port;
+    url << "udp://" << m_profile.sinkHost << ":" << m_profile.sinkPort;
     return url.str();
 }
 
@@ -151,20 +385,526 @@ void GStreamerPipeline::setTestPattern(int pattern) {
     }
 }
 
-void GStreamerPipeline::busWatch() {
-    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(m_pipeline));
+int GStreamerPipeline::addAvcOutput() {
+    // Unique per attach: a detached bin may still be in the pipeline
+    std::string suffix = std::to_string(m_streamId) + "-" + std::to_string(m_avcAttaches++);
+    GstElement* queue = gst_element_factory_make("queue", ("avcqueue-" + suffix).c_str());
+    GstElement* parser = gst_element_factory_make("h264parse", ("avcparse-" + suffix).c_str());
+    GstElement* sink = gst_element_factory_make("appsink", ("avcsink-" + suffix).c_str());
+    if (!queue || !parser || !sink) {
+        for (GstElement* element : {queue, parser, sink}) {
+            if (element) gst_object_unref(element);
+        }
+        return -1;
+    }
     
-    while (m_running) {
-        GstMessage* message = gst_bus_timed_pop_filtered(bus, 100 * GST_MSECOND,
-            (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_STATE_CHANGED));
+    // Length-prefixed access units with codec_data, as fMP4 stores them. No
+    // frame may be dropped here: a gap would corrupt the fragment it falls in.
+    GstCaps* caps = gst_caps_from_string("video/x-h264,stream-format=avc,alignment=au");
+    g_object_set(sink, "caps", caps, "sync", FALSE, NULL);
+    gst_caps_unref(caps);
+    GstAppSinkCallbacks callbacks{};
+    callbacks.new_sample = &GStreamerPipeline::onAvcSample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, this, NULL);
+    
+    m_avcSink = sink;
+    int branchId = addBranch(Tap::Encoded, createBranch("avc-branch-" + suffix, {queue, parser, sink}));
+    if (branchId < 0) {
+        m_avcSink = nullptr;
+    }
+    return branchId;
+}
+
+void GStreamerPipeline::updateAvcOutput() {
+    bool watched = m_mse->fanout()->subscriberCount() > 0;
+    if (watched && m_avcBranch < 0) {
+        // addBranch() asks for a keyframe with SPS/PPS, which h264parse needs first
+        m_avcBranch = addAvcOutput();
+        if (m_avcBranch < 0) {
+            std::cerr << "Failed to attach fMP4 output for stream " << m_streamId << std::endl;
+        } else {
+            std::cout << "Attached fMP4 output for stream " << m_streamId << std::endl;
+        }
+    } else if (watched) {
+        // A viewer arrived before the branch was detached; start it on a fresh IDR
+        GstPad* encoderPad = gst_element_get_static_pad(m_encoder, "src");
+        gst_pad_send_event(encoderPad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+        gst_object_unref(encoderPad);
+    } else if (m_avcBranch >= 0) {
+        // Samples still queued in the old branch must not reach the muxer
+        m_avcSink = nullptr;
+        removeBranch(m_avcBranch);
+        m_avcBranch = -1;
+        std::cout << "Detached fMP4 output for stream " << m_streamId << std::endl;
+    }
+}
+
+bool GStreamerPipeline::addRendition(size_t index, const Rendition& rendition) {
+    std::string suffix = std::to_string(m_streamId) + "-" + std::to_string(index);
+    GstElement* queue = gst_element_factory_make("queue", ("renditionqueue-" + suffix).c_str());
+    GstElement* scale = gst_element_factory_make("videoscale", ("videoscale-" + suffix).c_str());
+    GstElement* capsFilter = gst_element_factory_make("capsfilter", ("renditioncaps-" + suffix).c_str());
+    GstElement* encoder = gst_element_factory_make("x264enc", ("encoder-" + suffix).c_str());
+    GstElement* payloader = gst_element_factory_make("rtph264pay", ("payloader-" + suffix).c_str());
+    GstElement* rtpSink = createRtpSink(suffix, {RtpDestination{m_profile.sinkHost, rendition.port}},
+                                        rendition.bitrate);
+    if (!queue || !scale || !capsFilter || !encoder || !payloader || !rtpSink) {
+        for (GstElement* element : {queue, scale, capsFilter, encoder, payloader, rtpSink}) {
+            if (element) {
+                gst_object_unref(element);
+            }
+        }
+        return false;
+    }
+    
+    // A rendition that falls behind drops frames instead of stalling the
+    // raw tee, and with it the full-size encode
+    g_object_set(queue,
+                 "leaky", 2,
+                 "max-size-buffers", 2,
+                 "max-size-bytes", 0,
+                 "max-size-time", (guint64)0,
+                 NULL);
+    GstCaps* caps = gst_caps_new_simple("video/x-raw",
+                                        "width", G_TYPE_INT, rendition.width,
+                                        "height", G_TYPE_INT, rendition.height,
+                                        NULL);
+    g_object_set(capsFilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    StreamProfile profile = m_profile;
+    profile.bitrate = rendition.bitrate;
+    configureEncoder(encoder, profile);
+    g_object_set(payloader,
+                 "pt", 96,
+                 "config-interval", 1,
+                 NULL);
+    GstElement* branch = createBranch("rendition-branch-" + suffix,
+                                      {queue, scale, capsFilter, encoder, payloader, rtpSink});
+    if (addBranch(Tap::Raw, branch) < 0) {
+        return false;
+    }
+    m_encoders.push_back(Encoder{capsFilter, encoder, queue});
+    return true;
+}
+
+GstElement* GStreamerPipeline::createRtpSink(const std::string& suffix, const std::vector<RtpDestination>& destinations,
+                                             int bitrate) {
+    if (m_profile.rtpEgress == RtpEgress::UdpSink) {
+        GstElement* udpsink = gst_element_factory_make("multiudpsink", ("udpsink-" + suffix).c_str());
+        if (!udpsink) {
+            return nullptr;
+        }
+        g_object_set(udpsink,
+                     "sync", FALSE,
+                     "ttl-mc", m_profile.multicastTtl,
+                     NULL);
+        if (!m_profile.multicastInterface.empty()) {
+            g_object_set(udpsink, "multicast-iface", m_profile.multicastInterface.c_str(), NULL);
+        }
+        for (const RtpDestination& destination : destinations) {
+            g_signal_emit_by_name(udpsink, "add", destination.host.c_str(), destination.port, NULL);
+        }
+        m_udpSinks.push_back(udpsink);
+        return udpsink;
+    }
+    
+    auto output = std::make_unique<RtpOutput>(m_profile.rtpEgress, m_profile.multicastTtl, m_profile.multicastInterface);
+    for (const RtpDestination& destination : destinations) {
+        std::string error;
+        if (!output->sender.addDestination(destination, error)) {
+            std::cerr << "Stream " << m_streamId << ": " << error << std::endl;
+            return nullptr;
+        }
+    }
+    if (m_profile.rtpPacing) {
+        output->sender.setPacing(bitrate);
+    }
+    GstElement* appsink = gst_element_factory_make("appsink", ("rtpsink-" + suffix).c_str());
+    if (!appsink) {
+        return nullptr;
+    }
+    // Buffer lists from the payloader arrive as one sample each
+    g_object_set(appsink,
+                 "sync", FALSE,
+                 "buffer-list", TRUE,
+                 NULL);
+    GstAppSinkCallbacks callbacks{};
+    callbacks.new_sample = &GStreamerPipeline::onRtpSample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, output.get(), NULL);
+    m_rtpOutputs.push_back(std::move(output));
+    return appsink;
+}
+
+bool GStreamerPipeline::addDestination(size_t rendition, const RtpDestination& destination, std::string& error) {
+    std::lock_guard<std::mutex> lock(m_encoderMutex);
+    if (!m_pipeline || !m_running) {
+        error = "Stream not running";
+        return false;
+    }
+    if (rendition < m_rtpOutputs.size()) {
+        return m_rtpOutputs[rendition]->sender.addDestination(destination, error);
+    }
+    if (rendition < m_udpSinks.size()) {
+        // multiudpsink would count a duplicate rather than refuse it
+        std::vector<RtpDestination> clients = udpSinkClients(m_udpSinks[rendition]);
+        if (std::find(clients.begin(), clients.end(), destination) != clients.end()) {
+            error = "Already sending to " + destination.host + ":" + std::to_string(destination.port);
+            return false;
+        }
+        g_signal_emit_by_name(m_udpSinks[rendition], "add", destination.host.c_str(), destination.port, NULL);
+        return true;
+    }
+    error = "No such rendition";
+    return false;
+}
+
+bool GStreamerPipeline::removeDestination(size_t rendition, const RtpDestination& destination, std::string& error) {
+    std::lock_guard<std::mutex> lock(m_encoderMutex);
+    if (!m_pipeline || !m_running) {
+        error = "Stream not running";
+        return false;
+    }
+    if (rendition < m_rtpOutputs.size()) {
+        if (!m_rtpOutputs[rendition]->sender.removeDestination(destination)) {
+            error = "Not sending to " + destination.host + ":" + std::to_string(destination.port);
+            return false;
+        }
+        return true;
+    }
+    if (rendition < m_udpSinks.size()) {
+        std::vector<RtpDestination> clients = udpSinkClients(m_udpSinks[rendition]);
+        if (std::find(clients.begin(), clients.end(), destination) == clients.end()) {
+            error = "Not sending to " + destination.host + ":" + std::to_string(destination.port);
+            return false;
+        }
+        g_signal_emit_by_name(m_udpSinks[rendition], "remove", destination.host.c_str(), destination.port, NULL);
+        return true;
+    }
+    error = "No such rendition";
+    return false;
+}
+
+std::vector<std::vector<RtpDestination>> GStreamerPipeline::getDestinations() {
+    std::lock_guard<std::mutex> lock(m_encoderMutex);
+    std::vector<std::vector<RtpDestination>> destinations;
+    for (const auto& output : m_rtpOutputs) {
+        destinations.push_back(output->sender.destinations());
+    }
+    for (GstElement* udpsink : m_udpSinks) {
+        destinations.push_back(udpSinkClients(udpsink));
+    }
+    return destinations;
+}
+
+std::vector<RtpDestination> GStreamerPipeline::udpSinkClients(GstElement* udpsink) {
+    // "host:port,host:port"
+    gchar* clients = nullptr;
+    g_object_get(udpsink, "clients", &clients, NULL);
+    std::vector<RtpDestination> list;
+    std::istringstream entries(clients ? clients : "");
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        size_t colon = entry.rfind(':');
+        if (colon != std::string::npos) {
+            list.push_back(RtpDestination{entry.substr(0, colon), std::atoi(entry.c_str() + colon + 1)});
+        }
+    }
+    g_free(clients);
+    return list;
+}
+
+GstFlowReturn GStreamerPipeline::onRtpSample(GstAppSink* sink, gpointer data) {
+    // Frames bigger than this are sent in parts rather than held
+    constexpr size_t MAX_PENDING_PACKETS = 512;
+    RtpOutput* output = static_cast<RtpOutput*>(data);
+    GstSample* sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_EOS;
+    }
+    
+    output->samples.push_back(sample);
+    GstBufferList* list = gst_sample_get_buffer_list(sample);
+    guint count = list ? gst_buffer_list_length(list) : 1;
+    bool frameEnd = false;
+    for (guint i = 0; i < count; ++i) {
+        GstBuffer* buffer = list ? gst_buffer_list_get(list, i) : gst_sample_get_buffer(sample);
+        GstMapInfo map;
+        if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+            output->buffers.push_back(buffer);
+            output->maps.push_back(map);
+            output->packets.push_back(iovec{map.data, map.size});
+            // Marker bit, second byte of the RTP header
+            frameEnd = map.size >= 2 && (map.data[1] & 0x80) != 0;
+        }
+    }
+    if (frameEnd || output->packets.size() >= MAX_PENDING_PACKETS) {
+        output->sender.send(output->packets.data(), output->packets.size());
+        output->release();
+    }
+    return GST_FLOW_OK;
+}
+
+void GStreamerPipeline::configureEncoder(GstElement* encoder, const StreamProfile& profile) {
+    g_object_set(encoder,
+                 "bitrate", profile.bitrate,
+                 "byte-stream", TRUE,
+                 "key-int-max", profile.keyIntMax,
+                 "threads", profile.encoderThreads,
+                 NULL);
+    // Enum/flags by nick, e.g. "ultrafast" and "zerolatency"
+    gst_util_set_object_arg(G_OBJECT(encoder), "speed-preset", profile.encoderPreset.c_str());
+    gst_util_set_object_arg(G_OBJECT(encoder), "tune", profile.encoderTune.c_str());
+}
+
+GStreamerPipeline::EncoderChange GStreamerPipeline::updateEncoder(const EncoderUpdate& update, ProfileCallback done) {
+    std::shared_ptr<EncoderReopen> reopen;
+    {
+        std::lock_guard<std::mutex> lock(m_encoderMutex);
+        if (!m_pipeline || !m_running) {
+            return EncoderChange::Failed;
+        }
+        // Only updates set m_reopening and they are serialised here, so the
+        // profile cannot change under us once none is in flight
+        StreamProfile committed;
+        {
+            std::lock_guard<std::mutex> profileLock(m_profileMutex);
+            if (m_reopening) {
+                return EncoderChange::Busy;
+            }
+            committed = m_profile;
+        }
         
-        if (message) {
-            busCallback(bus, message, this);
-            gst_message_unref(message);
+        StreamProfile profile = committed;
+        if (update.bitrate) profile.bitrate = *update.bitrate;
+        if (update.keyIntMax) profile.keyIntMax = *update.keyIntMax;
+        if (update.encoderPreset) profile.encoderPreset = *update.encoderPreset;
+        
+        // Bitrate goes in place right away, so a reopen below only has GOP and
+        // preset to commit or undo. The ladder's shape is fixed by the profile;
+        // only its bitrates move.
+        std::vector<Rendition> ladder = profile.renditions();
+        std::vector<Rendition> current = committed.renditions();
+        for (size_t i = 0; i < m_encoders.size() && i < ladder.size(); ++i) {
+            if (ladder[i].bitrate != current[i].bitrate) {
+                // Rate control is reconfigured before the next frame is encoded
+                g_object_set(m_encoders[i].encoder, "bitrate", ladder[i].bitrate, NULL);
+            }
+            if (i < m_rtpOutputs.size() && profile.rtpPacing) {
+                m_rtpOutputs[i]->sender.setPacing(ladder[i].bitrate);
+            }
+        }
+        
+        // x264enc only retunes bitrate while playing; GOP and preset need a reopen
+        bool needsReopen = profile.keyIntMax != committed.keyIntMax ||
+                           profile.encoderPreset != committed.encoderPreset;
+        committed.bitrate = profile.bitrate;
+        {
+            std::lock_guard<std::mutex> profileLock(m_profileMutex);
+            m_profile = committed;
+            m_reopening = needsReopen;
+        }
+        if (!needsReopen) {
+            if (update.forceKeyframe) {
+                requestKeyframes();
+            }
+            std::cout << "Encoder for stream " << m_streamId << " now " << committed.bitrate << " kbit/s" << std::endl;
+            return EncoderChange::Applied;
         }
+        
+        reopen = std::make_shared<EncoderReopen>();
+        reopen->pipeline = this;
+        reopen->profile = profile;
+        reopen->previous = committed;
+        reopen->done = std::move(done);
+        for (size_t i = 0; i < m_encoders.size() && i < ladder.size(); ++i) {
+            gst_object_ref(m_encoders[i].feed);
+            gst_object_ref(m_encoders[i].encoder);
+            reopen->encoders.push_back(m_encoders[i]);
+            StreamProfile target = profile;
+            target.bitrate = ladder[i].bitrate;
+            StreamProfile fallback = committed;
+            fallback.bitrate = ladder[i].bitrate;
+            reopen->targets.push_back(target);
+            reopen->fallbacks.push_back(fallback);
+        }
+        reopen->switched.assign(reopen->encoders.size(), 0);
     }
     
-    gst_object_unref(bus);
+    // A reopened encoder starts with an IDR anyway
+    startReopen(reopen);
+    return EncoderChange::Pending;
+}
+
+void GStreamerPipeline::startReopen(const std::shared_ptr<EncoderReopen>& reopen) {
+    // Swap settings between two frames: each idle probe runs right away if
+    // its feed is not pushing, otherwise right after the current push, and
+    // holds that stream back while it works. Nothing here waits for them.
+    reopen->pending = reopen->encoders.size() + 1;
+    for (size_t i = 0; i < reopen->encoders.size(); ++i) {
+        GstPad* feedPad = gst_element_get_static_pad(reopen->encoders[i].feed, "src");
+        gst_pad_add_probe(feedPad, GST_PAD_PROBE_TYPE_IDLE, &GStreamerPipeline::reopenEncoderProbe,
+                          new EncoderSwap{reopen, i}, &GStreamerPipeline::releaseEncoderSwap);
+        gst_object_unref(feedPad);
+    }
+    if (--reopen->pending == 0) {
+        finishReopen(reopen);
+    }
+}
+
+void GStreamerPipeline::releaseEncoderSwap(gpointer data) {
+    delete static_cast<EncoderSwap*>(data);
+}
+
+GstPadProbeReturn GStreamerPipeline::reopenEncoderProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data) {
+    (void)info;
+    const EncoderSwap& swap = *static_cast<EncoderSwap*>(data);
+    EncoderReopen& reopen = *swap.reopen;
+    size_t i = swap.index;
+    GstElement* encoder = reopen.encoders[i].encoder;
+    
+    // A stopping pipeline is flushing its pads idle; leave its encoders be
+    if (!reopen.pipeline->m_running) {
+        reopen.failed = true;
+    } else if (swapEncoder(pad, encoder, reopen.targets[i])) {
+        reopen.switched[i] = 1;
+    } else {
+        reopen.failed = true;
+        if (!reopen.rollback && !swapEncoder(pad, encoder, reopen.fallbacks[i])) {
+            std::cerr << "Encoder " << i << " of stream " << reopen.pipeline->m_streamId
+                      << " could not be restarted" << std::endl;
+        }
+    }
+    
+    if (--reopen.pending == 0) {
+        reopen.pipeline->finishReopen(swap.reopen);
+    }
+    return GST_PAD_PROBE_REMOVE;
+}
+
+bool GStreamerPipeline::swapEncoder(GstPad* feedPad, GstElement* encoder, const StreamProfile& profile) {
+    // Only the encoder restarts; source, tees and outputs keep their state.
+    // With tune=zerolatency x264 holds no delayed frames, so none are lost.
+    GstPad* encoderPad = gst_element_get_static_pad(encoder, "sink");
+    gst_pad_unlink(feedPad, encoderPad);
+    gst_element_set_state(encoder, GST_STATE_NULL);
+    configureEncoder(encoder, profile);
+    bool ok = gst_element_sync_state_with_parent(encoder);
+    // Relinking re-sends the sticky caps and segment, so the encoder opens
+    // with the same input format before the next buffer reaches it
+    ok = gst_pad_link(feedPad, encoderPad) == GST_PAD_LINK_OK && ok;
+    gst_object_unref(encoderPad);
+    return ok;
+}
+
+void GStreamerPipeline::finishReopen(const std::shared_ptr<EncoderReopen>& reopen) {
+    // Encoders run one GOP and preset or none: if any could not switch, the
+    // ones that did go back to the committed settings in a second round
+    if (!reopen->rollback && reopen->failed && m_running) {
+        auto rollback = std::make_shared<EncoderReopen>();
+        rollback->pipeline = this;
+        rollback->profile = reopen->previous;
+        rollback->previous = reopen->previous;
+        rollback->done = std::move(reopen->done);
+        rollback->rollback = true;
+        for (size_t i = 0; i < reopen->encoders.size(); ++i) {
+            if (reopen->switched[i]) {
+                gst_object_ref(reopen->encoders[i].feed);
+                gst_object_ref(reopen->encoders[i].encoder);
+                rollback->encoders.push_back(reopen->encoders[i]);
+                rollback->targets.push_back(reopen->fallbacks[i]);
+                rollback->fallbacks.push_back(reopen->fallbacks[i]);
+            }
+        }
+        rollback->switched.assign(rollback->encoders.size(), 0);
+        std::cerr << "Encoder reopen failed for stream " << m_streamId << "; restoring GOP "
+                  << reopen->previous.keyIntMax << ", " << reopen->previous.encoderPreset << std::endl;
+        startReopen(rollback);
+        return;
+    }
+    
+    bool committed = !reopen->rollback && !reopen->failed;
+    if (reopen->rollback && reopen->failed) {
+        std::cerr << "Encoders of stream " << m_streamId << " could not all be restored" << std::endl;
+    }
+    StreamProfile profile;
+    {
+        std::lock_guard<std::mutex> lock(m_profileMutex);
+        if (committed) {
+            m_profile = reopen->profile;
+        }
+        m_reopening = false;
+        profile = m_profile;
+    }
+    if (committed) {
+        std::cout << "Encoder for stream " << m_streamId << " now " << profile.bitrate << " kbit/s, GOP "
+                  << profile.keyIntMax << ", " << profile.encoderPreset << " (reopened)" << std::endl;
+    }
+    if (reopen->done) {
+        reopen->done(profile);
+    }
+}
+
+bool GStreamerPipeline::forceKeyframe() {
+    std::lock_guard<std::mutex> lock(m_encoderMutex);
+    if (!m_pipeline || !m_running) {
+        return false;
+    }
+    requestKeyframes();
+    return true;
+}
+
+void GStreamerPipeline::requestKeyframes() {
+    for (const Encoder& encoder : m_encoders) {
+        GstPad* encoderPad = gst_element_get_static_pad(encoder.encoder, "src");
+        gst_pad_send_event(encoderPad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+        gst_object_unref(encoderPad);
+    }
+}
+
+StreamProfile GStreamerPipeline::getProfile() {
+    std::lock_guard<std::mutex> lock(m_profileMutex);
+    return m_profile;
+}
+
+double GStreamerPipeline::cpuSeconds() {
+    std::lock_guard<std::mutex> lock(m_threadMutex);
+    double seconds = 0;
+    for (const auto& thread : m_threads) {
+        seconds += threadCpuSeconds(thread.first) - thread.second;
+    }
+    return seconds;
+}
+
+GstBusSyncReply GStreamerPipeline::syncBusHandler(GstBus* bus, GstMessage* message, gpointer data) {
+    (void)bus;
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        GstElement* owner;
+        gst_message_parse_stream_status(message, &type, &owner);
+        if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+            static_cast<GStreamerPipeline*>(data)->registerStreamingThread(owner);
+        }
+    }
+    return GST_BUS_PASS;
+}
+
+void GStreamerPipeline::registerStreamingThread(GstElement* owner) {
+    pid_t tid = currentThreadId();
+    std::lock_guard<std::mutex> lock(m_threadMutex);
+    // Only the trunk is costed. Task threads are pooled: count from when one
+    // entered this pipeline, and only once if its task restarts.
+    bool trunk = owner == m_source ||
+                 std::any_of(m_encoders.begin(), m_encoders.end(),
+                             [owner](const Encoder& encoder) { return encoder.queue == owner; });
+    auto seen = std::find_if(m_threads.begin(), m_threads.end(),
+                             [tid](const std::pair<pid_t, double>& thread) { return thread.first == tid; });
+    if (trunk && seen == m_threads.end()) {
+        m_threads.emplace_back(tid, threadCpuSeconds(tid));
+    }
+    if (!m_cpus.empty() && !pinCurrentThread(m_cpus)) {
+        std::cerr << "Failed to pin streaming thread of stream " << m_streamId
+                  << " to CPUs " << formatCpuList(m_cpus) << std::endl;
+    }
 }
 
 gboolean GStreamerPipeline::busCallback(GstBus* bus, GstMessage* message, gpointer data) {
@@ -200,3 +940,215 @@ gboolean GStreamerPipeline::busCallback(GstBus* bus, GstMessage* message, gpoint
     
     return TRUE;
 }
+
+GstElement* GStreamerPipeline::createBranch(const std::string& name, std::initializer_list<GstElement*> elements) {
+    GstElement* bin = gst_bin_new(name.c_str());
+    GstElement* previous = nullptr;
+    bool linked = elements.size() > 0;
+    for (GstElement* element : elements) {
+        gst_bin_add(GST_BIN(bin), element);
+        if (previous && !gst_element_link(previous, element)) {
+            linked = false;
+        }
+        previous = element;
+    }
+    if (!linked) {
+        gst_object_unref(bin);
+        return nullptr;
+    }
+    
+    GstPad* target = gst_element_get_static_pad(*elements.begin(), "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", target));
+    gst_object_unref(target);
+    return bin;
+}
+
+int GStreamerPipeline::addBranch(Tap tap, GstElement* branch) {
+    if (!branch) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(m_branchMutex);
+    if (!m_pipeline) {
+        gst_object_unref(branch);
+        return -1;
+    }
+    
+    GstElement* tee = tap == Tap::Raw ? m_rawTee : m_encodedTee;
+    gst_bin_add(GST_BIN(m_pipeline), branch);
+    // Bring the branch up before data can reach it
+    gst_element_sync_state_with_parent(branch);
+    
+    GstPad* teePad = gst_element_request_pad_simple(tee, "src_%u");
+    GstPad* sinkPad = gst_element_get_static_pad(branch, "sink");
+    bool linked = teePad && sinkPad && gst_pad_link(teePad, sinkPad) == GST_PAD_LINK_OK;
+    if (sinkPad) {
+        gst_object_unref(sinkPad);
+    }
+    if (!linked) {
+        std::cerr << "Failed to link branch " << GST_OBJECT_NAME(branch)
+                  << " for stream " << m_streamId << std::endl;
+        if (teePad) {
+            gst_element_release_request_pad(tee, teePad);
+            gst_object_unref(teePad);
+        }
+        gst_element_set_state(branch, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(m_pipeline), branch);
+        return -1;
+    }
+    
+    if (tap == Tap::Encoded) {
+        // Late joiners would otherwise wait up to key-int-max for a decodable frame
+        gst_pad_send_event(teePad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+    }
+    
+    int branchId = m_nextBranchId++;
+    m_branches[branchId] = Branch{tee, teePad, branch};
+    return branchId;
+}
+
+bool GStreamerPipeline::removeBranch(int branchId) {
+    auto* unlink = new BranchUnlink();
+    {
+        std::lock_guard<std::mutex> lock(m_branchMutex);
+        auto it = m_branches.find(branchId);
+        if (it == m_branches.end()) {
+            delete unlink;
+            return false;
+        }
+        unlink->pipeline = GST_ELEMENT(gst_object_ref(m_pipeline));
+        unlink->tee = GST_ELEMENT(gst_object_ref(it->second.tee));
+        unlink->teePad = it->second.teePad;
+        unlink->bin = GST_ELEMENT(gst_object_ref(it->second.bin));
+        m_branches.erase(it);
+    }
+    
+    // Unlink between buffers: the idle probe runs right away if nothing is
+    // flowing, otherwise on the streaming thread after the current push.
+    // Nothing waits for it, so callers may hold locks the streaming thread needs.
+    gst_pad_add_probe(unlink->teePad, GST_PAD_PROBE_TYPE_IDLE, &GStreamerPipeline::unlinkBranchProbe,
+                      unlink, &GStreamerPipeline::finishBranchRemoval);
+    return true;
+}
+
+GstPadProbeReturn GStreamerPipeline::unlinkBranchProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data) {
+    (void)info;
+    auto* unlink = static_cast<BranchUnlink*>(data);
+    GstPad* peer = gst_pad_get_peer(pad);
+    if (peer) {
+        gst_pad_unlink(pad, peer);
+        gst_object_unref(peer);
+    }
+    unlink->unlinked = true;
+    return GST_PAD_PROBE_REMOVE;
+}
+
+void GStreamerPipeline::finishBranchRemoval(gpointer data) {
+    auto* unlink = static_cast<BranchUnlink*>(data);
+    if (!unlink->unlinked) {
+        // The pad went away before it was ever idle. Never unlink under a
+        // running push; leave the bin to be torn down with the pipeline.
+        std::cerr << "Branch " << GST_OBJECT_NAME(unlink->bin)
+                  << " was never idle; leaving it in the pipeline" << std::endl;
+        releaseBranchUnlink(unlink);
+        return;
+    }
+    // State changes are not allowed from a streaming thread; finish elsewhere
+    gst_element_call_async(unlink->pipeline, &GStreamerPipeline::disposeBranch, unlink, &releaseBranchUnlink);
+}
+
+void GStreamerPipeline::disposeBranch(GstElement* pipeline, gpointer data) {
+    auto* unlink = static_cast<BranchUnlink*>(data);
+    gst_element_release_request_pad(unlink->tee, unlink->teePad);
+    gst_element_set_state(unlink->bin, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline), unlink->bin);
+}
+
+GstPadProbeReturn GStreamerPipeline::mjpegGateProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data) {
+    (void)pad;
+    (void)info;
+    FrameFanout* fanout = static_cast<FrameFanout*>(data);
+    return fanout->subscriberCount() > 0 ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+}
+
+GstFlowReturn GStreamerPipeline::onMjpegSample(GstAppSink* sink, gpointer data) {
+    GStreamerPipeline* pipeline = static_cast<GStreamerPipeline*>(data);
+    
+    GstSample* sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_EOS;
+    }
+    
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+    if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        // Serialize the complete multipart part once; viewers only reference it
+        std::string partHeader = std::string("--") + MJPEG_BOUNDARY + "\r\n"
+                                 "Content-Type: image/jpeg\r\n"
+                                 "Content-Length: " + std::to_string(map.size) + "\r\n\r\n";
+        auto frame = std::make_shared<EncodedFrame>();
+        frame->sequence = pipeline->m_mjpegFanout->nextSequence();
+        frame->data.reserve(partHeader.size() + map.size + 2);
+        frame->data.append(partHeader);
+        frame->data.append(reinterpret_cast<const char*>(map.data), map.size);
+        frame->data.append("\r\n");
+        gst_buffer_unmap(buffer, &map);
+        
+        pipeline->m_mjpegFanout->publish(std::move(frame));
+    }
+    
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+GstFlowReturn GStreamerPipeline::onAvcSample(GstAppSink* sink, gpointer data) {
+    GStreamerPipeline* pipeline = static_cast<GStreamerPipeline*>(data);
+    
+    GstSample* sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_EOS;
+    }
+    if (GST_ELEMENT(sink) != pipeline->m_avcSink.load()) {
+        // A detached branch draining its queue
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+    
+    // Both consumers ignore an unchanged format, and pick up a new one (after
+    // an encoder reopen) at the next keyframe
+    GstCaps* caps = gst_sample_get_caps(sample);
+    const GstStructure* structure = caps ? gst_caps_get_structure(caps, 0) : nullptr;
+    const GValue* codecData = structure ? gst_structure_get_value(structure, "codec_data") : nullptr;
+    int width = 0;
+    int height = 0;
+    GstMapInfo map;
+    if (codecData && gst_structure_get_int(structure, "width", &width) &&
+        gst_structure_get_int(structure, "height", &height)) {
+        GstBuffer* avcC = gst_value_get_buffer(codecData);
+        if (avcC && gst_buffer_map(avcC, &map, GST_MAP_READ)) {
+            std::string record(reinterpret_cast<const char*>(map.data), map.size);
+            gst_buffer_unmap(avcC, &map);
+            pipeline->m_mse->setFormat(width, height, record);
+            if (pipeline->m_hls) {
+                pipeline->m_hls->setFormat(width, height, record);
+            }
+        }
+    }
+    
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if (buffer && GST_BUFFER_PTS_IS_VALID(buffer) && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        GstClockTime pts = GST_BUFFER_PTS(buffer);
+        GstClockTime dts = GST_BUFFER_DTS_IS_VALID(buffer) ? GST_BUFFER_DTS(buffer) : pts;
+        bool keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+        int64_t duration = GST_BUFFER_DURATION_IS_VALID(buffer) ? static_cast<int64_t>(GST_BUFFER_DURATION(buffer)) : 0;
+        pipeline->m_mse->pushSample(map.data, map.size, static_cast<int64_t>(dts), static_cast<int64_t>(pts), duration,
+                                    keyframe);
+        if (pipeline->m_hls) {
+            pipeline->m_hls->pushSample(map.data, map.size, static_cast<int64_t>(dts), static_cast<int64_t>(pts),
+                                        keyframe);
+        }
+        gst_buffer_unmap(buffer, &map);
+    }
+    
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
@@ -1,40 +1,207 @@
-#pragma once
-
-#include <gst/gst.h>
-#include <gst/app/gstappsrc.h>
-#include <string>
-#include <atomic>
-#include <thread>
-
-class GStreamerPipeline {
-public:
-    GStreamerPipeline(int streamId, int port, int width, int height, int framerate);
-    ~GStreamerPipeline();
-    
-    bool initialize();
-    void stop();
-    std::string getStreamUrl();
-    void setTestPattern(int pattern);
-    
-private:
-    int m_streamId;
-    int m_port;
-    int m_width;
-    int m_height;
-    int m_framerate;
-    
-    GstElement* m_pipeline;
-    GstElement* m_source;
-    GstElement* m_videoconvert;
-    GstElement* m_encoder;
-    GstElement* m_payloader;
-    GstElement* m_udpsink;
-    
-    std::atomic<bool> m_running;
-    std::thread m_busThread;
-    
-    void busWatch();
-    static gboolean busCallback(GstBus* bus, GstMessage* message, gpointer data);
-    std::string createPipelineString();
-};
-
+#pragma once
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
+#include <initializer_list>
+#include <optional>
+#include <functional>
+#include "FrameFanout.h"
+#include "HlsPackager.h"
+#include "MseStreamer.h"
+#include "BusDispatcher.h"
+#include "Config.h"
+
+// Encoder changes for a running stream; unset fields are left alone
+struct EncoderUpdate {
+    std::optional<int> bitrate;                 // kbit/s
+    std::optional<int> keyIntMax;
+    std::optional<std::string> encoderPreset;
+    bool forceKeyframe{false};
+};
+
+// One video stream. The source is converted once and split by a raw tee;
+// one branch of it is encoded once and split again by an encoded tee. Every
+// output (RTP, MJPEG, ...) is a branch bin hanging off one of the two tees,
+// so consumers share a single encode and branches can come and go while the
+// pipeline plays. Scaled renditions are raw branches with their own
+// videoscale and encoder, each sending RTP to its own port.
+class GStreamerPipeline {
+public:
+    // Which tee a branch consumes: raw video or the H.264 byte-stream
+    enum class Tap { Raw, Encoded };
+    // Outcome of updateEncoder()
+    enum class EncoderChange { Applied, Pending, Busy, Failed };
+    using ProfileCallback = std::function<void(const StreamProfile& profile)>;
+
+
+    GStreamerPipeline(int streamId, const StreamProfile& profile, BusDispatcher& busDispatcher);
+    ~GStreamerPipeline();
+    
+    bool initialize();
+    void stop();
+    std::string getStreamUrl();
+    void setTestPattern(int pattern);
+    
+    // Pin every streaming thread to these CPUs as it starts; x264's own
+    // worker threads inherit the mask from the thread that opens the encoder.
+    // Call before initialize(). Empty leaves scheduling to the kernel.
+    void setCpuAffinity(const std::vector<int>& cpus) { m_cpus = cpus; }
+    // CPU time used so far by the trunk's streaming threads: the source thread
+    // (capture, conversion, scaling) and each encoder's queue thread (x264).
+    // Output branches and x264's own worker threads (encoder_threads != 1)
+    // are not included.
+    double cpuSeconds();
+    
+    // Change the encoders while playing. Bitrate is retuned in place from the
+    // next frame (renditions keep their share of it) and the change is
+    // Applied on return. GOP and preset reopen just the encoders between two
+    // frames, which starts a new IDR; that happens on the streaming threads,
+    // so the call returns Pending at once and `done` later gets the profile
+    // that is running: the new one, or the old one if any encoder failed and
+    // the others were put back. Busy while a reopen is still in flight,
+    // Failed if the pipeline is not running.
+    EncoderChange updateEncoder(const EncoderUpdate& update, ProfileCallback done);
+    // Ask every encoder for an IDR with SPS/PPS on its next frame
+    bool forceKeyframe();
+    StreamProfile getProfile();
+    
+    // Receivers of one rendition's RTP (0 is full size), editable while
+    // playing; the next frame goes to the new list
+    bool addDestination(size_t rendition, const RtpDestination& destination, std::string& error);
+    bool removeDestination(size_t rendition, const RtpDestination& destination, std::string& error);
+    // Every rendition's receivers, in ladder order
+    std::vector<std::vector<RtpDestination>> getDestinations();
+    
+    // Multipart JPEG parts for /stream/{id}/mjpeg; each frame is encoded once
+    // and shared by every viewer, and nothing is encoded while nobody watches
+    std::shared_ptr<FrameFanout> getMjpegFanout() const { return m_mjpegFanout; }
+    // LL-HLS parts and playlist, packaged in memory; null unless the profile
+    // enables hls
+    std::shared_ptr<HlsPackager> getHlsPackager() const { return m_hls; }
+    // Per-frame fMP4 WebSocket messages for /ws/stream/{id}; null until initialized
+    std::shared_ptr<FrameFanout> getMseFanout() const { return m_mse ? m_mse->fanout() : nullptr; }
+    
+    // Chain the elements into a bin whose "sink" ghost pad feeds the first one.
+    // Returns null (and releases the elements) if they cannot be linked.
+    static GstElement* createBranch(const std::string& name, std::initializer_list<GstElement*> elements);
+    // Attach a branch bin to a tee; takes ownership of the bin. Encoded
+    // branches get a keyframe promptly. Returns the branch id, or -1.
+    int addBranch(Tap tap, GstElement* branch);
+    // Detach a branch once its tee pad is idle and dispose of it off the
+    // streaming thread. Returns without waiting; false if the id is unknown.
+    bool removeBranch(int branchId);
+    
+private:
+    int m_streamId;
+    StreamProfile m_profile;
+    
+    GstElement* m_pipeline;
+    GstElement* m_source;
+    GstElement* m_videoconvert;
+    GstElement* m_rawTee;
+    GstElement* m_encodeQueue;
+    GstElement* m_encoder;
+    GstElement* m_encodedTee;
+    
+    // RTP branch: encodedTee -> queue -> rtph264pay -> multiudpsink, or
+    // appsink feeding an RtpSender
+    GstElement* m_payloader;
+    GstElement* m_rtpSink;
+    struct RtpOutput;
+    std::vector<std::unique_ptr<RtpOutput>> m_rtpOutputs;   // ladder order; empty with udpsink
+    std::vector<GstElement*> m_udpSinks;                    // ladder order; only with udpsink
+    
+    // MJPEG branch: rawTee -> queue -> jpegenc -> appsink
+    GstElement* m_mjpegQueue;
+    GstElement* m_jpegEncoder;
+    GstElement* m_mjpegSink;
+    std::shared_ptr<FrameFanout> m_mjpegFanout;
+    
+    // fMP4 branch: encodedTee -> queue -> h264parse -> appsink (AVC access
+    // units), feeding MSE viewers and, if enabled, LL-HLS. Without HLS it is
+    // only attached while at least one MSE viewer is connected.
+    std::shared_ptr<MseStreamer> m_mse;
+    std::shared_ptr<HlsPackager> m_hls;
+    struct AvcDemand;
+    std::shared_ptr<AvcDemand> m_avcDemand;
+    int m_avcBranch{-1};                    // guarded by m_avcDemand's mutex
+    int m_avcAttaches{0};                   // guarded by m_avcDemand's mutex
+    std::atomic<GstElement*> m_avcSink{nullptr};    // the attached appsink; samples from others are dropped
+    
+    struct Branch {
+        GstElement* tee;
+        GstPad* teePad;         // request pad, owned
+        GstElement* bin;
+    };
+    std::map<int, Branch> m_branches;
+    std::mutex m_branchMutex;
+    int m_nextBranchId{0};
+    
+    std::atomic<bool> m_running;
+    BusDispatcher& m_busDispatcher;
+    GSource* m_busWatch{nullptr};
+    
+    // Scaled renditions: rawTee -> queue -> videoscale -> capsfilter -> x264enc
+    // -> rtph264pay -> udpsink
+    bool addRendition(size_t index, const Rendition& rendition);
+    // multiudpsink or an appsink sending whole frames through a new
+    // RtpSender, per the profile's rtp_egress
+    GstElement* createRtpSink(const std::string& suffix, const std::vector<RtpDestination>& destinations, int bitrate);
+    static GstFlowReturn onRtpSample(GstAppSink* sink, gpointer data);
+    static std::vector<RtpDestination> udpSinkClients(GstElement* udpsink);
+    
+    // Every encoder in ladder order, the trunk's first; `feed` is the element
+    // whose src pad drives it, `queue` the one whose streaming thread runs it
+    struct Encoder {
+        GstElement* feed;
+        GstElement* encoder;
+        GstElement* queue;
+    };
+    std::vector<Encoder> m_encoders;
+    std::mutex m_encoderMutex;              // serialises encoder and output changes with stop()
+    // Guards m_profile and m_reopening; never held across GStreamer calls
+    std::mutex m_profileMutex;
+    bool m_reopening{false};
+    struct EncoderReopen;
+    struct EncoderSwap;
+    
+    std::vector<int> m_cpus;
+    std::vector<std::pair<pid_t, double>> m_threads;    // trunk streaming threads and their CPU time on entry
+    std::mutex m_threadMutex;
+    
+    static gboolean busCallback(GstBus* bus, GstMessage* message, gpointer data);
+    // Runs on the posting thread, so stream-status ENTER lands on the new
+    // streaming thread itself
+    static GstBusSyncReply syncBusHandler(GstBus* bus, GstMessage* message, gpointer data);
+    void registerStreamingThread(GstElement* owner);
+    static GstPadProbeReturn unlinkBranchProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data);
+    static void finishBranchRemoval(gpointer data);
+    static void disposeBranch(GstElement* pipeline, gpointer data);
+    static GstPadProbeReturn reopenEncoderProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data);
+    static void releaseEncoderSwap(gpointer data);
+    static void configureEncoder(GstElement* encoder, const StreamProfile& profile);
+    // Restart one encoder with new settings; `feedPad` must be idle
+    static bool swapEncoder(GstPad* feedPad, GstElement* encoder, const StreamProfile& profile);
+    // Install an idle probe per encoder; the last one to finish calls finishReopen()
+    void startReopen(const std::shared_ptr<EncoderReopen>& reopen);
+    void finishReopen(const std::shared_ptr<EncoderReopen>& reopen);
+    void requestKeyframes();
+    static GstPadProbeReturn mjpegGateProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data);
+    static GstFlowReturn onMjpegSample(GstAppSink* sink, gpointer data);
+    // Returns the branch id, or -1
+    int addAvcOutput();
+    // MSE viewers came or went; attach or detach the fMP4 branch to match.
+    // Called with m_avcDemand's mutex held.
+    void updateAvcOutput();
+    static GstFlowReturn onAvcSample(GstAppSink* sink, gpointer data);
+    std::string createPipelineString();
+};
+
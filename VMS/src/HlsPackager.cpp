@@ -0,0 +1,267 @@
+#include "HlsPackager.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+constexpr int64_t PART_TARGET_TICKS = static_cast<int64_t>(HlsPackager::PART_TARGET * Fmp4Muxer::TIMESCALE);
+// Parts are listed only for the newest segments; older ones are whole
+constexpr size_t SEGMENTS_WITH_PARTS = 3;
+}
+
+bool HlsWindow::has(uint64_t sequence, int part) const {
+    if (segments.empty()) {
+        return false;
+    }
+    const HlsSegment& last = segments.back();
+    if (sequence < last.sequence) {
+        return true;
+    }
+    if (sequence > last.sequence) {
+        return false;
+    }
+    // Without a part number the whole segment is wanted
+    return last.complete() || (part >= 0 && static_cast<size_t>(part) < last.parts.size());
+}
+
+const HlsSegment* HlsWindow::find(uint64_t sequence) const {
+    for (const HlsSegment& segment : segments) {
+        if (segment.sequence == sequence) {
+            return &segment;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t HlsWindow::nextSequence() const {
+    if (segments.empty()) {
+        return 0;
+    }
+    return segments.back().complete() ? segments.back().sequence + 1 : segments.back().sequence;
+}
+
+HlsPackager::HlsPackager(double targetDuration, int framerate)
+    : m_targetDuration(std::max(1, static_cast<int>(std::ceil(targetDuration)))),
+      m_lastDuration(Fmp4Muxer::TIMESCALE / std::max(1, framerate)),
+      m_window(std::make_shared<const HlsWindow>()) {
+}
+
+void HlsPackager::setFormat(int width, int height, const std::string& avcC) {
+    if (avcC.empty()) {
+        return;
+    }
+    if (m_muxer && avcC == m_muxer->avcC() && width == m_width && height == m_height) {
+        m_pendingAvcC.clear();                      // changed back before a keyframe
+        return;
+    }
+    m_pendingAvcC = avcC;
+    m_pendingWidth = width;
+    m_pendingHeight = height;
+}
+
+void HlsPackager::pushSample(const uint8_t* data, size_t size, int64_t decodeTimeNs, int64_t presentationTimeNs,
+                             bool keyframe) {
+    if (!m_pendingAvcC.empty()) {
+        if (!keyframe) {
+            return;                                 // undecodable with the new format
+        }
+        // End the old format's segment; the new one starts with a new init segment
+        if (m_haveSample) {
+            m_sample.duration = m_lastDuration;
+            appendSample(std::move(m_sample), true);
+            m_haveSample = false;
+        }
+        m_muxer = std::make_unique<Fmp4Muxer>(m_pendingWidth, m_pendingHeight, m_pendingAvcC);
+        m_width = m_pendingWidth;
+        m_height = m_pendingHeight;
+        m_initSegment = std::make_shared<const std::string>(m_muxer->initSegment());
+        ++m_initVersion;
+        m_pendingAvcC.clear();
+    }
+    if (!m_muxer) {
+        return;
+    }
+
+    Fmp4Sample sample;
+    sample.data.assign(reinterpret_cast<const char*>(data), size);
+    sample.decodeTime = Fmp4Muxer::toTicks(decodeTimeNs);
+    sample.compositionOffset = static_cast<int32_t>(Fmp4Muxer::toTicks(presentationTimeNs) - sample.decodeTime);
+    sample.keyframe = keyframe;
+    if (m_haveSample) {
+        int64_t duration = sample.decodeTime - m_sample.decodeTime;
+        if (duration > 0) {
+            m_lastDuration = static_cast<uint32_t>(duration);
+        }
+        m_sample.duration = m_lastDuration;
+        appendSample(std::move(m_sample), keyframe);
+    }
+    m_sample = std::move(sample);
+    m_haveSample = true;
+}
+
+void HlsPackager::appendSample(Fmp4Sample&& sample, bool nextIsKeyframe) {
+    if (!m_segmentOpen) {
+        HlsSegment segment;
+        segment.sequence = m_nextSequence++;
+        segment.init = m_initSegment;
+        segment.initVersion = m_initVersion;
+        m_segments.push_back(std::move(segment));
+        m_segmentOpen = true;
+        m_segmentTicks = 0;
+    }
+    uint32_t duration = sample.duration;
+    m_partSamples.push_back(std::move(sample));
+    m_partTicks += duration;
+    m_segmentTicks += duration;
+
+    // A keyframe starts the next segment; otherwise parts end before they
+    // would outgrow the part target, and segments before the target duration
+    if (nextIsKeyframe) {
+        closePart();
+        closeSegment();
+    } else if (m_partTicks + duration > PART_TARGET_TICKS) {
+        closePart();
+        if (m_segmentTicks + duration > static_cast<int64_t>(m_targetDuration) * Fmp4Muxer::TIMESCALE) {
+            closeSegment();
+        }
+    } else {
+        return;
+    }
+    publish();
+}
+
+void HlsPackager::closePart() {
+    if (m_partSamples.empty()) {
+        return;
+    }
+    HlsPart part;
+    part.data = std::make_shared<const std::string>(m_muxer->fragment(m_partSamples));
+    part.duration = static_cast<double>(m_partTicks) / Fmp4Muxer::TIMESCALE;
+    part.independent = m_partSamples.front().keyframe;
+    m_segments.back().parts.push_back(std::move(part));
+    m_partSamples.clear();
+    m_partTicks = 0;
+}
+
+void HlsPackager::closeSegment() {
+    if (!m_segmentOpen) {
+        return;
+    }
+    m_segmentOpen = false;
+    HlsSegment& segment = m_segments.back();
+    size_t size = 0;
+    for (const HlsPart& part : segment.parts) {
+        size += part.data->size();
+    }
+    auto data = std::make_shared<std::string>();
+    data->reserve(size);
+    for (const HlsPart& part : segment.parts) {
+        data->append(*part.data);
+    }
+    segment.data = std::move(data);
+    segment.duration = static_cast<double>(m_segmentTicks) / Fmp4Muxer::TIMESCALE;
+
+    while (m_segments.size() > WINDOW_SEGMENTS) {
+        if (m_segments[1].initVersion != m_segments[0].initVersion) {
+            ++m_discontinuitySequence;              // its EXT-X-DISCONTINUITY leaves the window
+        }
+        m_segments.erase(m_segments.begin());
+    }
+}
+
+void HlsPackager::close() {
+    if (m_haveSample) {
+        m_sample.duration = m_lastDuration;
+        appendSample(std::move(m_sample), true);
+        m_haveSample = false;
+    }
+    publish(true);
+}
+
+void HlsPackager::publish(bool ended) {
+    auto window = std::make_shared<HlsWindow>();
+    window->segments = m_segments;
+    window->ended = ended;
+    window->playlist = std::make_shared<const std::string>(renderPlaylist(m_segments, ended));
+    std::atomic_store(&m_window, std::shared_ptr<const HlsWindow>(std::move(window)));
+
+    std::map<uint64_t, std::function<void()>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_waitersMutex);
+        waiters.swap(m_waiters);
+    }
+    for (auto& waiter : waiters) {
+        waiter.second();
+    }
+}
+
+std::shared_ptr<const HlsWindow> HlsPackager::window() const {
+    return std::atomic_load(&m_window);
+}
+
+uint64_t HlsPackager::addWaiter(std::function<void()> wake, const std::shared_ptr<const HlsWindow>& seen) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(m_waitersMutex);
+        id = m_nextWaiterId++;
+        // A publish after this check finds the waiter registered
+        if (window() == seen) {
+            m_waiters[id] = std::move(wake);
+            return id;
+        }
+    }
+    wake();
+    return id;
+}
+
+void HlsPackager::removeWaiter(uint64_t id) {
+    std::lock_guard<std::mutex> lock(m_waitersMutex);
+    m_waiters.erase(id);
+}
+
+std::string HlsPackager::renderPlaylist(const std::vector<HlsSegment>& segments, bool ended) const {
+    std::ostringstream playlist;
+    playlist << std::fixed << std::setprecision(3);
+    playlist << "#EXTM3U\n"
+             << "#EXT-X-VERSION:6\n"
+             << "#EXT-X-TARGETDURATION:" << m_targetDuration << "\n"
+             << "#EXT-X-PART-INF:PART-TARGET=" << PART_TARGET << "\n"
+             << "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=" << 3 * PART_TARGET << "\n"
+             << "#EXT-X-MEDIA-SEQUENCE:" << (segments.empty() ? 0 : segments.front().sequence) << "\n";
+    if (m_discontinuitySequence > 0) {
+        playlist << "#EXT-X-DISCONTINUITY-SEQUENCE:" << m_discontinuitySequence << "\n";
+    }
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const HlsSegment& segment = segments[i];
+        if (i == 0 || segment.initVersion != segments[i - 1].initVersion) {
+            if (i > 0) {
+                playlist << "#EXT-X-DISCONTINUITY\n";
+            }
+            playlist << "#EXT-X-MAP:URI=\"init/" << segment.initVersion << "\"\n";
+        }
+        if (i + SEGMENTS_WITH_PARTS >= segments.size()) {
+            for (size_t p = 0; p < segment.parts.size(); ++p) {
+                playlist << "#EXT-X-PART:DURATION=" << segment.parts[p].duration << ",URI=\"part/"
+                         << segment.sequence << "/" << p << "\"";
+                if (segment.parts[p].independent) {
+                    playlist << ",INDEPENDENT=YES";
+                }
+                playlist << "\n";
+            }
+        }
+        if (segment.complete()) {
+            playlist << "#EXTINF:" << segment.duration << ",\nsegment/" << segment.sequence << "\n";
+        }
+    }
+    if (ended) {
+        playlist << "#EXT-X-ENDLIST\n";
+    } else if (!segments.empty()) {
+        // Where the next part will appear; requests for it block until then
+        const HlsSegment& last = segments.back();
+        uint64_t sequence = last.complete() ? last.sequence + 1 : last.sequence;
+        size_t part = last.complete() ? 0 : last.parts.size();
+        playlist << "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"part/" << sequence << "/" << part << "\"\n";
+    }
+    return playlist.str();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+#include "Fmp4Muxer.h"
+
+// A partial segment: one moof + mdat, shared read-only with every request
+struct HlsPart {
+    std::shared_ptr<const std::string> data;
+    double duration{0};             // seconds
+    bool independent{false};        // starts with a keyframe
+};
+
+struct HlsSegment {
+    uint64_t sequence{0};           // media sequence number
+    std::shared_ptr<const std::string> init;    // the init segment its parts need
+    uint32_t initVersion{0};        // changes with the codec configuration
+    std::vector<HlsPart> parts;
+    std::shared_ptr<const std::string> data;    // all parts, once complete
+    double duration{0};
+
+    bool complete() const { return data != nullptr; }
+};
+
+// Immutable view of the packager's window, published after every part.
+// The playlist text is rendered once per publish, not per request.
+struct HlsWindow {
+    std::vector<HlsSegment> segments;                   // oldest first; the last may be open
+    std::shared_ptr<const std::string> playlist;
+    bool ended{false};
+
+    // What a blocking reload asked for: true once part `part` of segment
+    // `sequence` (or anything after it) is in this window
+    bool has(uint64_t sequence, int part) const;
+    const HlsSegment* find(uint64_t sequence) const;
+    // Sequence number of the segment the next part will belong to
+    uint64_t nextSequence() const;
+};
+
+// Low-latency HLS packager for one stream. Access units from h264parse go in
+// on the streaming thread; they are cut into ~200 ms fMP4 parts and
+// keyframe-aligned segments held in a bounded in-memory ring, so nothing
+// touches the disk. HTTP workers read the current HlsWindow without
+// locking, and blocking playlist reloads (_HLS_msn/_HLS_part) register a
+// waiter that is called when the next part is published.
+class HlsPackager {
+public:
+    static constexpr double PART_TARGET = 0.2;          // seconds
+    static constexpr size_t WINDOW_SEGMENTS = 6;
+
+    // targetDuration: segment length to aim for in seconds, normally one GOP
+    explicit HlsPackager(double targetDuration, int framerate);
+
+    // Streaming thread: the codec configuration, then access units in decode
+    // order with times in nanoseconds. Until a keyframe arrives after a
+    // configuration change, samples are dropped.
+    void setFormat(int width, int height, const std::string& avcC);
+    void pushSample(const uint8_t* data, size_t size, int64_t decodeTimeNs, int64_t presentationTimeNs,
+                    bool keyframe);
+    // The stream is over; wakes every waiter
+    void close();
+
+    std::shared_ptr<const HlsWindow> window() const;
+    int targetDuration() const { return m_targetDuration; }
+
+    // `wake` is called once, on the publishing thread, after the next
+    // publish; right away if the window has already moved on from `seen`.
+    // Returns an id for removeWaiter().
+    uint64_t addWaiter(std::function<void()> wake, const std::shared_ptr<const HlsWindow>& seen);
+    void removeWaiter(uint64_t id);
+
+private:
+    int m_targetDuration;                       // EXT-X-TARGETDURATION, whole seconds
+
+    // Streaming thread state
+    std::unique_ptr<Fmp4Muxer> m_muxer;
+    int m_width{0};
+    int m_height{0};
+    std::string m_pendingAvcC;                  // set while a new format waits for a keyframe
+    int m_pendingWidth{0};
+    int m_pendingHeight{0};
+    bool m_haveSample{false};
+    Fmp4Sample m_sample;                        // held until the next one gives its duration
+    uint32_t m_lastDuration;                    // ticks; stands in when there is no next sample
+    std::vector<Fmp4Sample> m_partSamples;
+    int64_t m_partTicks{0};
+    bool m_segmentOpen{false};
+    int64_t m_segmentTicks{0};
+    uint64_t m_nextSequence{0};
+    std::vector<HlsSegment> m_segments;
+    std::shared_ptr<const std::string> m_initSegment;
+    uint32_t m_initVersion{0};
+    uint64_t m_discontinuitySequence{0};
+
+    std::shared_ptr<const HlsWindow> m_window;  // accessed with std::atomic_load/store
+
+    std::mutex m_waitersMutex;
+    std::map<uint64_t, std::function<void()>> m_waiters;
+    uint64_t m_nextWaiterId{1};
+
+    void appendSample(Fmp4Sample&& sample, bool nextIsKeyframe);
+    void closePart();
+    void closeSegment();
+    void publish(bool ended = false);
+    std::string renderPlaylist(const std::vector<HlsSegment>& segments, bool ended) const;
+};
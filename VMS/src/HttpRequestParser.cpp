@@ -0,0 +1,193 @@
+#include "HttpRequestParser.h"
+#include <cstring>
+
+namespace {
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+    return value;
+}
+
+char toLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+}
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < headerCount; ++i) {
+        if (HttpRequestParser::equalsIgnoreCase(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return std::string_view();
+}
+
+HttpRequestParser::HttpRequestParser() {
+    reset();
+}
+
+void HttpRequestParser::reset() {
+    m_scanOffset = 0;
+    m_headLength = 0;
+    m_bodyLength = 0;
+    m_errorStatus = 0;
+}
+
+HttpRequestParser::Result HttpRequestParser::parse(const char* data, size_t size,
+                                                   HttpRequest& request, size_t& consumed) {
+    if (m_errorStatus != 0) {
+        return Result::Error;
+    }
+
+    if (m_headLength == 0) {
+        // Resume 3 bytes back so a terminator split across reads is still found
+        size_t from = m_scanOffset > 3 ? m_scanOffset - 3 : 0;
+        const char* end = nullptr;
+        for (const char* p = static_cast<const char*>(memchr(data + from, '\r', size - from));
+             p != nullptr && p + 3 < data + size;
+             p = static_cast<const char*>(memchr(p + 1, '\r', data + size - p - 1))) {
+            if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+                end = p + 4;
+                break;
+            }
+        }
+
+        if (end == nullptr) {
+            m_scanOffset = size;
+            if (size > MAX_HEAD_SIZE) {
+                return fail(431);
+            }
+            return Result::Incomplete;
+        }
+
+        m_headLength = end - data;
+        if (m_headLength > MAX_HEAD_SIZE) {
+            return fail(431);
+        }
+        if (!parseHead(data, m_headLength, request)) {
+            return Result::Error;
+        }
+    } else if (size >= m_headLength + m_bodyLength) {
+        // The buffer may have moved since the head was first seen; rebuild the views
+        parseHead(data, m_headLength, request);
+    }
+
+    if (size < m_headLength + m_bodyLength) {
+        return Result::Incomplete;
+    }
+
+    request.body = std::string_view(data + m_headLength, m_bodyLength);
+    consumed = m_headLength + m_bodyLength;
+    return Result::Complete;
+}
+
+bool HttpRequestParser::parseHead(const char* data, size_t headLength, HttpRequest& request) {
+    // Drop the blank line that terminates the head
+    std::string_view head(data, headLength - 2);
+
+    size_t lineEnd = head.find("\r\n");
+    std::string_view requestLine = head.substr(0, lineEnd);
+
+    size_t methodEnd = requestLine.find(' ');
+    size_t targetEnd = requestLine.rfind(' ');
+    if (methodEnd == std::string_view::npos || targetEnd == methodEnd || methodEnd == 0) {
+        fail(400);
+        return false;
+    }
+    request.method = requestLine.substr(0, methodEnd);
+    request.version = requestLine.substr(targetEnd + 1);
+    std::string_view target = requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+    if (target.empty() || request.version.substr(0, 5) != "HTTP/") {
+        fail(400);
+        return false;
+    }
+
+    size_t queryStart = target.find('?');
+    if (queryStart != std::string_view::npos) {
+        request.path = target.substr(0, queryStart);
+        request.query = target.substr(queryStart + 1);
+    } else {
+        request.path = target;
+        request.query = std::string_view();
+    }
+
+    request.headerCount = 0;
+    size_t pos = lineEnd + 2;
+    while (pos < head.size()) {
+        lineEnd = head.find("\r\n", pos);
+        std::string_view line = head.substr(pos, lineEnd - pos);
+        pos = lineEnd + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0) {
+            fail(400);
+            return false;
+        }
+        if (request.headerCount == HttpRequest::MAX_HEADERS) {
+            fail(431);
+            return false;
+        }
+        HttpHeader& header = request.headers[request.headerCount++];
+        header.name = line.substr(0, colon);
+        header.value = trim(line.substr(colon + 1));
+    }
+
+    if (!request.header("Transfer-Encoding").empty()) {
+        // Chunked uploads are not used by any endpoint
+        fail(501);
+        return false;
+    }
+
+    m_bodyLength = 0;
+    std::string_view contentLength = request.header("Content-Length");
+    if (!contentLength.empty()) {
+        size_t length = 0;
+        for (char c : contentLength) {
+            if (c < '0' || c > '9' || length > MAX_BODY_SIZE) {
+                fail(c < '0' || c > '9' ? 400 : 413);
+                return false;
+            }
+            length = length * 10 + (c - '0');
+        }
+        if (length > MAX_BODY_SIZE) {
+            fail(413);
+            return false;
+        }
+        m_bodyLength = length;
+    }
+
+    // HTTP/1.1 defaults to persistent connections, HTTP/1.0 must opt in
+    std::string_view connection = request.header("Connection");
+    if (request.version == "HTTP/1.0") {
+        request.keepAlive = hasToken(connection, "keep-alive");
+    } else {
+        request.keepAlive = !hasToken(connection, "close");
+    }
+    request.body = std::string_view();
+    return true;
+}
+
+HttpRequestParser::Result HttpRequestParser::fail(int status) {
+    m_errorStatus = status;
+    return Result::Error;
+}
+
+bool HttpRequestParser::equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (toLower(a[i]) != toLower(b[i])) return false;
+    }
+    return true;
+}
+
+bool HttpRequestParser::hasToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        if (equalsIgnoreCase(trim(value.substr(0, comma)), token)) {
+            return true;
+        }
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
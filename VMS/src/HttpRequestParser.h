@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string_view>
+#include <cstddef>
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// A parsed request. Every view points into the connection's receive buffer
+// and stays valid only until that buffer is compacted or appended to.
+struct HttpRequest {
+    static constexpr size_t MAX_HEADERS = 32;
+
+    std::string_view method;
+    std::string_view path;      // target without the query string
+    std::string_view query;     // text after '?', empty if none
+    std::string_view version;
+    HttpHeader headers[MAX_HEADERS];
+    size_t headerCount{0};
+    std::string_view body;
+    bool keepAlive{false};
+
+    // Case-insensitive header lookup; empty view if absent
+    std::string_view header(std::string_view name) const;
+};
+
+class HttpRequestParser {
+public:
+    static constexpr size_t MAX_HEAD_SIZE = 16 * 1024;
+    static constexpr size_t MAX_BODY_SIZE = 64 * 1024;
+
+    enum class Result {
+        Incomplete,   // need more bytes
+        Complete,     // request filled in, `consumed` bytes belong to it
+        Error         // malformed or oversized, see errorStatus()
+    };
+
+    HttpRequestParser();
+
+    // Parse one request from the start of data[0, size). The caller passes the
+    // same (possibly grown) buffer again after each read; scanning resumes where
+    // the previous call stopped, so partial reads cost no rescans.
+    Result parse(const char* data, size_t size, HttpRequest& request, size_t& consumed);
+
+    // Forget progress on the current request; call after consuming a Complete one
+    void reset();
+
+    int errorStatus() const { return m_errorStatus; }
+
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b);
+    // True if a comma-separated header value contains `token` (case-insensitive)
+    static bool hasToken(std::string_view value, std::string_view token);
+
+private:
+    size_t m_scanOffset;    // where to resume looking for the end of the head
+    size_t m_headLength;    // 0 until the head has been parsed
+    size_t m_bodyLength;
+    int m_errorStatus;
+
+    bool parseHead(const char* data, size_t headLength, HttpRequest& request);
+    Result fail(int status);
+};
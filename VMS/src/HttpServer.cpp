@@ -1,49 +1,176 @@
 #include "HttpServer.h"
 #include "StreamManager.h"
 #include "WebSocketHandler.h"
+#include "HttpRequestParser.h"
+#include "Router.h"
+#include "StaticAssetCache.h"
 #include <iostream>
 #include <sstream>
-#include <fstream>
+#include <iomanip>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
-#include <regex>
 #include <errno.h>
 #include <fcntl.h>
 #include <chrono>
 #include <thread>
 #include <cstring>
-#include <sys/select.h>
+#include <charconv>
+#include <map>
+#include <algorithm>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
 
-HttpServer::HttpServer(const std::string& host, int port, StreamManager* streamManager)
-    : m_host(host), m_port(port), m_streamManager(streamManager), m_running(false) {
-    m_webSocketHandler = std::make_unique<WebSocketHandler>(streamManager);
+namespace {
+constexpr size_t RECV_CHUNK_SIZE = 4096;
+constexpr size_t MAX_OUTPUT_BACKLOG = 1024 * 1024;
+// Shared broadcast frames are not counted in ownedOutBytes; bound them by count
+constexpr size_t MAX_QUEUED_CHUNKS = 1024;
+constexpr size_t MAX_IOVECS = 16;
+constexpr int MAX_EPOLL_EVENTS = 64;
+constexpr int MAX_ACCEPTS_PER_WAKEUP = 16;
+constexpr int IDLE_SWEEP_INTERVAL_MS = 1000;
+// Pinned hls.js build fetched into web/vendor by install_dependencies.sh
+constexpr std::string_view HLS_JS_PATH = "/vendor/hls.min.js";
+
+void skipSpace(std::string_view& text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t' ||
+                             text.front() == '\r' || text.front() == '\n')) {
+        text.remove_prefix(1);
+    }
 }
 
-HttpServer::~HttpServer() {
-    stop();
+// Text for inside a JSON string literal; messages may quote client input
+std::string jsonEscape(std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (byte < 0x20) {
+            escaped += "\\u00";
+            escaped += HEX[byte >> 4];
+            escaped += HEX[byte & 0xf];
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
 }
 
-void HttpServer::start() {
-    m_running = true;
-    m_serverThread = std::thread(&HttpServer::serverLoop, this);
+// IPv4 or IPv6 literal. Runtime destinations must be one: resolving a host
+// name would block the worker on DNS.
+bool isNumericHost(const std::string& host) {
+    in6_addr address;
+    return inet_pton(AF_INET, host.c_str(), &address) == 1 || inet_pton(AF_INET6, host.c_str(), &address) == 1;
 }
 
-void HttpServer::stop() {
-    m_running = false;
-    // Close the listening socket to unblock accept()
-    if (m_serverSocket >= 0) {
-        close(m_serverSocket);
-        m_serverSocket = -1;
+// Reads a flat JSON object of string, number and boolean members, such as
+// an API request body. Values come back as source text, strings unquoted;
+// escapes and nesting are rejected.
+bool parseFlatJson(std::string_view text, std::map<std::string, std::string>& fields) {
+    skipSpace(text);
+    if (text.empty() || text.front() != '{') return false;
+    text.remove_prefix(1);
+    skipSpace(text);
+    if (!text.empty() && text.front() == '}') {
+        text.remove_prefix(1);
+        skipSpace(text);
+        return text.empty();
     }
-    if (m_serverThread.joinable()) {
-        m_serverThread.join();
+    while (true) {
+        skipSpace(text);
+        if (text.empty() || text.front() != '"') return false;
+        size_t keyEnd = text.find_first_of("\"\\", 1);
+        if (keyEnd == std::string_view::npos || text[keyEnd] != '"') return false;
+        std::string key(text.substr(1, keyEnd - 1));
+        text.remove_prefix(keyEnd + 1);
+        skipSpace(text);
+        if (text.empty() || text.front() != ':') return false;
+        text.remove_prefix(1);
+        skipSpace(text);
+        if (text.empty()) return false;
+        if (text.front() == '"') {
+            size_t valueEnd = text.find_first_of("\"\\", 1);
+            if (valueEnd == std::string_view::npos || text[valueEnd] != '"') return false;
+            fields[key] = std::string(text.substr(1, valueEnd - 1));
+            text.remove_prefix(valueEnd + 1);
+        } else {
+            size_t valueEnd = text.find_first_of(",} \t\r\n");
+            std::string_view value = text.substr(0, valueEnd);
+            if (value.empty() || value.find_first_not_of("-+.0123456789eEtruefalsn") != std::string_view::npos) {
+                return false;
+            }
+            fields[key] = std::string(value);
+            text.remove_prefix(value.size());
+        }
+        skipSpace(text);
+        if (text.empty()) return false;
+        if (text.front() == '}') {
+            text.remove_prefix(1);
+            skipSpace(text);
+            return text.empty();
+        }
+        if (text.front() != ',') return false;
+        text.remove_prefix(1);
     }
 }
 
-void HttpServer::serverLoop() {
-    m_serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+// Value of `name=<non-negative integer>` in a query string
+bool queryInt(std::string_view query, std::string_view name, int64_t& value) {
+    while (!query.empty()) {
+        size_t end = query.find('&');
+        std::string_view pair = query.substr(0, end);
+        query = end == std::string_view::npos ? std::string_view() : query.substr(end + 1);
+        if (pair.size() > name.size() && pair.compare(0, name.size(), name) == 0 && pair[name.size()] == '=') {
+            std::string_view text = pair.substr(name.size() + 1);
+            auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+            return result.ec == std::errc() && result.ptr == text.data() + text.size() && value >= 0;
+        }
+    }
+    return false;
+}
+
+bool parseIntField(const std::string& text, int min, int max, int& value) {
+    int parsed = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size() || parsed < min || parsed > max) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+}
+
+HttpServer::HttpServer(const std::string& host, int port, StreamManager* streamManager, int workerThreads)
+    : m_host(host), m_port(port), m_streamManager(streamManager), m_running(false),
+      m_workerCount(workerThreads > 0 ? workerThreads : 1) {
+    m_webSocketHandler = std::make_unique<WebSocketHandler>(streamManager);
+    m_assetCache = std::make_unique<StaticAssetCache>("web");
+}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+void HttpServer::setCacheControl(const std::string& revalidate, const std::string& immutable) {
+    StaticCachePolicy policy;
+    policy.revalidate = revalidate;
+    policy.fingerprinted = immutable;
+    m_assetCache->setCachePolicy(policy);
+}
+
+void HttpServer::start() {
+    m_assetCache->start();
+    
+    m_serverSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (m_serverSocket < 0) {
         throw std::runtime_error("Failed to create socket");
     }
@@ -52,207 +179,1058 @@ void HttpServer::serverLoop() {
     int opt = 1;
     setsockopt(m_serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
     
-    sockaddr_in serverAddr;
+    sockaddr_in serverAddr{};
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_port = htons(m_port);
     inet_pton(AF_INET, m_host.c_str(), &serverAddr.sin_addr);
     
     if (bind(m_serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        int bindErrno = errno;
         close(m_serverSocket);
+        m_serverSocket = -1;
         std::string errorMsg = "Failed to bind socket to " + m_host + ":" + std::to_string(m_port);
-        if (errno == EADDRINUSE) {
+        if (bindErrno == EADDRINUSE) {
             errorMsg += " (Port already in use)";
-        } else if (errno == EADDRNOTAVAIL) {
+        } else if (bindErrno == EADDRNOTAVAIL) {
             errorMsg += " (Address not available)";
-        } else if (errno == EACCES) {
+        } else if (bindErrno == EACCES) {
             errorMsg += " (Permission denied - try running with sudo)";
         } else {
-            errorMsg += " (Error: " + std::to_string(errno) + ")";
+            errorMsg += " (Error: " + std::to_string(bindErrno) + ")";
         }
         throw std::runtime_error(errorMsg);
     }
     
-    if (listen(m_serverSocket, 10) < 0) {
+    if (listen(m_serverSocket, SOMAXCONN) < 0) {
         close(m_serverSocket);
+        m_serverSocket = -1;
         throw std::runtime_error("Failed to listen on socket");
     }
     
-    std::cout << "HTTP server listening on " << m_host << ":" << m_port << std::endl;
+    // Create one epoll reactor per worker; all of them watch the listening socket
+    for (int i = 0; i < m_workerCount; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->index = i;
+        worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        worker->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (worker->epollFd < 0 || worker->wakeFd < 0) {
+            if (worker->epollFd >= 0) close(worker->epollFd);
+            if (worker->wakeFd >= 0) close(worker->wakeFd);
+            m_workers.clear();
+            close(m_serverSocket);
+            m_serverSocket = -1;
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+        
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = worker->wakeFd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->wakeFd, &ev);
+        
+        // EPOLLEXCLUSIVE avoids waking every worker per connection (Linux 4.5+)
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.fd = m_serverSocket;
+        if (epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, m_serverSocket, &ev) < 0) {
+            ev.events = EPOLLIN;
+            epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, m_serverSocket, &ev);
+        }
+        m_workers.push_back(std::move(worker));
+    }
+    
+    std::cout << "HTTP server listening on " << m_host << ":" << m_port
+              << " (" << m_workerCount << " worker threads)" << std::endl;
     std::cout << "Server is running... Press Ctrl+C to stop" << std::endl;
     
+    m_running = true;
+    m_serverThread = std::thread(&HttpServer::serverLoop, this);
+}
+
+void HttpServer::stop() {
+    m_running = false;
+    // Wake every reactor so epoll_wait() returns and the loops observe m_running
+    for (auto& worker : m_workers) {
+        uint64_t one = 1;
+        ssize_t ignored = write(worker->wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+    if (m_serverThread.joinable()) {
+        m_serverThread.join();
+    }
+    for (auto& worker : m_workers) {
+        std::vector<int> fds;
+        for (const auto& pair : worker->connections) {
+            fds.push_back(pair.first);
+        }
+        for (int fd : fds) {
+            closeConnection(*worker, fd);
+        }
+        close(worker->wakeFd);
+        close(worker->epollFd);
+    }
+    m_workers.clear();
+    if (m_serverSocket >= 0) {
+        close(m_serverSocket);
+        m_serverSocket = -1;
+    }
+    m_assetCache->stop();
+}
+
+void HttpServer::serverLoop() {
+    // The server thread doubles as worker 0; the rest get their own threads
+    for (size_t i = 1; i < m_workers.size(); ++i) {
+        Worker& worker = *m_workers[i];
+        worker.thread = std::thread(&HttpServer::workerLoop, this, std::ref(worker));
+    }
+    
+    workerLoop(*m_workers[0]);
+    
+    for (size_t i = 1; i < m_workers.size(); ++i) {
+        if (m_workers[i]->thread.joinable()) {
+            m_workers[i]->thread.join();
+        }
+    }
+}
+
+void HttpServer::workerLoop(Worker& worker) {
+    epoll_event events[MAX_EPOLL_EVENTS];
+    
+    worker.lastSweep = std::chrono::steady_clock::now();
+    
     while (m_running) {
-        // Wait for readiness with timeout so we can react to stop()
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(m_serverSocket, &readfds);
-        timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 200000; // 200ms
-
-        int sel = select(m_serverSocket + 1, &readfds, nullptr, nullptr, &tv);
+        // Only tick while there are connections whose idle timers need checking
+        int timeout = worker.connections.empty() ? -1 : IDLE_SWEEP_INTERVAL_MS;
+        int count = epoll_wait(worker.epollFd, events, MAX_EPOLL_EVENTS, timeout);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed in HTTP worker " << worker.index
+                      << " (Error: " << errno << ")" << std::endl;
+            break;
+        }
         if (!m_running) break;
-        if (sel <= 0) {
-            // timeout or interrupted
-            continue;
+        
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            uint32_t flags = events[i].events;
+            
+            if (fd == worker.wakeFd) {
+                uint64_t value;
+                ssize_t ignored = read(worker.wakeFd, &value, sizeof(value));
+                (void)ignored;
+                drainReadyViewers(worker);
+                drainReadyRequests(worker);
+                drainReadySessions(worker);
+                continue;
+            }
+            if (fd == m_serverSocket) {
+                acceptConnections(worker);
+                continue;
+            }
+            
+            auto it = worker.connections.find(fd);
+            if (it == worker.connections.end()) {
+                continue;
+            }
+            Connection& conn = *it->second;
+            
+            if (flags & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(worker, fd);
+                continue;
+            }
+            if (flags & EPOLLIN) {
+                handleReadable(worker, conn);
+                if (worker.connections.find(fd) == worker.connections.end()) {
+                    continue;
+                }
+            }
+            if (flags & EPOLLOUT) {
+                if (!flushConnection(conn)) {
+                    closeConnection(worker, fd);
+                } else if (conn.viewer && conn.out.empty()) {
+                    // The previous frame is out; send whatever arrived meanwhile
+                    pumpViewer(worker, conn);
+                }
+            }
+        }
+        
+        if (std::chrono::steady_clock::now() - worker.lastSweep >=
+            std::chrono::milliseconds(IDLE_SWEEP_INTERVAL_MS)) {
+            closeIdleConnections(worker);
+            sampleViewerRates(worker);
+            pingWebSockets(worker);
         }
+    }
+}
 
+void HttpServer::acceptConnections(Worker& worker) {
+    // Accept a bounded batch; the listening socket is level-triggered so any
+    // backlog left over wakes the next idle worker instead of piling up here.
+    for (int i = 0; i < MAX_ACCEPTS_PER_WAKEUP; ++i) {
         sockaddr_in clientAddr;
         socklen_t clientLen = sizeof(clientAddr);
-        int clientSocket = accept(m_serverSocket, (sockaddr*)&clientAddr, &clientLen);
+        int clientSocket = accept4(m_serverSocket, (sockaddr*)&clientAddr, &clientLen,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (clientSocket < 0) {
-            if (!m_running) break;
-            // If socket was closed during stop(), exit loop
-            if (errno == EBADF || errno == EINVAL) break;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            // EAGAIN: backlog drained. Anything else (e.g. EMFILE) is retried on the next wakeup.
+            return;
+        }
+        
+        int nodelay = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = clientSocket;
+        if (epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, clientSocket, &ev) < 0) {
+            close(clientSocket);
             continue;
         }
+        
+        auto conn = std::make_unique<Connection>();
+        conn->fd = clientSocket;
+        conn->lastActivity = std::chrono::steady_clock::now();
+        conn->in.reserve(2 * RECV_CHUNK_SIZE);
+        worker.connections[clientSocket] = std::move(conn);
+    }
+}
 
-        // Handle request in a separate thread
-        std::thread([this, clientSocket]() {
-            char buffer[4096];
-            int bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-            if (bytesRead > 0) {
-                buffer[bytesRead] = '\0';
-                std::string request(buffer);
-                std::string response = handleRequest(request);
-                send(clientSocket, response.c_str(), response.length(), 0);
+void HttpServer::handleReadable(Worker& worker, Connection& conn) {
+    int fd = conn.fd;
+    bool peerClosed = false;
+    
+    // Edge-triggered: drain the socket until the kernel reports EAGAIN. Bytes are
+    // received straight into the connection buffer and parsed after every read,
+    // so at most one partial request plus one read chunk is ever buffered.
+    while (!conn.closeAfterWrite) {
+        size_t used = conn.in.size();
+        conn.in.resize(used + RECV_CHUNK_SIZE);
+        ssize_t bytesRead = recv(fd, &conn.in[used], RECV_CHUNK_SIZE, 0);
+        conn.in.resize(used + (bytesRead > 0 ? bytesRead : 0));
+        
+        if (bytesRead > 0) {
+            conn.lastActivity = std::chrono::steady_clock::now();
+            processRequests(worker, conn);
+            if (conn.ownedOutBytes > MAX_OUTPUT_BACKLOG || conn.in.size() > MAX_OUTPUT_BACKLOG) {
+                // Client pipelines requests but never reads the responses, or
+                // keeps sending behind a blocked one
+                closeConnection(worker, fd);
+                return;
             }
-            close(clientSocket);
-        }).detach();
+            continue;
+        }
+        if (bytesRead == 0) {
+            peerClosed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        closeConnection(worker, fd);
+        return;
     }
     
-    if (m_serverSocket >= 0) {
-        close(m_serverSocket);
-        m_serverSocket = -1;
+    if (peerClosed && conn.out.empty()) {
+        closeConnection(worker, fd);
+        return;
+    }
+    if (peerClosed) {
+        conn.closeAfterWrite = true;
+    }
+    
+    if (!flushConnection(conn)) {
+        closeConnection(worker, fd);
     }
 }
 
-std::string HttpServer::handleRequest(const std::string& request) {
-    std::istringstream requestStream(request);
-    std::string method, path, version;
-    requestStream >> method >> path >> version;
+void HttpServer::processRequests(Worker& worker, Connection& conn) {
+    // After an upgrade the client sends WebSocket frames, not requests
+    if (conn.frameParser) {
+        processWebSocketFrames(conn);
+        return;
+    }
+    // A live stream response never ends, so nothing after it can be answered
+    if (conn.viewer) {
+        conn.in.clear();
+        return;
+    }
+    // Pipelined requests queue behind a blocked one to keep responses in order
+    if (conn.blockedOn) {
+        return;
+    }
     
-    // Handle WebSocket upgrade
-    if (method == "GET" && request.find("Upgrade: websocket") != std::string::npos) {
-        return m_webSocketHandler->handleWebSocketUpgrade(request);
+    size_t consumedTotal = 0;
+    
+    // Serve every complete request in the buffer; pipelined responses are
+    // queued in request order and written out together.
+    while (!conn.closeAfterWrite && !conn.viewer && !conn.frameParser) {
+        HttpRequest request;
+        size_t consumed = 0;
+        HttpRequestParser::Result result = conn.parser.parse(
+            conn.in.data() + consumedTotal, conn.in.size() - consumedTotal, request, consumed);
+        
+        if (result == HttpRequestParser::Result::Incomplete) {
+            break;
+        }
+        
+        HttpResponse response;
+        bool keepAlive = false;
+        if (result == HttpRequestParser::Result::Error) {
+            response = createErrorResponse(conn.parser.errorStatus(), "Malformed request");
+        } else {
+            try {
+                response = handleRequest(request, !conn.blockExpired);
+            } catch (const std::exception& e) {
+                std::cerr << "Error handling HTTP request: " << e.what() << std::endl;
+                response = createErrorResponse(500, "Internal server error");
+            }
+            conn.blockExpired = false;
+            if (response.blockOn) {
+                // Left in the buffer and parsed again when the wait ends
+                conn.parser.reset();
+                blockRequest(worker, conn, response);
+                break;
+            }
+            keepAlive = request.keepAlive && ++conn.requestsServed < MAX_REQUESTS_PER_CONNECTION;
+            consumedTotal += consumed;
+            conn.parser.reset();
+        }
+        
+        bool keepOpen = finalizeResponse(response, keepAlive);
+        std::shared_ptr<FrameFanout> stream = std::move(response.stream);
+        bool webSocket = response.webSocket;
+        queueResponse(conn, std::move(response));
+        
+        if (webSocket) {
+            conn.frameParser = std::make_unique<WebSocketFrameParser>();
+            conn.lastReceived = std::chrono::steady_clock::now();
+            conn.lastPing = conn.lastReceived;
+        }
+        if (stream) {
+            // The response body is the live stream; frames follow the head
+            sockaddr_in peerAddr{};
+            socklen_t peerLen = sizeof(peerAddr);
+            char peerHost[INET_ADDRSTRLEN] = "";
+            std::string peer;
+            if (getpeername(conn.fd, (sockaddr*)&peerAddr, &peerLen) == 0 &&
+                inet_ntop(AF_INET, &peerAddr.sin_addr, peerHost, sizeof(peerHost))) {
+                peer = std::string(peerHost) + ":" + std::to_string(ntohs(peerAddr.sin_port));
+            }
+            auto viewer = std::make_shared<StreamViewer>(worker, conn.fd, m_nextViewerId++,
+                                                         std::move(peer), stream);
+            if (stream->subscribe(viewer)) {
+                conn.viewer = std::move(viewer);
+            } else {
+                conn.closeAfterWrite = true;
+            }
+        } else if (webSocket) {
+            // A dashboard session: state changes are pushed to it until it closes
+            conn.webSocket = std::make_shared<WebSocketSession>(worker, conn.fd, m_nextViewerId++);
+            m_webSocketHandler->addConnection(conn.webSocket->id, conn.webSocket);
+        } else if (!keepOpen) {
+            conn.closeAfterWrite = true;
+        }
     }
     
-    // Handle API endpoints
-    if (path.find("/api/") == 0) {
-        if (path == "/api/streams") {
-            return handleApiStreams();
-        } else if (path.find("/api/stream/") == 0) {
-            std::regex streamRegex("/api/stream/(\\d+)/(start|stop|status)");
-            std::smatch matches;
-            if (std::regex_match(path, matches, streamRegex)) {
-                std::string streamId = matches[1].str();
-                std::string action = matches[2].str();
-                
-                if (action == "start") {
-                    return handleApiStreamStart(streamId);
-                } else if (action == "stop") {
-                    return handleApiStreamStop(streamId);
-                } else if (action == "status") {
-                    return handleApiStreamStatus(streamId);
+    // Shift the unconsumed tail (usually nothing) to the front of the buffer
+    if (consumedTotal > 0) {
+        conn.in.erase(0, consumedTotal);
+    }
+    // Frames the client sent right behind its handshake
+    if (conn.frameParser && !conn.in.empty()) {
+        processWebSocketFrames(conn);
+    }
+}
+
+void HttpServer::processWebSocketFrames(Connection& conn) {
+    size_t consumedTotal = 0;
+    while (!conn.closeAfterWrite) {
+        WebSocketMessage message;
+        size_t consumed = 0;
+        WebSocketFrameParser::Result result = conn.frameParser->parse(
+            conn.in.data() + consumedTotal, conn.in.size() - consumedTotal, message, consumed);
+        consumedTotal += consumed;
+        if (consumed > 0) {
+            conn.lastReceived = std::chrono::steady_clock::now();
+        }
+        
+        if (result == WebSocketFrameParser::Result::Incomplete) {
+            break;
+        }
+        if (result == WebSocketFrameParser::Result::Error) {
+            queueWebSocketClose(conn, conn.frameParser->errorCode());
+            break;
+        }
+        
+        switch (message.opcode) {
+            case WebSocketOpcode::Text:
+                if (conn.webSocket) {
+                    m_webSocketHandler->handleWebSocketMessage(conn.webSocket->id, message.payload);
+                }
+                break;
+            case WebSocketOpcode::Ping: {
+                OutboundChunk pong;
+                WebSocketHandler::appendFrame(pong.owned, WebSocketOpcode::Pong, message.payload);
+                conn.ownedOutBytes += pong.owned.size();
+                conn.out.push_back(std::move(pong));
+                break;
+            }
+            case WebSocketOpcode::Close: {
+                // Echo the client's status code, then close once it is out
+                uint16_t code = WebSocketFrameParser::CLOSE_NORMAL;
+                if (message.payload.size() >= 2) {
+                    code = static_cast<uint16_t>((static_cast<uint8_t>(message.payload[0]) << 8) |
+                                                 static_cast<uint8_t>(message.payload[1]));
+                } else if (message.payload.size() == 1) {
+                    code = WebSocketFrameParser::CLOSE_PROTOCOL_ERROR;
                 }
+                queueWebSocketClose(conn, code);
+                break;
             }
+            default:
+                break;                              // binary messages and pongs are not used
         }
-        return createErrorResponse(404, "API endpoint not found");
     }
     
-    // Handle video stream endpoints
-    if (path.find("/stream/") == 0) {
-        std::regex streamRegex("/stream/(\\d+)(?:/(\\w+))?");
-        std::smatch matches;
-        if (std::regex_match(path, matches, streamRegex)) {
-            std::string streamId = matches[1].str();
-            if (matches.size() > 2 && matches[2].str() == "mjpeg") {
-                return handleMJPEGStream(streamId);
-            } else {
-                return handleVideoStream(streamId);
+    if (conn.closeAfterWrite) {
+        conn.in.clear();
+    } else if (consumedTotal > 0) {
+        conn.in.erase(0, consumedTotal);
+    }
+}
+
+void HttpServer::queueWebSocketClose(Connection& conn, uint16_t code) {
+    if (!conn.closeSent) {
+        OutboundChunk close;
+        close.owned = WebSocketHandler::closeFrame(code);
+        conn.ownedOutBytes += close.owned.size();
+        conn.out.push_back(std::move(close));
+        conn.closeSent = true;
+    }
+    conn.closeAfterWrite = true;
+}
+
+bool HttpServer::finalizeResponse(HttpResponse& response, bool keepAlive) {
+    size_t headEnd = response.data.find("\r\n\r\n");
+    if (headEnd == std::string::npos) return false;
+    
+    // Without a length the client can only find the end of the body by EOF;
+    // a 304 never has a body
+    std::string_view head(response.data.data(), headEnd);
+    // After a 101 the connection belongs to the new protocol
+    if (head.compare(0, 12, "HTTP/1.1 101") == 0) {
+        return false;
+    }
+    bool bodiless = head.compare(0, 12, "HTTP/1.1 304") == 0;
+    if (!bodiless && head.find("Content-Length:") == std::string_view::npos) {
+        keepAlive = false;
+    }
+    
+    std::string connectionHeaders;
+    if (keepAlive) {
+        connectionHeaders = "\r\nConnection: keep-alive\r\nKeep-Alive: timeout=" +
+                            std::to_string(KEEP_ALIVE_TIMEOUT_SECONDS) +
+                            ", max=" + std::to_string(MAX_REQUESTS_PER_CONNECTION);
+    } else {
+        connectionHeaders = "\r\nConnection: close";
+    }
+    response.data.insert(headEnd, connectionHeaders);
+    return keepAlive;
+}
+
+void HttpServer::queueResponse(Connection& conn, HttpResponse&& response) {
+    OutboundChunk head;
+    head.owned = std::move(response.data);
+    conn.ownedOutBytes += head.owned.size();
+    conn.out.push_back(std::move(head));
+    
+    if (response.payload) {
+        OutboundChunk body;
+        body.borrowed = *response.payload;
+        body.holder = std::move(response.payload);
+        if (body.size() > 0) {
+            conn.out.push_back(std::move(body));
+        }
+    }
+    
+    if (!response.asset) return;
+    OutboundChunk body;
+    if (response.sendFile) {
+        body.fileFd = response.asset->fd;
+        body.fileLength = response.asset->size;
+    } else {
+        body.borrowed = response.body;
+    }
+    body.holder = std::move(response.asset);
+    if (body.size() > 0) {
+        conn.out.push_back(std::move(body));
+    }
+}
+
+bool HttpServer::flushConnection(Connection& conn) {
+    while (!conn.out.empty()) {
+        OutboundChunk& front = conn.out.front();
+        ssize_t sent;
+        if (front.fileFd >= 0) {
+            // Large cached assets go from the page cache straight to the socket
+            off_t offset = front.offset;
+            sent = sendfile(conn.fd, front.fileFd, &offset, front.size() - front.offset);
+        } else {
+            // Gather queued heads and bodies into a single syscall
+            iovec iov[MAX_IOVECS];
+            size_t count = 0;
+            for (const OutboundChunk& chunk : conn.out) {
+                if (chunk.fileFd >= 0 || count == MAX_IOVECS) break;
+                iov[count].iov_base = const_cast<char*>(chunk.bytes() + chunk.offset);
+                iov[count].iov_len = chunk.size() - chunk.offset;
+                ++count;
             }
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            sent = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
         }
+        
+        if (sent > 0) {
+            consumeOutput(conn, sent);
+            conn.lastActivity = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Kernel buffer full; EPOLLOUT will resume the write
+            return true;
+        }
+        return false;
     }
     
-    // Serve static files
-    if (path == "/") {
-        path = "/index.html";
+    return !conn.closeAfterWrite;
+}
+
+void HttpServer::consumeOutput(Connection& conn, size_t bytes) {
+    while (bytes > 0 && !conn.out.empty()) {
+        OutboundChunk& front = conn.out.front();
+        size_t remaining = front.size() - front.offset;
+        if (bytes < remaining) {
+            front.offset += bytes;
+            if (!front.holder) conn.ownedOutBytes -= bytes;
+            return;
+        }
+        bytes -= remaining;
+        if (!front.holder) conn.ownedOutBytes -= remaining;
+        conn.out.pop_front();
+    }
+}
+
+void HttpServer::closeConnection(Worker& worker, int fd) {
+    auto it = worker.connections.find(fd);
+    if (it != worker.connections.end() && it->second->viewer) {
+        StreamViewer& viewer = *it->second->viewer;
+        viewer.detach();
+        viewer.fanout->unsubscribe(&viewer);
+    }
+    if (it != worker.connections.end() && it->second->blockedOn) {
+        it->second->blockedOn->removeWaiter(it->second->waiterId);
+    }
+    if (it != worker.connections.end() && it->second->webSocket) {
+        it->second->webSocket->detach();
+        m_webSocketHandler->removeConnection(it->second->webSocket->id);
+    }
+    epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    worker.connections.erase(fd);
+}
+
+void HttpServer::drainReadyViewers(Worker& worker) {
+    std::vector<int> ready;
+    {
+        std::lock_guard<std::mutex> lock(worker.readyMutex);
+        ready.swap(worker.readyViewers);
+    }
+    for (int fd : ready) {
+        auto it = worker.connections.find(fd);
+        // The fd may have been closed (or even reused) since it was posted
+        if (it != worker.connections.end() && it->second->viewer) {
+            pumpViewer(worker, *it->second);
+        }
+    }
+}
+
+void HttpServer::drainReadyRequests(Worker& worker) {
+    std::vector<int> ready;
+    {
+        std::lock_guard<std::mutex> lock(worker.readyMutex);
+        ready.swap(worker.readyRequests);
+    }
+    for (int fd : ready) {
+        auto it = worker.connections.find(fd);
+        // A stale wakeup only makes a still-blocked request register again
+        if (it != worker.connections.end() && it->second->blockedOn) {
+            resumeRequest(worker, *it->second);
+        }
+    }
+}
+
+void HttpServer::drainReadySessions(Worker& worker) {
+    std::vector<int> ready;
+    {
+        std::lock_guard<std::mutex> lock(worker.readyMutex);
+        ready.swap(worker.readySessions);
+    }
+    for (int fd : ready) {
+        auto it = worker.connections.find(fd);
+        if (it == worker.connections.end() || !it->second->webSocket) {
+            continue;
+        }
+        Connection& conn = *it->second;
+        for (auto& frame : conn.webSocket->takeFrames()) {
+            if (conn.closeSent) break;
+            // Borrowed: every session sending this frame shares one copy
+            OutboundChunk chunk;
+            chunk.borrowed = *frame;
+            chunk.holder = std::move(frame);
+            conn.out.push_back(std::move(chunk));
+        }
+        // A session that stopped reading would otherwise buffer without bound
+        if (conn.ownedOutBytes > MAX_OUTPUT_BACKLOG || conn.out.size() > MAX_QUEUED_CHUNKS ||
+            !flushConnection(conn)) {
+            closeConnection(worker, fd);
+        }
+    }
+}
+
+void HttpServer::pingWebSockets(Worker& worker) {
+    auto now = std::chrono::steady_clock::now();
+    const auto interval = std::chrono::seconds(WEBSOCKET_PING_INTERVAL_SECONDS);
+    std::vector<int> dead;
+    for (const auto& pair : worker.connections) {
+        Connection& conn = *pair.second;
+        if (!conn.frameParser || conn.closeAfterWrite) {
+            continue;
+        }
+        // Browsers answer pings on their own, so silence means the peer is gone
+        if (now - conn.lastReceived >= 2 * interval) {
+            dead.push_back(pair.first);
+        } else if (now - conn.lastPing >= interval) {
+            OutboundChunk ping;
+            WebSocketHandler::appendFrame(ping.owned, WebSocketOpcode::Ping, std::string_view());
+            conn.ownedOutBytes += ping.owned.size();
+            conn.out.push_back(std::move(ping));
+            conn.lastPing = now;
+            if (!flushConnection(conn)) {
+                dead.push_back(pair.first);
+            }
+        }
+    }
+    for (int fd : dead) {
+        closeConnection(worker, fd);
+    }
+}
+
+void HttpServer::blockRequest(Worker& worker, Connection& conn, HttpResponse& response) {
+    conn.blockedOn = std::move(response.blockOn);
+    // Past the deadline the client gets what there is rather than waiting on
+    // a stream that has stalled
+    conn.blockDeadline = std::chrono::steady_clock::now() +
+                         std::chrono::seconds(3 * conn.blockedOn->targetDuration());
+    Worker* owner = &worker;
+    int fd = conn.fd;
+    // Runs on the streaming thread that published the part, or right here if
+    // it already has
+    conn.waiterId = conn.blockedOn->addWaiter([owner, fd] {
+        {
+            std::lock_guard<std::mutex> lock(owner->readyMutex);
+            owner->readyRequests.push_back(fd);
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(owner->wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }, response.blockedWindow);
+}
+
+void HttpServer::resumeRequest(Worker& worker, Connection& conn) {
+    conn.blockedOn->removeWaiter(conn.waiterId);
+    conn.blockedOn.reset();
+    conn.lastActivity = std::chrono::steady_clock::now();
+    processRequests(worker, conn);
+    if (!flushConnection(conn)) {
+        closeConnection(worker, conn.fd);
+    }
+}
+
+void HttpServer::pumpViewer(Worker& worker, Connection& conn) {
+    // Only one frame is ever in flight; while it drains, newer frames simply
+    // replace the pending one, so a slow client skips frames instead of lagging
+    if (conn.closeAfterWrite || !conn.out.empty()) {
+        return;
+    }
+    
+    bool ended = false;
+    std::shared_ptr<const EncodedFrame> frame = conn.viewer->takeFrame(ended);
+    if (frame) {
+        OutboundChunk chunk;
+        chunk.borrowed = frame->data;
+        chunk.holder = std::move(frame);
+        conn.out.push_back(std::move(chunk));
+        conn.viewer->countDelivered();
+    }
+    if (ended) {
+        conn.closeAfterWrite = true;
     }
     
-    return serveStaticFile(path);
+    if (!flushConnection(conn)) {
+        closeConnection(worker, conn.fd);
+    }
+}
+
+void HttpServer::sampleViewerRates(Worker& worker) {
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& pair : worker.connections) {
+        if (pair.second->viewer) {
+            pair.second->viewer->sampleRates(now);
+        }
+    }
+}
+
+HttpServer::StreamViewer::StreamViewer(Worker& worker, int fd, uint64_t id, std::string peer,
+                                       std::shared_ptr<FrameFanout> fanout)
+    : fanout(std::move(fanout)), m_worker(worker), m_fd(fd), m_id(id), m_peer(std::move(peer)),
+      m_connectedAt(std::chrono::steady_clock::now()), m_lastSample(m_connectedAt) {
 }
 
-std::string HttpServer::serveStaticFile(const std::string& path) {
-    std::string filePath = "web" + path;
+void HttpServer::StreamViewer::onFrame(const std::shared_ptr<const EncodedFrame>& frame) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_detached) return;
+    if (frame) {
+        if (!frame->independent && (m_pending || m_needIndependent)) {
+            // Without the frames before it this one cannot be decoded; skip
+            // to the next independent frame instead of queueing
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            m_needIndependent = true;
+            return;
+        }
+        if (m_pending) {
+            // The client has not taken the previous frame yet: it is stale now
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_pending = frame;
+        m_needIndependent = false;
+    } else {
+        m_ended = true;
+    }
+    if (m_scheduled) return;
+    m_scheduled = true;
     
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file.is_open()) {
-        return createErrorResponse(404, "File not found");
+    {
+        std::lock_guard<std::mutex> readyLock(m_worker.readyMutex);
+        m_worker.readyViewers.push_back(m_fd);
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(m_worker.wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+std::shared_ptr<const EncodedFrame> HttpServer::StreamViewer::takeFrame(bool& ended) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scheduled = false;
+    ended = m_ended;
+    return std::move(m_pending);
+}
+
+ViewerStats HttpServer::StreamViewer::stats() const {
+    ViewerStats stats;
+    stats.id = m_id;
+    stats.peer = m_peer;
+    stats.connectedSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - m_connectedAt).count();
+    stats.framesDelivered = m_delivered.load(std::memory_order_relaxed);
+    stats.framesDropped = m_dropped.load(std::memory_order_relaxed);
+    stats.deliveredFps = m_deliveredFps.load(std::memory_order_relaxed);
+    stats.droppedFps = m_droppedFps.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void HttpServer::StreamViewer::sampleRates(std::chrono::steady_clock::time_point now) {
+    double seconds = std::chrono::duration<double>(now - m_lastSample).count();
+    if (seconds <= 0) return;
+    uint64_t delivered = m_delivered.load(std::memory_order_relaxed);
+    uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    m_deliveredFps.store((delivered - m_lastDelivered) / seconds, std::memory_order_relaxed);
+    m_droppedFps.store((dropped - m_lastDropped) / seconds, std::memory_order_relaxed);
+    m_lastDelivered = delivered;
+    m_lastDropped = dropped;
+    m_lastSample = now;
+}
+
+HttpServer::WebSocketSession::WebSocketSession(Worker& worker, int fd, uint64_t id)
+    : id(id), m_worker(worker), m_fd(fd) {
+}
+
+void HttpServer::WebSocketSession::send(std::shared_ptr<const std::string> frame) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_detached) return;
+    m_pending.push_back(std::move(frame));
+    if (m_scheduled) return;
+    m_scheduled = true;
+    
+    {
+        std::lock_guard<std::mutex> readyLock(m_worker.readyMutex);
+        m_worker.readySessions.push_back(m_fd);
     }
+    uint64_t one = 1;
+    ssize_t ignored = write(m_worker.wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+std::vector<std::shared_ptr<const std::string>> HttpServer::WebSocketSession::takeFrames() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scheduled = false;
+    return std::move(m_pending);
+}
+
+void HttpServer::WebSocketSession::detach() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_detached = true;
+    m_pending.clear();
+}
+
+void HttpServer::StreamViewer::detach() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_detached = true;
+    m_pending.reset();
+}
+
+void HttpServer::closeIdleConnections(Worker& worker) {
+    auto now = std::chrono::steady_clock::now();
+    worker.lastSweep = now;
     
-    std::ostringstream content;
-    content << file.rdbuf();
-    file.close();
+    std::vector<int> expired;
+    std::vector<int> timedOut;
+    for (const auto& pair : worker.connections) {
+        // A blocked request is bounded by its own deadline instead
+        if (pair.second->blockedOn) {
+            if (now >= pair.second->blockDeadline) {
+                timedOut.push_back(pair.first);
+            }
+        } else if (!pair.second->frameParser &&
+                   now - pair.second->lastActivity >= std::chrono::seconds(KEEP_ALIVE_TIMEOUT_SECONDS)) {
+            expired.push_back(pair.first);
+        }
+    }
+    for (int fd : expired) {
+        closeConnection(worker, fd);
+    }
+    for (int fd : timedOut) {
+        auto it = worker.connections.find(fd);
+        if (it != worker.connections.end()) {
+            it->second->blockExpired = true;
+            resumeRequest(worker, *it->second);
+        }
+    }
+}
+
+HttpResponse HttpServer::handleRequest(const HttpRequest& request, bool mayBlock) {
+    std::string_view path = request.path;
     
-    std::string mimeType = getMimeType(path);
+    RouteMatch route = matchRoute(request.method, path);
     
-    std::ostringstream response;
-    response << "HTTP/1.1 200 OK\r\n";
-    response << "Content-Type: " << mimeType << "\r\n";
-    response << "Content-Length: " << content.str().length() << "\r\n";
-    response << "Access-Control-Allow-Origin: *\r\n";
-    response << "Connection: close\r\n";
-    response << "\r\n";
-    response << content.str();
+    // Handle WebSocket upgrade
+    if (request.method == "GET" &&
+        HttpRequestParser::equalsIgnoreCase(request.header("Upgrade"), "websocket")) {
+        if (route.id == RouteId::WsStream) {
+            return handleWebSocketStream(request, route.intParam(0));
+        }
+        HttpResponse response(m_webSocketHandler->handleWebSocketUpgrade(request));
+        response.webSocket = response.data.compare(0, 12, "HTTP/1.1 101") == 0;
+        return response;
+    }
     
-    return response.str();
+    // Handle API and video stream endpoints
+    switch (route.id) {
+        case RouteId::ApiStreams:
+            return handleApiStreams();
+        case RouteId::ApiStreamStart:
+            return handleApiStreamStart(route.intParam(0));
+        case RouteId::ApiStreamStop:
+            return handleApiStreamStop(route.intParam(0));
+        case RouteId::ApiStreamStatus:
+            return handleApiStreamStatus(route.intParam(0));
+        case RouteId::ApiStreamViewers:
+            return handleApiStreamViewers(route.intParam(0));
+        case RouteId::ApiStreamEncoder:
+            return handleApiStreamEncoder(route.intParam(0), request.body);
+        case RouteId::ApiStreamKeyframe:
+            return handleApiStreamKeyframe(route.intParam(0));
+        case RouteId::ApiStreamRenditions:
+            return handleApiStreamRenditions(route.intParam(0));
+        case RouteId::ApiStreamDestinations:
+            return handleApiStreamDestinations(route.intParam(0));
+        case RouteId::ApiStreamDestinationAdd:
+            return handleApiStreamDestinationEdit(route.intParam(0), request.body, true);
+        case RouteId::ApiStreamDestinationRemove:
+            return handleApiStreamDestinationEdit(route.intParam(0), request.body, false);
+        case RouteId::StreamMjpeg:
+            return handleMJPEGStream(route.intParam(0));
+        case RouteId::HlsPlaylist:
+        case RouteId::HlsInit:
+        case RouteId::HlsSegment:
+        case RouteId::HlsPart:
+            return handleHls(route, request.query, mayBlock);
+        case RouteId::WsStream:
+            return createErrorResponse(400, "WebSocket upgrade required");
+        case RouteId::StreamPage:
+            return handleVideoStream(route.intParam(0));
+        case RouteId::None:
+            break;
+    }
+    
+    if (path.compare(0, 5, "/api/") == 0) {
+        return createErrorResponse(404, "API endpoint not found");
+    }
+    
+    // Serve static files
+    if (path == "/") {
+        path = "/index.html";
+    }
+    
+    return serveStaticFile(request, path);
 }
 
-std::string HttpServer::getMimeType(const std::string& path) {
-    if (path.length() >= 5 && path.substr(path.length() - 5) == ".html") return "text/html";
-    if (path.length() >= 4 && path.substr(path.length() - 4) == ".css") return "text/css";
-    if (path.length() >= 3 && path.substr(path.length() - 3) == ".js") return "application/javascript";
-    if (path.length() >= 5 && path.substr(path.length() - 5) == ".json") return "application/json";
-    if (path.length() >= 4 && path.substr(path.length() - 4) == ".png") return "image/png";
-    if ((path.length() >= 4 && path.substr(path.length() - 4) == ".jpg") || 
-        (path.length() >= 5 && path.substr(path.length() - 5) == ".jpeg")) return "image/jpeg";
-    if (path.length() >= 4 && path.substr(path.length() - 4) == ".gif") return "image/gif";
-    if (path.length() >= 4 && path.substr(path.length() - 4) == ".svg") return "image/svg+xml";
-    return "text/plain";
+HttpResponse HttpServer::serveStaticFile(const HttpRequest& request, std::string_view path) {
+    // Only files loaded into the cache are reachable, so "../" cannot escape web/
+    std::shared_ptr<const StaticAsset> asset = m_assetCache->find(path);
+    if (!asset) {
+        return createErrorResponse(404, "File not found");
+    }
+    
+    StaticAsset::Encoding encoding = StaticAssetCache::chooseEncoding(*asset, request.header("Accept-Encoding"));
+    // Fingerprinted URLs embed the content hash, so they can be cached forever
+    StaticAsset::Variant variant = path == asset->path ? StaticAsset::REVALIDATE : StaticAsset::IMMUTABLE;
+    
+    if (StaticAssetCache::isNotModified(*asset, request.header("If-None-Match"),
+                                        request.header("If-Modified-Since"))) {
+        return HttpResponse(asset->notModifiedHeads[variant][encoding]);
+    }
+    
+    HttpResponse response(asset->heads[variant][encoding]);
+    if (asset->fd >= 0) {
+        response.sendFile = true;
+    } else {
+        response.body = asset->bodies[encoding];
+    }
+    response.asset = std::move(asset);
+    return response;
 }
 
-std::string HttpServer::createApiResponse(const std::string& data) {
+std::string HttpServer::createApiResponse(const std::string& data, int code) {
     std::ostringstream response;
-    response << "HTTP/1.1 200 OK\r\n";
+    response << "HTTP/1.1 " << code << " " << getStatusText(code) << "\r\n";
     response << "Content-Type: application/json\r\n";
     response << "Content-Length: " << data.length() << "\r\n";
     response << "Access-Control-Allow-Origin: *\r\n";
-    response << "Connection: close\r\n";
     response << "\r\n";
     response << data;
     return response.str();
 }
 
+std::string HttpServer::getStatusText(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Internal Server Error";
+    }
+}
+
 std::string HttpServer::createErrorResponse(int code, const std::string& message) {
+    std::string body = "{\"error\": \"" + jsonEscape(message) + "\"}";
+    
     std::ostringstream response;
-    response << "HTTP/1.1 " << code << " " << (code == 404 ? "Not Found" : "Internal Server Error") << "\r\n";
+    response << "HTTP/1.1 " << code << " " << getStatusText(code) << "\r\n";
     response << "Content-Type: application/json\r\n";
+    response << "Content-Length: " << body.length() << "\r\n";
     response << "Access-Control-Allow-Origin: *\r\n";
-    response << "Connection: close\r\n";
     response << "\r\n";
-    response << "{\"error\": \"" << message << "\"}";
+    response << body;
     return response.str();
 }
 
+void HttpServer::writeStreamJson(std::ostream& json, const StreamInfo& stream) {
+    json << "{\"id\": " << stream.streamId
+         << ", \"active\": " << (stream.state == StreamState::Playing ? "true" : "false")
+         << ", \"state\": \"" << streamStateName(stream.state) << "\""
+         << ", \"port\": " << stream.port
+         << ", \"width\": " << stream.profile.width
+         << ", \"height\": " << stream.profile.height
+         << ", \"framerate\": " << stream.profile.framerate
+         << ", \"bitrate\": " << stream.profile.bitrate
+         << ", \"encoderPreset\": \"" << stream.profile.encoderPreset << "\""
+         << ", \"keyIntMax\": " << stream.profile.keyIntMax
+         << ", \"cpus\": \"" << formatCpuList(stream.cpus) << "\""
+         << ", \"cpuCost\": " << stream.cost
+         << ", \"downgraded\": " << (stream.downgraded ? "true" : "false")
+         << ", \"startupMs\": " << stream.startupMs
+         << ", \"mjpegViewers\": " << (stream.mjpeg ? stream.mjpeg->subscriberCount() : 0)
+         << ", \"mseViewers\": " << (stream.mse ? stream.mse->subscriberCount() : 0);
+    // Null when the stream's RTP is not monitored; read straight from the
+    // monitor's atomics
+    if (const PortActivity* rtp = stream.rtp.get()) {
+        json << ", \"rtpActive\": " << (rtp->isActive() ? "true" : "false")
+             << ", \"rtp\": {\"packets\": " << rtp->packets()
+             << ", \"bytes\": " << rtp->bytes()
+             << ", \"lost\": " << rtp->lost()
+             << ", \"reordered\": " << rtp->reordered()
+             << ", \"jitterMs\": " << rtp->jitterMs()
+             << ", \"packetsPerSecond\": " << rtp->packetsPerSecond()
+             << ", \"bitrateKbps\": " << rtp->bytesPerSecond() * 8 / 1000
+             << ", \"keyframes\": " << rtp->keyframes()
+             << ", \"keyframeIntervalMs\": " << rtp->keyframeIntervalMs() << "}";
+    } else {
+        json << ", \"rtpActive\": null, \"rtp\": null";
+    }
+    json << ", \"renditions\": ";
+    writeRenditionsJson(json, stream.profile);
+    json << "}";
+}
+
+void HttpServer::writeRenditionsJson(std::ostream& json, const StreamProfile& profile) {
+    json << "[";
+    bool first = true;
+    for (const Rendition& rendition : profile.renditions()) {
+        if (!first) json << ",";
+        json << "{\"name\": \"" << rendition.name << "\""
+             << ", \"width\": " << rendition.width
+             << ", \"height\": " << rendition.height
+             << ", \"bitrate\": " << rendition.bitrate
+             << ", \"port\": " << rendition.port
+             << ", \"url\": \"rtp://" << profile.sinkHost << ":" << rendition.port << "\"}";
+        first = false;
+    }
+    json << "]";
+}
+
 std::string HttpServer::handleApiStreams() {
-    auto streams = m_streamManager->getStreamStatus();
+    // Served from the published snapshot; never waits on a starting/stopping stream
+    std::shared_ptr<const StreamSnapshot> snapshot = m_streamManager->getSnapshot();
     std::ostringstream json;
-    json << "{\"streams\": [";
+    json << std::fixed << std::setprecision(1);
+    json << "{\"version\": " << snapshot->version
+         << ", \"startsTotal\": " << snapshot->startsTotal
+         << ", \"failedStartsTotal\": " << snapshot->failedStartsTotal
+         << ", \"stopsTotal\": " << snapshot->stopsTotal
+         << ", \"rejectedTotal\": " << snapshot->rejectedTotal
+         << ", \"encodeBudget\": " << snapshot->encodeBudget
+         << ", \"encodeLoad\": " << snapshot->encodeLoad
+         << ", \"streams\": [";
     
     bool first = true;
-    for (const auto& stream : streams) {
+    for (const StreamInfo& stream : snapshot->streams) {
         if (!first) json << ",";
-        json << "{\"id\": " << stream.first 
-             << ", \"active\": " << (stream.second ? "true" : "false") << "}";
+        writeStreamJson(json, stream);
         first = false;
     }
     
@@ -260,19 +1238,24 @@ std::string HttpServer::handleApiStreams() {
     return createApiResponse(json.str());
 }
 
-std::string HttpServer::handleApiStreamStart(const std::string& streamId) {
-    int id = std::stoi(streamId);
-    bool success = m_streamManager->startStream(id, 1920, 1080, 30);
+std::string HttpServer::handleApiStreamStart(int id) {
+    StreamStartResult result = m_streamManager->startStream(id);
     
     std::ostringstream json;
-    json << "{\"success\": " << (success ? "true" : "false") 
-         << ", \"streamId\": " << id << "}";
+    json << "{\"success\": " << (result.success ? "true" : "false") 
+         << ", \"streamId\": " << id
+         << ", \"admission\": \"" << admissionName(result.admission) << "\"";
+    if (result.admission != Admission::Rejected) {
+        json << ", \"width\": " << result.profile.width
+             << ", \"height\": " << result.profile.height
+             << ", \"bitrate\": " << result.profile.bitrate;
+    }
+    json << "}";
     
     return createApiResponse(json.str());
 }
 
-std::string HttpServer::handleApiStreamStop(const std::string& streamId) {
-    int id = std::stoi(streamId);
+std::string HttpServer::handleApiStreamStop(int id) {
     bool success = m_streamManager->stopStream(id);
     
     std::ostringstream json;
@@ -282,31 +1265,239 @@ std::string HttpServer::handleApiStreamStop(const std::string& streamId) {
     return createApiResponse(json.str());
 }
 
-std::string HttpServer::handleApiStreamStatus(const std::string& streamId) {
-    int id = std::stoi(streamId);
-    bool active = m_streamManager->isStreamActive(id);
+std::string HttpServer::handleApiStreamStatus(int id) {
+    std::shared_ptr<const StreamSnapshot> snapshot = m_streamManager->getSnapshot();
+    const StreamInfo* stream = snapshot->find(id);
     
     std::ostringstream json;
-    json << "{\"streamId\": " << id 
-         << ", \"active\": " << (active ? "true" : "false") << "}";
+    json << std::fixed << std::setprecision(1);
+    json << "{\"streamId\": " << id;
+    if (stream) {
+        json << ", \"active\": " << (stream->state == StreamState::Playing ? "true" : "false")
+             << ", \"stream\": ";
+        writeStreamJson(json, *stream);
+    } else {
+        json << ", \"active\": false";
+    }
+    json << "}";
     
     return createApiResponse(json.str());
 }
 
-std::string HttpServer::handleVideoStream(const std::string& streamId) {
-    int id = std::stoi(streamId);
+std::string HttpServer::handleApiStreamViewers(int id) {
+    std::shared_ptr<FrameFanout> fanout = m_streamManager->getMjpegFanout(id);
+    if (!fanout) {
+        return createErrorResponse(404, "Stream not found or inactive");
+    }
+    std::shared_ptr<FrameFanout> mse = m_streamManager->getMseFanout(id);
     
-    // Check if stream is active
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(1);
+    auto writeViewers = [&json](const std::vector<ViewerStats>& viewers) {
+        json << "[";
+        bool first = true;
+        for (const ViewerStats& viewer : viewers) {
+            if (!first) json << ",";
+            json << "{\"id\": " << viewer.id
+                 << ", \"peer\": \"" << viewer.peer << "\""
+                 << ", \"connectedSeconds\": " << viewer.connectedSeconds
+                 << ", \"framesDelivered\": " << viewer.framesDelivered
+                 << ", \"framesDropped\": " << viewer.framesDropped
+                 << ", \"deliveredFps\": " << viewer.deliveredFps
+                 << ", \"droppedFps\": " << viewer.droppedFps << "}";
+            first = false;
+        }
+        json << "]";
+    };
+    json << "{\"streamId\": " << id << ", \"viewers\": ";
+    writeViewers(fanout->viewerStats());
+    json << ", \"mseViewers\": ";
+    writeViewers(mse ? mse->viewerStats() : std::vector<ViewerStats>());
+    json << "}";
+    return createApiResponse(json.str());
+}
+
+std::string HttpServer::handleApiStreamEncoder(int id, std::string_view body) {
+    std::map<std::string, std::string> fields;
+    if (!parseFlatJson(body, fields)) {
+        return createErrorResponse(400, "Expected a JSON object");
+    }
+    
+    // Same limits as config/vms.conf
+    EncoderUpdate update;
+    for (const auto& field : fields) {
+        int value = 0;
+        if (field.first == "bitrate") {
+            if (!parseIntField(field.second, 16, 100000, value)) {
+                return createErrorResponse(400, "Invalid bitrate");
+            }
+            update.bitrate = value;
+        } else if (field.first == "keyIntMax") {
+            if (!parseIntField(field.second, 1, 1000, value)) {
+                return createErrorResponse(400, "Invalid keyIntMax");
+            }
+            update.keyIntMax = value;
+        } else if (field.first == "encoderPreset") {
+            if (!isEncoderPreset(field.second)) {
+                return createErrorResponse(400, "Invalid encoderPreset");
+            }
+            update.encoderPreset = field.second;
+        } else if (field.first == "forceKeyframe") {
+            if (field.second != "true" && field.second != "false") {
+                return createErrorResponse(400, "Invalid forceKeyframe");
+            }
+            update.forceKeyframe = field.second == "true";
+        } else {
+            return createErrorResponse(400, "Unknown field " + field.first);
+        }
+    }
+    
+    if (!m_streamManager->isStreamActive(id)) {
+        return createErrorResponse(404, "Stream not found or inactive");
+    }
+    std::string error;
+    GStreamerPipeline::EncoderChange change = m_streamManager->updateEncoder(id, update, error);
+    if (change == GStreamerPipeline::EncoderChange::Busy || change == GStreamerPipeline::EncoderChange::Failed) {
+        return createErrorResponse(409, error);
+    }
+    
+    // A GOP or preset change completes on the streaming threads; the stream
+    // shown is what runs now, and the new profile follows in the snapshot
+    bool pending = change == GStreamerPipeline::EncoderChange::Pending;
+    std::shared_ptr<const StreamSnapshot> snapshot = m_streamManager->getSnapshot();
+    const StreamInfo* stream = snapshot->find(id);
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(1);
+    json << "{\"success\": true, \"pending\": " << (pending ? "true" : "false") << ", \"stream\": ";
+    if (stream) {
+        writeStreamJson(json, *stream);
+    } else {
+        json << "null";
+    }
+    json << "}";
+    return createApiResponse(json.str(), pending ? 202 : 200);
+}
+
+std::string HttpServer::handleApiStreamRenditions(int id) {
+    std::shared_ptr<const StreamSnapshot> snapshot = m_streamManager->getSnapshot();
+    const StreamInfo* stream = snapshot->find(id);
+    if (!stream) {
+        return createErrorResponse(404, "Stream not found");
+    }
+    
+    // Viewers pick a rung by port; each is a complete H.264 RTP stream
+    std::ostringstream json;
+    json << "{\"streamId\": " << id
+         << ", \"state\": \"" << streamStateName(stream->state) << "\""
+         << ", \"renditions\": ";
+    writeRenditionsJson(json, stream->profile);
+    json << "}";
+    return createApiResponse(json.str());
+}
+
+std::string HttpServer::handleApiStreamDestinations(int id) {
+    std::shared_ptr<const StreamSnapshot> snapshot = m_streamManager->getSnapshot();
+    const StreamInfo* stream = snapshot->find(id);
+    if (!stream || stream->state != StreamState::Playing) {
+        return createErrorResponse(404, "Stream not found or inactive");
+    }
+    
+    std::vector<Rendition> ladder = stream->profile.renditions();
+    std::ostringstream json;
+    json << "{\"streamId\": " << id << ", \"renditions\": [";
+    for (size_t i = 0; i < ladder.size(); ++i) {
+        if (i > 0) json << ",";
+        json << "{\"name\": \"" << ladder[i].name << "\", \"destinations\": [";
+        if (i < stream->destinations.size()) {
+            bool first = true;
+            for (const RtpDestination& destination : stream->destinations[i]) {
+                if (!first) json << ",";
+                json << "{\"host\": \"" << jsonEscape(destination.host) << "\", \"port\": " << destination.port << "}";
+                first = false;
+            }
+        }
+        json << "]}";
+    }
+    json << "]}";
+    return createApiResponse(json.str());
+}
+
+std::string HttpServer::handleApiStreamDestinationEdit(int id, std::string_view body, bool add) {
+    std::map<std::string, std::string> fields;
+    if (!parseFlatJson(body, fields)) {
+        return createErrorResponse(400, "Expected a JSON object");
+    }
+    RtpDestination destination;
+    std::string renditionName;
+    for (const auto& field : fields) {
+        if (field.first == "host") {
+            destination.host = field.second;
+        } else if (field.first == "port") {
+            if (!parseIntField(field.second, 1, 65535, destination.port)) {
+                return createErrorResponse(400, "Invalid port");
+            }
+        } else if (field.first == "rendition") {
+            renditionName = field.second;
+        } else {
+            return createErrorResponse(400, "Unknown field " + field.first);
+        }
+    }
+    if (destination.host.empty() || destination.port == 0) {
+        return createErrorResponse(400, "host and port are required");
+    }
+    if (!isNumericHost(destination.host)) {
+        return createErrorResponse(400, "host must be an IP address");
+    }
+    
+    std::shared_ptr<const StreamSnapshot> snapshot = m_streamManager->getSnapshot();
+    const StreamInfo* stream = snapshot->find(id);
+    if (!stream || stream->state != StreamState::Playing) {
+        return createErrorResponse(404, "Stream not found or inactive");
+    }
+    // Full size unless a rendition is named
+    size_t rendition = 0;
+    if (!renditionName.empty()) {
+        std::vector<Rendition> ladder = stream->profile.renditions();
+        auto it = std::find_if(ladder.begin(), ladder.end(),
+                               [&](const Rendition& entry) { return entry.name == renditionName; });
+        if (it == ladder.end()) {
+            return createErrorResponse(400, "Unknown rendition " + renditionName);
+        }
+        rendition = static_cast<size_t>(it - ladder.begin());
+    }
+    
+    std::string error;
+    bool changed = add ? m_streamManager->addDestination(id, rendition, destination, error)
+                       : m_streamManager->removeDestination(id, rendition, destination, error);
+    if (!changed) {
+        return createErrorResponse(409, error);
+    }
+    return handleApiStreamDestinations(id);
+}
+
+std::string HttpServer::handleApiStreamKeyframe(int id) {
     if (!m_streamManager->isStreamActive(id)) {
         return createErrorResponse(404, "Stream not found or inactive");
     }
+    bool success = m_streamManager->forceKeyframe(id);
     
-    // Create an HTML page with WebRTC or HLS streaming capability
+    std::ostringstream json;
+    json << "{\"success\": " << (success ? "true" : "false")
+         << ", \"streamId\": " << id << "}";
+    return createApiResponse(json.str());
+}
+
+std::string HttpServer::handleVideoStream(int id) {
+    
+    // Check if stream is active
+    std::shared_ptr<const StreamSnapshot> snapshot = m_streamManager->getSnapshot();
+    const StreamInfo* stream = snapshot->find(id);
+    if (!stream || stream->state != StreamState::Playing) {
+        return createErrorResponse(404, "Stream not found or inactive");
+    }
+    
+    // Player page: LL-HLS, or fMP4 over a WebSocket into MSE
     std::ostringstream response;
-    response << "HTTP/1.1 200 OK\r\n";
-    response << "Content-Type: text/html\r\n";
-    response << "Connection: close\r\n";
-    response << "\r\n";
     response << "<!DOCTYPE html>\n";
     response << "<html><head>\n";
     response << "<title>Stream " << (id + 1) << "</title>\n";
@@ -328,167 +1519,303 @@ std::string HttpServer::handleVideoStream(const std::string& streamId) {
     response << "<div class='container'>\n";
     response << "<div class='header'>\n";
     response << "<h1>Stream " << (id + 1) << " - Live View</h1>\n";
-    response << "<p>UDP Port: " << (8081 + id) << " | Resolution: 1920x1080 @ 30fps | Codec: H.264</p>\n";
+    response << "<p>UDP Port: " << stream->port << " | Resolution: " << stream->profile.width << "x"
+             << stream->profile.height << " @ " << stream->profile.framerate << "fps | Codec: H.264</p>\n";
+    std::vector<Rendition> ladder = stream->profile.renditions();
+    if (ladder.size() > 1) {
+        response << "<p>Renditions:";
+        for (const Rendition& rendition : ladder) {
+            response << " " << rendition.name << " (UDP " << rendition.port << ", " << rendition.bitrate << " kbit/s)";
+        }
+        response << "</p>\n";
+    }
     response << "</div>\n";
     response << "<div class='video-container'>\n";
-    response << "<canvas id='videoCanvas' class='video-player' width='640' height='360'></canvas>\n";
-    response << "<div id='status' class='status'>Stream " << (id + 1) << " - GStreamer Test Pattern</div>\n";
+    response << "<video id='video' class='video-player' muted autoplay playsinline controls></video>\n";
+    response << "<div id='status' class='status'>Stream " << (id + 1) << "</div>\n";
     response << "</div>\n";
     response << "<div class='controls'>\n";
     response << "<button class='btn' onclick='refreshStream()'>Refresh Stream</button>\n";
+    if (stream->hls) {
+        response << "<button class='btn' id='modeButton' onclick='toggleMode()'>Switch to WebSocket</button>\n";
+    }
     response << "<button class='btn' onclick='toggleFullscreen()'>Fullscreen</button>\n";
     response << "<button class='btn' onclick='window.close()'>Close</button>\n";
     response << "<a href='/' class='btn' style='text-decoration:none;'>Back to Dashboard</a>\n";
     response << "</div>\n";
     response << "</div>\n";
+    if (stream->hls) {
+        // Safari plays LL-HLS natively; elsewhere hls.js feeds MSE. It is
+        // served from web/vendor, so the page works without internet access.
+        std::shared_ptr<const StaticAsset> hlsJs = m_assetCache->find(HLS_JS_PATH);
+        if (hlsJs) {
+            response << "<script src='" << hlsJs->fingerprintPath << "'></script>\n";
+        }
+    }
     response << "<script>\n";
-    response << "const canvas = document.getElementById('videoCanvas');\n";
-    response << "const ctx = canvas.getContext('2d');\n";
+    response << "const video = document.getElementById('video');\n";
     response << "const status = document.getElementById('status');\n";
-    response << "const streamId = " << id << ";\n";
-    response << "let animationId;\n";
-    response << "let time = 0;\n";
+    response << "const hlsSource = '/stream/" << id << "/hls/index.m3u8';\n";
+    response << "const wsSource = (location.protocol === 'https:' ? 'wss://' : 'ws://') + location.host + '/ws/stream/" << id << "';\n";
+    response << "let mode = " << (stream->hls ? "'hls'" : "'ws'") << ";\n";
+    response << "let hls = null;\n";
+    response << "let socket = null;\n";
     response << "\n";
     response << "function updateStatus(message, type = 'info') {\n";
     response << "    status.textContent = message;\n";
     response << "    status.className = 'status ' + type;\n";
     response << "}\n";
     response << "\n";
-    response << "function drawTestPattern() {\n";
-    response << "    const width = canvas.width;\n";
-    response << "    const height = canvas.height;\n";
-    response << "    \n";
-    response << "    // Clear canvas\n";
-    response << "    ctx.fillStyle = '#000';\n";
-    response << "    ctx.fillRect(0, 0, width, height);\n";
-    response << "    \n";
-    response << "    // Draw SMPTE color bars (pattern 2 from videotestsrc)\n";
-    response << "    const barWidth = width / 7;\n";
-    response << "    const colors = ['#C0C0C0', '#C0C000', '#00C0C0', '#00C000', '#C000C0', '#C00000', '#0000C0'];\n";
-    response << "    \n";
-    response << "    for (let i = 0; i < 7; i++) {\n";
-    response << "        ctx.fillStyle = colors[i];\n";
-    response << "        ctx.fillRect(i * barWidth, 0, barWidth, height * 0.6);\n";
+    response << "function startHls() {\n";
+    response << "    if (video.canPlayType('application/vnd.apple.mpegurl')) {\n";
+    response << "        video.src = hlsSource;\n";
+    response << "    } else if (window.Hls && Hls.isSupported()) {\n";
+    response << "        hls = new Hls({ lowLatencyMode: true, backBufferLength: 10 });\n";
+    response << "        hls.on(Hls.Events.ERROR, (event, data) => {\n";
+    response << "            if (data.fatal) updateStatus('Playback error: ' + data.details, 'error');\n";
+    response << "        });\n";
+    response << "        hls.loadSource(hlsSource);\n";
+    response << "        hls.attachMedia(video);\n";
+    response << "    } else {\n";
+    response << "        return false;\n";
+    response << "    }\n";
+    response << "    updateStatus('Stream " << (id + 1) << " - LL-HLS', 'success');\n";
+    response << "    return true;\n";
+    response << "}\n";
+    response << "\n";
+    response << "// One fMP4 fragment per frame over a WebSocket, appended to MSE as it arrives\n";
+    response << "function startWebSocket() {\n";
+    response << "    if (!window.MediaSource) return false;\n";
+    response << "    const mediaSource = new MediaSource();\n";
+    response << "    video.src = URL.createObjectURL(mediaSource);\n";
+    response << "    mediaSource.addEventListener('sourceopen', () => {\n";
+    response << "        let buffer = null;\n";
+    response << "        let mimeType = null;\n";
+    response << "        const queue = [];\n";
+    response << "        const appendNext = () => {\n";
+    response << "            if (!buffer || buffer.updating) return;\n";
+    response << "            const ranges = buffer.buffered;\n";
+    response << "            if (ranges.length && video.currentTime - ranges.start(0) > 10) {\n";
+    response << "                buffer.remove(0, video.currentTime - 5);\n";
+    response << "                return;\n";
+    response << "            }\n";
+    response << "            if (queue.length) buffer.appendBuffer(queue.shift());\n";
+    response << "            // Stay at the live edge\n";
+    response << "            if (ranges.length && ranges.end(ranges.length - 1) - video.currentTime > 1) {\n";
+    response << "                video.currentTime = ranges.end(ranges.length - 1) - 0.1;\n";
+    response << "            }\n";
+    response << "        };\n";
+    response << "        socket = new WebSocket(wsSource);\n";
+    response << "        socket.binaryType = 'arraybuffer';\n";
+    response << "        socket.onmessage = (event) => {\n";
+    response << "            if (typeof event.data === 'string') {\n";
+    response << "                const message = JSON.parse(event.data);\n";
+    response << "                if (message.type !== 'init' || message.mimeType === mimeType) return;\n";
+    response << "                if (!buffer) {\n";
+    response << "                    buffer = mediaSource.addSourceBuffer(message.mimeType);\n";
+    response << "                    buffer.addEventListener('updateend', appendNext);\n";
+    response << "                } else if (buffer.changeType) {\n";
+    response << "                    buffer.changeType(message.mimeType);\n";
+    response << "                }\n";
+    response << "                mimeType = message.mimeType;\n";
+    response << "                return;\n";
+    response << "            }\n";
+    response << "            queue.push(event.data);\n";
+    response << "            appendNext();\n";
+    response << "        };\n";
+    response << "        socket.onclose = () => updateStatus('WebSocket stream ended', 'error');\n";
+    response << "    }, { once: true });\n";
+    response << "    updateStatus('Stream " << (id + 1) << " - WebSocket (MSE)', 'success');\n";
+    response << "    return true;\n";
+    response << "}\n";
+    response << "\n";
+    response << "function setMode(next) {\n";
+    response << "    mode = next;\n";
+    response << "    const button = document.getElementById('modeButton');\n";
+    response << "    if (button) button.textContent = mode === 'hls' ? 'Switch to WebSocket' : 'Switch to LL-HLS';\n";
+    response << "}\n";
+    response << "\n";
+    response << "function startPlayback() {\n";
+    response << "    let started = mode === 'hls' ? startHls() : startWebSocket();\n";
+    response << "    // No native HLS and no hls.js: the WebSocket path only needs MSE\n";
+    response << "    if (!started && mode === 'hls') {\n";
+    response << "        setMode('ws');\n";
+    response << "        started = startWebSocket();\n";
+    response << "    }\n";
+    response << "    if (!started) {\n";
+    response << "        updateStatus('This browser cannot play the stream', 'error');\n";
+    response << "        return;\n";
     response << "    }\n";
-    response << "    \n";
-    response << "    // Draw moving elements\n";
-    response << "    const centerX = width / 2;\n";
-    response << "    const centerY = height / 2;\n";
-    response << "    \n";
-    response << "    // Moving circle\n";
-    response << "    const circleX = centerX + Math.sin(time * 0.02) * 100;\n";
-    response << "    const circleY = centerY + Math.cos(time * 0.02) * 50;\n";
-    response << "    ctx.fillStyle = '#FF0000';\n";
-    response << "    ctx.beginPath();\n";
-    response << "    ctx.arc(circleX, circleY, 20, 0, Math.PI * 2);\n";
-    response << "    ctx.fill();\n";
-    response << "    \n";
-    response << "    // Moving rectangle\n";
-    response << "    const rectX = centerX + Math.cos(time * 0.015) * 80;\n";
-    response << "    const rectY = centerY + Math.sin(time * 0.015) * 40;\n";
-    response << "    ctx.fillStyle = '#00FF00';\n";
-    response << "    ctx.fillRect(rectX - 15, rectY - 15, 30, 30);\n";
-    response << "    \n";
-    response << "    // Moving triangle\n";
-    response << "    const triX = centerX + Math.sin(time * 0.025) * 60;\n";
-    response << "    const triY = centerY + Math.cos(time * 0.025) * 30;\n";
-    response << "    ctx.fillStyle = '#0000FF';\n";
-    response << "    ctx.beginPath();\n";
-    response << "    ctx.moveTo(triX, triY - 15);\n";
-    response << "    ctx.lineTo(triX - 15, triY + 15);\n";
-    response << "    ctx.lineTo(triX + 15, triY + 15);\n";
-    response << "    ctx.closePath();\n";
-    response << "    ctx.fill();\n";
-    response << "    \n";
-    response << "    // Draw text overlay\n";
-    response << "    ctx.fillStyle = '#FFFFFF';\n";
-    response << "    ctx.font = '16px Arial';\n";
-    response << "    ctx.textAlign = 'center';\n";
-    response << "    ctx.fillText('GStreamer Test Pattern - Stream ' + (streamId + 1), centerX, height - 20);\n";
-    response << "    ctx.fillText('Time: ' + Math.floor(time / 60) + 's', centerX, height - 40);\n";
-    response << "    \n";
-    response << "    time++;\n";
+    response << "    video.play().catch(() => {});\n";
     response << "}\n";
     response << "\n";
-    response << "function animate() {\n";
-    response << "    drawTestPattern();\n";
-    response << "    animationId = requestAnimationFrame(animate);\n";
+    response << "function stopPlayback() {\n";
+    response << "    if (hls) {\n";
+    response << "        hls.destroy();\n";
+    response << "        hls = null;\n";
+    response << "    }\n";
+    response << "    if (socket) {\n";
+    response << "        socket.onclose = null;\n";
+    response << "        socket.close();\n";
+    response << "        socket = null;\n";
+    response << "    }\n";
+    response << "    video.removeAttribute('src');\n";
+    response << "    video.load();\n";
     response << "}\n";
     response << "\n";
     response << "function refreshStream() {\n";
     response << "    updateStatus('Refreshing stream...', 'info');\n";
-    response << "    if (animationId) {\n";
-    response << "        cancelAnimationFrame(animationId);\n";
-    response << "    }\n";
-    response << "    time = 0;\n";
-    response << "    animate();\n";
-    response << "    updateStatus('Stream " << (id + 1) << " - GStreamer Test Pattern (Simulated)', 'success');\n";
+    response << "    stopPlayback();\n";
+    response << "    startPlayback();\n";
+    response << "}\n";
+    response << "\n";
+    response << "function toggleMode() {\n";
+    response << "    setMode(mode === 'hls' ? 'ws' : 'hls');\n";
+    response << "    refreshStream();\n";
     response << "}\n";
     response << "\n";
     response << "function toggleFullscreen() {\n";
-    response << "    if (canvas.requestFullscreen) {\n";
-    response << "        canvas.requestFullscreen();\n";
-    response << "    } else if (canvas.webkitRequestFullscreen) {\n";
-    response << "        canvas.webkitRequestFullscreen();\n";
-    response << "    } else if (canvas.msRequestFullscreen) {\n";
-    response << "        canvas.msRequestFullscreen();\n";
+    response << "    if (video.requestFullscreen) {\n";
+    response << "        video.requestFullscreen();\n";
+    response << "    } else if (video.webkitRequestFullscreen) {\n";
+    response << "        video.webkitRequestFullscreen();\n";
     response << "    }\n";
     response << "}\n";
     response << "\n";
-    response << "// Start the animation\n";
     response << "updateStatus('Starting stream...', 'info');\n";
-    response << "setTimeout(() => {\n";
-    response << "    refreshStream();\n";
-    response << "}, 500);\n";
+    response << "startPlayback();\n";
     response << "\n";
-    response << "// Cleanup on page unload\n";
-    response << "window.addEventListener('beforeunload', () => {\n";
-    response << "    if (animationId) {\n";
-    response << "        cancelAnimationFrame(animationId);\n";
-    response << "    }\n";
-    response << "});\n";
+    response << "window.addEventListener('beforeunload', stopPlayback);\n";
     response << "</script>\n";
     response << "</body></html>\n";
     
-    return response.str();
+    std::string page = response.str();
+    std::ostringstream header;
+    header << "HTTP/1.1 200 OK\r\n";
+    header << "Content-Type: text/html\r\n";
+    header << "Content-Length: " << page.length() << "\r\n";
+    header << "\r\n";
+    
+    return header.str() + page;
 }
 
-std::string HttpServer::handleMJPEGStream(const std::string& streamId) {
-    int id = std::stoi(streamId);
-    
-    // Check if stream is active
-    if (!m_streamManager->isStreamActive(id)) {
+HttpResponse HttpServer::handleMJPEGStream(int id) {
+    std::shared_ptr<FrameFanout> fanout = m_streamManager->getMjpegFanout(id);
+    if (!fanout) {
         return createErrorResponse(404, "Stream not found or inactive");
     }
     
-    // For now, return a simple test pattern as MJPEG
-    // In a real implementation, this would connect to the GStreamer pipeline
-    // and convert the H.264 stream to MJPEG for web viewing
+    // Only the head is sent here; each JPEG part is encoded once by the
+    // stream's pipeline and relayed to every viewer by its worker
+    std::ostringstream header;
+    header << "HTTP/1.1 200 OK\r\n";
+    header << "Content-Type: multipart/x-mixed-replace; boundary=" << MJPEG_BOUNDARY << "\r\n";
+    header << "Cache-Control: no-cache\r\n";
+    header << "\r\n";
     
-    std::ostringstream response;
-    response << "HTTP/1.1 200 OK\r\n";
-    response << "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n";
-    response << "Cache-Control: no-cache\r\n";
-    response << "Connection: close\r\n";
-    response << "\r\n";
+    HttpResponse response(header.str());
+    response.stream = std::move(fanout);
+    return response;
+}
+
+HttpResponse HttpServer::handleWebSocketStream(const HttpRequest& request, int id) {
+    std::shared_ptr<FrameFanout> fanout = m_streamManager->getMseFanout(id);
+    if (!fanout) {
+        return createErrorResponse(404, "Stream not found or inactive");
+    }
     
-    // Generate a simple test pattern as MJPEG frames
-    // This is a placeholder - in production you'd use GStreamer to convert H.264 to MJPEG
-    for (int frame = 0; frame < 10; frame++) {
-        response << "--myboundary\r\n";
-        response << "Content-Type: image/jpeg\r\n";
-        response << "Content-Length: 0\r\n";
-        response << "\r\n";
-        response << "\r\n";
-        
-        // In a real implementation, you would:
-        // 1. Capture a frame from the GStreamer pipeline
-        // 2. Convert it to JPEG format
-        // 3. Send the JPEG data here
-        
-        // For now, we'll just send a minimal response
-        // The browser will show "broken image" but the connection will be established
+    // After the handshake the connection is relayed exactly like an MJPEG
+    // viewer: each message is framed once by the pipeline and shared
+    HttpResponse response(m_webSocketHandler->handleWebSocketUpgrade(request));
+    if (response.data.compare(0, 12, "HTTP/1.1 101") == 0) {
+        response.stream = std::move(fanout);
+        response.webSocket = true;
     }
+    return response;
+}
+
+HttpResponse HttpServer::handleHls(const RouteMatch& route, std::string_view query, bool mayBlock) {
+    std::shared_ptr<HlsPackager> hls = m_streamManager->getHlsPackager(route.intParam(0));
+    if (!hls) {
+        return createErrorResponse(404, "Stream not found, inactive or without HLS");
+    }
+    std::shared_ptr<const HlsWindow> window = hls->window();
     
-    return response.str();
+    auto block = [&]() {
+        HttpResponse response;
+        response.blockOn = std::move(hls);
+        response.blockedWindow = window;
+        return response;
+    };
+    auto media = [](const char* contentType, std::shared_ptr<const std::string> body, bool noCache) {
+        std::ostringstream header;
+        header << "HTTP/1.1 200 OK\r\n";
+        header << "Content-Type: " << contentType << "\r\n";
+        header << "Content-Length: " << body->size() << "\r\n";
+        if (noCache) {
+            header << "Cache-Control: no-cache\r\n";
+        }
+        header << "Access-Control-Allow-Origin: *\r\n";
+        header << "\r\n";
+        HttpResponse response(header.str());
+        response.payload = std::move(body);
+        return response;
+    };
+    
+    switch (route.id) {
+        case RouteId::HlsPlaylist: {
+            int64_t sequence = 0;
+            if (queryInt(query, "_HLS_msn", sequence)) {
+                int64_t part = -1;
+                if (query.find("_HLS_part=") != std::string_view::npos && !queryInt(query, "_HLS_part", part)) {
+                    return createErrorResponse(400, "Bad _HLS_part");
+                }
+                // Blocking for more than two segments ahead is a client error
+                if (static_cast<uint64_t>(sequence) > window->nextSequence() + 2) {
+                    return createErrorResponse(400, "_HLS_msn is too far ahead");
+                }
+                if (!window->ended && !window->has(sequence, static_cast<int>(std::min<int64_t>(part, INT_MAX))) &&
+                    mayBlock) {
+                    return block();
+                }
+            }
+            if (!window->playlist) {
+                // Nothing packaged yet; the first part is at most a GOP away
+                return mayBlock ? block() : createErrorResponse(503, "No media yet");
+            }
+            return media("application/vnd.apple.mpegurl", window->playlist, true);
+        }
+        case RouteId::HlsInit:
+            for (const HlsSegment& segment : window->segments) {
+                if (segment.initVersion == static_cast<uint32_t>(route.intParam(1))) {
+                    return media("video/mp4", segment.init, false);
+                }
+            }
+            return createErrorResponse(404, "Init segment not found");
+        case RouteId::HlsSegment: {
+            const HlsSegment* segment = window->find(route.intParam(1));
+            if (!segment || !segment->complete()) {
+                return createErrorResponse(404, "Segment not found");
+            }
+            return media("video/mp4", segment->data, false);
+        }
+        case RouteId::HlsPart: {
+            uint64_t sequence = route.intParam(1);
+            int part = route.intParam(2);
+            if (!window->has(sequence, part)) {
+                // The preload hint names the next part before it exists
+                if (!window->ended && sequence <= window->nextSequence() + 1) {
+                    return mayBlock ? block() : createErrorResponse(503, "Part not ready");
+                }
+                return createErrorResponse(404, "Part not found");
+            }
+            const HlsSegment* segment = window->find(sequence);
+            if (!segment || static_cast<size_t>(part) >= segment->parts.size()) {
+                return createErrorResponse(404, "Part not found");
+            }
+            return media("video/mp4", segment->parts[part].data, false);
+        }
+        default:
+            return createErrorResponse(404, "Not found");
+    }
 }
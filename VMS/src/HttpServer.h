@@ -1,46 +1,257 @@
 #pragma once
 
 #include <string>
+#include <iosfwd>
 #include <memory>
 #include <thread>
 #include <atomic>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <deque>
 #include <functional>
+#include <chrono>
+#include <mutex>
+#include "HttpRequestParser.h"
+#include "FrameFanout.h"
+#include "WebSocketHandler.h"
+#include "WebSocketFrameParser.h"
 
 class StreamManager;
-class WebSocketHandler;
+class StaticAssetCache;
+class HlsPackager;
+struct HlsWindow;
+struct StaticAsset;
+struct StreamInfo;
+struct StreamProfile;
+struct RouteMatch;
+
+// A response ready for the wire. Dynamic handlers put the whole message in
+// `data`; cached assets put only the head there and lend their body.
+struct HttpResponse {
+    std::string data;
+    std::shared_ptr<const StaticAsset> asset;   // keeps a lent body or fd alive
+    std::string_view body;                      // in-memory body owned by `asset`
+    bool sendFile{false};                       // stream asset->fd with sendfile()
+    std::shared_ptr<FrameFanout> stream;        // keep the connection open and relay these frames
+    std::shared_ptr<const std::string> payload; // shared body sent after `data`, e.g. an HLS part
+    bool webSocket{false};                      // 101: WebSocket frames follow in both directions
+    // Blocking HLS reload: nothing is sent; the request is answered again
+    // once the packager publishes something newer than blockedWindow
+    std::shared_ptr<HlsPackager> blockOn;
+    std::shared_ptr<const HlsWindow> blockedWindow;
+
+    HttpResponse() = default;
+    HttpResponse(std::string response) : data(std::move(response)) {}
+};
 
 class HttpServer {
 public:
-    HttpServer(const std::string& host, int port, StreamManager* streamManager);
+    static constexpr int DEFAULT_WORKER_THREADS = 4;
+    static constexpr int KEEP_ALIVE_TIMEOUT_SECONDS = 15;
+    // Idle WebSockets are pinged this often and dropped after two silent intervals
+    static constexpr int WEBSOCKET_PING_INTERVAL_SECONDS = 15;
+    static constexpr int MAX_REQUESTS_PER_CONNECTION = 100;
+
+    HttpServer(const std::string& host, int port, StreamManager* streamManager,
+               int workerThreads = DEFAULT_WORKER_THREADS);
     ~HttpServer();
     
+    // Cache-Control values for web assets at plain and fingerprinted URLs;
+    // call before start()
+    void setCacheControl(const std::string& revalidate, const std::string& immutable);
+    
     void start();
     void stop();
     
 private:
+    struct Worker;
+
+    // One queued piece of output: owned bytes, bytes lent by a shared object
+    // (cached asset or broadcast frame), or a file range sent with sendfile()
+    struct OutboundChunk {
+        std::string owned;
+        std::shared_ptr<const void> holder;     // keeps borrowed bytes or fileFd alive
+        std::string_view borrowed;
+        int fileFd{-1};
+        size_t fileLength{0};
+        size_t offset{0};       // bytes of this chunk already written
+
+        const char* bytes() const { return holder ? borrowed.data() : owned.data(); }
+        size_t size() const { return fileFd >= 0 ? fileLength : (holder ? borrowed.size() : owned.size()); }
+    };
+
+    // A connection subscribed to a live stream. Frames arrive on a GStreamer
+    // thread into a single latest-frame-wins slot: a frame still waiting there
+    // when the next one arrives is counted as dropped. For streams of
+    // dependent frames (fMP4) the slot only skips ahead to an independent one. The owning worker is
+    // woken and writes the slot's frame whenever the previous one has drained,
+    // so a slow client costs at most two frames of memory and never stalls
+    // the fan-out.
+    class StreamViewer : public FrameFanout::Subscriber {
+    public:
+        StreamViewer(Worker& worker, int fd, uint64_t id, std::string peer,
+                     std::shared_ptr<FrameFanout> fanout);
+        void onFrame(const std::shared_ptr<const EncodedFrame>& frame) override;
+        ViewerStats stats() const override;
+        // Worker side: newest pending frame (may be null); ended once the stream is over
+        std::shared_ptr<const EncodedFrame> takeFrame(bool& ended);
+        void countDelivered() { m_delivered.fetch_add(1, std::memory_order_relaxed); }
+        // Worker side, about once a second: refresh the per-second rates
+        void sampleRates(std::chrono::steady_clock::time_point now);
+        // Stop touching the worker; called before the connection goes away
+        void detach();
+
+        const std::shared_ptr<FrameFanout> fanout;
+
+    private:
+        Worker& m_worker;
+        int m_fd;
+        uint64_t m_id;
+        std::string m_peer;
+        std::chrono::steady_clock::time_point m_connectedAt;
+
+        std::mutex m_mutex;
+        std::shared_ptr<const EncodedFrame> m_pending;
+        bool m_scheduled{false};    // fd already on the worker's ready list
+        bool m_ended{false};
+        bool m_detached{false};
+        bool m_needIndependent{true};   // start, or resume after a skip, at an independent frame
+
+        std::atomic<uint64_t> m_delivered{0};
+        std::atomic<uint64_t> m_dropped{0};
+        std::atomic<double> m_deliveredFps{0};
+        std::atomic<double> m_droppedFps{0};
+        std::chrono::steady_clock::time_point m_lastSample;
+        uint64_t m_lastDelivered{0};
+        uint64_t m_lastDropped{0};
+    };
+
+    // A dashboard WebSocket session. Frames pushed from any thread queue up
+    // here by reference and the owning worker is woken to move them to the
+    // socket, several per sendmsg.
+    class WebSocketSession : public WebSocketHandler::Peer {
+    public:
+        WebSocketSession(Worker& worker, int fd, uint64_t id);
+        void send(std::shared_ptr<const std::string> frame) override;
+        // Worker side: everything queued so far
+        std::vector<std::shared_ptr<const std::string>> takeFrames();
+        // Stop touching the worker; called before the connection goes away
+        void detach();
+
+        const uint64_t id;
+
+    private:
+        Worker& m_worker;
+        int m_fd;
+        std::mutex m_mutex;
+        std::vector<std::shared_ptr<const std::string>> m_pending;
+        bool m_scheduled{false};
+        bool m_detached{false};
+    };
+
+    // Per-socket state, owned by exactly one worker for its whole lifetime
+    struct Connection {
+        int fd;
+        std::string in;
+        HttpRequestParser parser;
+        std::deque<OutboundChunk> out;
+        size_t ownedOutBytes{0};    // buffered bytes we own, excluding lent bodies
+        bool closeAfterWrite{false};
+        int requestsServed{0};
+        std::chrono::steady_clock::time_point lastActivity;
+        std::shared_ptr<StreamViewer> viewer;   // set while relaying a live stream
+        // Set while an HLS request waits for the next part; the request
+        // stays unparsed in `in` until then
+        std::shared_ptr<HlsPackager> blockedOn;
+        uint64_t waiterId{0};
+        std::chrono::steady_clock::time_point blockDeadline;
+        bool blockExpired{false};   // answer with what there is instead of waiting again
+        // Set once upgraded: `in` then holds WebSocket frames, not requests
+        std::unique_ptr<WebSocketFrameParser> frameParser;
+        std::shared_ptr<WebSocketSession> webSocket;    // dashboard sessions only
+        std::chrono::steady_clock::time_point lastReceived;     // last frame from the client
+        std::chrono::steady_clock::time_point lastPing;
+        bool closeSent{false};
+    };
+
+    // Each worker is an independent edge-triggered epoll reactor; the
+    // listening socket is shared between them with EPOLLEXCLUSIVE so a new
+    // connection wakes a single worker, which then owns it until close.
+    struct Worker {
+        int index;
+        int epollFd{-1};
+        int wakeFd{-1};
+        std::thread thread;
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+        std::chrono::steady_clock::time_point lastSweep;
+
+        // Viewers with a frame to send, posted from other threads before wakeFd is signalled
+        std::mutex readyMutex;
+        std::vector<int> readyViewers;
+        std::vector<int> readyRequests;     // blocked HLS requests whose part has arrived
+        std::vector<int> readySessions;     // WebSocket sessions with frames queued
+    };
+
     std::string m_host;
     int m_port;
     StreamManager* m_streamManager;
     std::unique_ptr<WebSocketHandler> m_webSocketHandler;
+    std::unique_ptr<StaticAssetCache> m_assetCache;
     std::atomic<bool> m_running;
     std::thread m_serverThread;
     int m_serverSocket{-1};
+    int m_workerCount;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<uint64_t> m_nextViewerId{1};
     
     void serverLoop();
-    std::string handleRequest(const std::string& request);
-    std::string serveStaticFile(const std::string& path);
-    std::string getMimeType(const std::string& path);
-    std::string createApiResponse(const std::string& data);
+    void workerLoop(Worker& worker);
+    void acceptConnections(Worker& worker);
+    void handleReadable(Worker& worker, Connection& conn);
+    void processRequests(Worker& worker, Connection& conn);
+    void queueResponse(Connection& conn, HttpResponse&& response);
+    bool flushConnection(Connection& conn);
+    void consumeOutput(Connection& conn, size_t bytes);
+    void closeConnection(Worker& worker, int fd);
+    void drainReadyViewers(Worker& worker);
+    void drainReadyRequests(Worker& worker);
+    void drainReadySessions(Worker& worker);
+    // Frames from an upgraded connection: commands, ping/pong and close
+    void processWebSocketFrames(Connection& conn);
+    void queueWebSocketClose(Connection& conn, uint16_t code);
+    void pingWebSockets(Worker& worker);
+    void blockRequest(Worker& worker, Connection& conn, HttpResponse& response);
+    void resumeRequest(Worker& worker, Connection& conn);
+    void pumpViewer(Worker& worker, Connection& conn);
+    void closeIdleConnections(Worker& worker);
+    void sampleViewerRates(Worker& worker);
+    bool finalizeResponse(HttpResponse& response, bool keepAlive);
+    HttpResponse handleRequest(const HttpRequest& request, bool mayBlock = true);
+    HttpResponse serveStaticFile(const HttpRequest& request, std::string_view path);
+    std::string createApiResponse(const std::string& data, int code = 200);
+    std::string getStatusText(int code);
     std::string createErrorResponse(int code, const std::string& message);
     
     // API endpoints
+    static void writeStreamJson(std::ostream& json, const StreamInfo& stream);
+    static void writeRenditionsJson(std::ostream& json, const StreamProfile& profile);
     std::string handleApiStreams();
-    std::string handleApiStreamStart(const std::string& streamId);
-    std::string handleApiStreamStop(const std::string& streamId);
-    std::string handleApiStreamStatus(const std::string& streamId);
+    std::string handleApiStreamStart(int streamId);
+    std::string handleApiStreamStop(int streamId);
+    std::string handleApiStreamStatus(int streamId);
+    std::string handleApiStreamViewers(int streamId);
+    std::string handleApiStreamRenditions(int streamId);
+    std::string handleApiStreamDestinations(int streamId);
+    std::string handleApiStreamDestinationEdit(int streamId, std::string_view body, bool add);
+    std::string handleApiStreamEncoder(int streamId, std::string_view body);
+    std::string handleApiStreamKeyframe(int streamId);
     
     // Video stream endpoints
-    std::string handleVideoStream(const std::string& streamId);
-    std::string handleMJPEGStream(const std::string& streamId);
+    std::string handleVideoStream(int streamId);
+    HttpResponse handleMJPEGStream(int streamId);
+    // Upgrades to a WebSocket carrying per-frame fMP4 for MSE playback
+    HttpResponse handleWebSocketStream(const HttpRequest& request, int streamId);
+    // LL-HLS playlist, init segment, segments and parts, all from memory
+    HttpResponse handleHls(const RouteMatch& route, std::string_view query, bool mayBlock);
 };
@@ -0,0 +1,61 @@
+#include "MseStreamer.h"
+#include "WebSocketHandler.h"
+#include <algorithm>
+
+MseStreamer::MseStreamer(int framerate)
+    : m_fanout(std::make_shared<FrameFanout>()),
+      m_defaultDuration(Fmp4Muxer::TIMESCALE / std::max(1, framerate)) {
+}
+
+void MseStreamer::setFormat(int width, int height, const std::string& avcC) {
+    if (avcC.empty()) {
+        return;
+    }
+    if (m_muxer && avcC == m_muxer->avcC() && width == m_width && height == m_height) {
+        m_pendingAvcC.clear();
+        return;
+    }
+    m_pendingAvcC = avcC;
+    m_pendingWidth = width;
+    m_pendingHeight = height;
+}
+
+void MseStreamer::pushSample(const uint8_t* data, size_t size, int64_t decodeTimeNs, int64_t presentationTimeNs,
+                             int64_t durationNs, bool keyframe) {
+    if (!m_pendingAvcC.empty() && keyframe) {
+        // Subscribers switch over at this keyframe, which carries the new init
+        m_muxer = std::make_unique<Fmp4Muxer>(m_pendingWidth, m_pendingHeight, m_pendingAvcC);
+        m_width = m_pendingWidth;
+        m_height = m_pendingHeight;
+        m_pendingAvcC.clear();
+        
+        m_header.clear();
+        std::string type = "{\"type\":\"init\",\"mimeType\":\"video/mp4; codecs=\\\"" + m_muxer->codecString() + "\\\"\"}";
+        WebSocketHandler::appendFrame(m_header, WebSocketOpcode::Text, type);
+        WebSocketHandler::appendFrame(m_header, WebSocketOpcode::Binary, m_muxer->initSegment());
+    }
+    // Frames of a new format are undecodable before its keyframe
+    if (!m_muxer || !m_pendingAvcC.empty() || m_fanout->subscriberCount() == 0) {
+        return;
+    }
+    
+    std::vector<Fmp4Sample> samples(1);
+    Fmp4Sample& sample = samples.front();
+    sample.data.assign(reinterpret_cast<const char*>(data), size);
+    sample.decodeTime = Fmp4Muxer::toTicks(decodeTimeNs);
+    sample.compositionOffset = static_cast<int32_t>(Fmp4Muxer::toTicks(presentationTimeNs) - sample.decodeTime);
+    sample.duration = durationNs > 0 ? static_cast<uint32_t>(Fmp4Muxer::toTicks(durationNs)) : m_defaultDuration;
+    sample.keyframe = keyframe;
+    std::string fragment = m_muxer->fragment(samples);
+    
+    // Framed once here; every subscriber's socket is written from this buffer
+    auto frame = std::make_shared<EncodedFrame>();
+    frame->data.reserve((keyframe ? m_header.size() : 0) + fragment.size() + 10);
+    if (keyframe) {
+        frame->data.append(m_header);
+    }
+    WebSocketHandler::appendFrame(frame->data, WebSocketOpcode::Binary, fragment);
+    frame->sequence = m_fanout->nextSequence();
+    frame->independent = keyframe;
+    m_fanout->publish(std::move(frame));
+}
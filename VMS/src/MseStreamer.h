@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "FrameFanout.h"
+#include "Fmp4Muxer.h"
+
+// Fragmented MP4 for Media Source Extensions over /ws/stream/{id}. Each
+// access unit becomes one moof + mdat, framed as a binary WebSocket message
+// once and shared by every subscriber through a FrameFanout. Keyframes are
+// preceded by a text message naming the MSE type and by the init segment,
+// so a viewer can join, or resync after falling behind, at any keyframe.
+class MseStreamer {
+public:
+    explicit MseStreamer(int framerate);
+
+    // Streaming thread, as for HlsPackager: the codec configuration, then
+    // access units in decode order with times in nanoseconds (duration 0 if
+    // unknown). Nothing is muxed while there are no subscribers.
+    void setFormat(int width, int height, const std::string& avcC);
+    void pushSample(const uint8_t* data, size_t size, int64_t decodeTimeNs, int64_t presentationTimeNs,
+                    int64_t durationNs, bool keyframe);
+    // The stream is over; ends every subscriber
+    void close() { m_fanout->close(); }
+
+    std::shared_ptr<FrameFanout> fanout() const { return m_fanout; }
+
+private:
+    std::shared_ptr<FrameFanout> m_fanout;
+    uint32_t m_defaultDuration;                 // ticks of one frame at the profile's rate
+    std::unique_ptr<Fmp4Muxer> m_muxer;
+    int m_width{0};
+    int m_height{0};
+    std::string m_pendingAvcC;                  // set while a new format waits for a keyframe
+    int m_pendingWidth{0};
+    int m_pendingHeight{0};
+    std::string m_header;                       // type message + init segment, framed
+};
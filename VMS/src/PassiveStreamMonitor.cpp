@@ -1,77 +1,375 @@
-#include "PassiveStreamMonitor.h"
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <unistd.h>
-#include <cstring>
-#include <iostream>
-
-PassiveStreamMonitor::PassiveStreamMonitor(int streamId, int port)
-    : m_streamId(streamId), m_port(port), m_socketFd(-1), 
-      m_lastActivity(std::chrono::steady_clock::now()) {
-}
-
-PassiveStreamMonitor::~PassiveStreamMonitor() {
-    stop();
-}
-
-bool PassiveStreamMonitor::start() {
-    if (m_running.load()) return true;
-
-    m_socketFd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (m_socketFd < 0) {
-        std::cerr << "Monitor: failed to create UDP socket for stream " << m_streamId << std::endl;
-        return false;
-    }
-
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(m_port);
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-
-    int reuse = 1;
-    setsockopt(m_socketFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-
-    if (bind(m_socketFd, (sockaddr*)&addr, sizeof(addr)) < 0) {
-        std::cerr << "Monitor: failed to bind UDP port " << m_port << " for stream " << m_streamId << std::endl;
-        close(m_socketFd);
-        m_socketFd = -1;
-        return false;
-    }
-
-    m_running = true;
-    m_thread = std::thread(&PassiveStreamMonitor::receiveLoop, this);
-    return true;
-}
-
-void PassiveStreamMonitor::stop() {
-    if (!m_running.exchange(false)) return;
-    if (m_socketFd >= 0) {
-        close(m_socketFd);
-        m_socketFd = -1;
-    }
-    if (m_thread.joinable()) m_thread.join();
-}
-
-bool PassiveStreamMonitor::isActive() const {
-    auto last = m_lastActivity.load();
-    auto now = std::chrono::steady_clock::now();
-    return (now - last) < std::chrono::seconds(2);
-}
-
-void PassiveStreamMonitor::receiveLoop() {
-    constexpr size_t BUF_SIZE = 1500;
-    char buffer[BUF_SIZE];
-    while (m_running.load()) {
-        ssize_t n = recv(m_socketFd, buffer, sizeof(buffer), 0);
-        if (n > 0) {
-            m_lastActivity.store(std::chrono::steady_clock::now());
-        } else if (n < 0) {
-            if (!m_running.load()) break;
-            // avoid busy loop
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        }
-    }
-}
-
-
+#include "PassiveStreamMonitor.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+namespace {
+constexpr int MAX_EPOLL_EVENTS = 64;
+// Datagrams per recvmmsg(); RTP packets stay below the MTU
+constexpr unsigned RECV_BATCH = 32;
+constexpr size_t RECV_BUFFER_SIZE = 2048;
+constexpr auto ACTIVE_WINDOW = std::chrono::seconds(2);
+constexpr int64_t RATE_BUCKET_NS = 100000000;
+// RFC 3550 A.1: a jump further ahead than this, or further back than
+// MAX_MISORDER, means the sender restarted its sequence
+constexpr uint16_t MAX_DROPOUT = 3000;
+constexpr uint16_t MAX_MISORDER = 100;
+constexpr size_t RTP_HEADER_SIZE = 12;
+constexpr int RTP_CLOCK_RATE = 90000;           // every video payload format
+
+// H.264 NAL unit types (RFC 6184)
+constexpr uint8_t NAL_IDR = 5;
+constexpr uint8_t NAL_STAP_A = 24;
+constexpr uint8_t NAL_FU_A = 28;
+
+struct TimestampControl {
+    alignas(cmsghdr) char data[CMSG_SPACE(sizeof(timespec))];
+};
+
+int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t realtimeNowNs() {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Kernel receive time from SO_TIMESTAMPNS, or now if it is missing
+int64_t arrivalNs(msghdr& header) {
+    for (cmsghdr* control = CMSG_FIRSTHDR(&header); control; control = CMSG_NXTHDR(&header, control)) {
+        if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec stamp;
+            std::memcpy(&stamp, CMSG_DATA(control), sizeof(stamp));
+            return stamp.tv_sec * 1000000000LL + stamp.tv_nsec;
+        }
+    }
+    return realtimeNowNs();
+}
+
+// Whether an H.264 RTP payload starts or carries an IDR slice: a single NAL
+// unit, each unit of a STAP-A aggregate, or the first fragment of a FU-A
+bool carriesIdr(const uint8_t* payload, size_t size) {
+    if (size < 1) return false;
+    uint8_t type = payload[0] & 0x1f;
+    if (type == NAL_FU_A) {
+        return size >= 2 && (payload[1] & 0x80) != 0 && (payload[1] & 0x1f) == NAL_IDR;
+    }
+    if (type == NAL_STAP_A) {
+        size_t offset = 1;
+        while (offset + 2 < size) {
+            size_t length = (payload[offset] << 8) | payload[offset + 1];
+            offset += 2;
+            if (length == 0 || offset + length > size) break;
+            if ((payload[offset] & 0x1f) == NAL_IDR) return true;
+            offset += length;
+        }
+        return false;
+    }
+    return type == NAL_IDR;
+}
+}
+
+bool PortActivity::isActive() const {
+    int64_t last = m_lastPacketNs.load(std::memory_order_relaxed);
+    return last != 0 && steadyNowNs() - last < std::chrono::nanoseconds(ACTIVE_WINDOW).count();
+}
+
+double PortActivity::packetsPerSecond() const {
+    return windowTotal(false) * 1e9 / (RATE_BUCKET_NS * (RATE_BUCKETS - 1));
+}
+
+double PortActivity::bytesPerSecond() const {
+    return windowTotal(true) * 1e9 / (RATE_BUCKET_NS * (RATE_BUCKETS - 1));
+}
+
+void PortActivity::countRate(int64_t nowNs, uint64_t packets, uint64_t bytes) {
+    int64_t slot = nowNs / RATE_BUCKET_NS;
+    RateBucket& bucket = m_rates[slot % RATE_BUCKETS];
+    if (bucket.slot.load(std::memory_order_relaxed) != slot) {
+        // Reset before claiming, so a reader sees old counts under the old
+        // slot (outside the window) rather than under the new one
+        bucket.packets.store(0, std::memory_order_relaxed);
+        bucket.bytes.store(0, std::memory_order_relaxed);
+        bucket.slot.store(slot, std::memory_order_release);
+    }
+    bucket.packets.fetch_add(packets, std::memory_order_relaxed);
+    bucket.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+uint64_t PortActivity::windowTotal(bool bytes) const {
+    int64_t current = steadyNowNs() / RATE_BUCKET_NS;
+    uint64_t total = 0;
+    for (const RateBucket& bucket : m_rates) {
+        int64_t slot = bucket.slot.load(std::memory_order_acquire);
+        if (slot < current && slot >= current - (RATE_BUCKETS - 1)) {
+            total += bytes ? bucket.bytes.load(std::memory_order_relaxed)
+                           : bucket.packets.load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+PassiveStreamMonitor::PassiveStreamMonitor() : m_epollFd(-1), m_wakeFd(-1) {
+}
+
+PassiveStreamMonitor::~PassiveStreamMonitor() {
+    stop();
+}
+
+bool PassiveStreamMonitor::start() {
+    if (m_running.load()) return true;
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd < 0 || m_wakeFd < 0) {
+        std::cerr << "Monitor: failed to create epoll set: " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;          // the wake eventfd
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+
+    m_running = true;
+    m_thread = std::thread(&PassiveStreamMonitor::receiveLoop, this);
+    return true;
+}
+
+void PassiveStreamMonitor::stop() {
+    if (m_running.exchange(false)) {
+        uint64_t one = 1;
+        ssize_t written = write(m_wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+    if (m_thread.joinable()) m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_watchMutex);
+    for (auto& entry : m_watches) {
+        close(entry.second->socketFd);
+    }
+    m_watches.clear();
+    if (m_wakeFd >= 0) {
+        close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+    if (m_epollFd >= 0) {
+        close(m_epollFd);
+        m_epollFd = -1;
+    }
+}
+
+std::shared_ptr<const PortActivity> PassiveStreamMonitor::addPort(int port) {
+    std::lock_guard<std::mutex> lock(m_watchMutex);
+    if (m_epollFd < 0) {
+        return nullptr;
+    }
+    auto existing = m_watches.find(port);
+    if (existing != m_watches.end()) {
+        return existing->second->activity;
+    }
+
+    int socketFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socketFd < 0) {
+        std::cerr << "Monitor: failed to create UDP socket for port " << port << std::endl;
+        return nullptr;
+    }
+    // A player bound later with SO_REUSEADDR takes the packets over
+    int reuse = 1;
+    setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // Arrival times for jitter, unaffected by how late a batch is drained
+    int timestamps = 1;
+    setsockopt(socketFd, SOL_SOCKET, SO_TIMESTAMPNS, &timestamps, sizeof(timestamps));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(socketFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::cerr << "Monitor: failed to bind UDP port " << port << ": " << std::strerror(errno) << std::endl;
+        close(socketFd);
+        return nullptr;
+    }
+
+    auto watch = std::make_unique<Watch>();
+    watch->socketFd = socketFd;
+    watch->activity = std::make_shared<PortActivity>(port);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = watch.get();
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, socketFd, &ev) < 0) {
+        close(socketFd);
+        return nullptr;
+    }
+    std::shared_ptr<const PortActivity> activity = watch->activity;
+    m_watches[port] = std::move(watch);
+    return activity;
+}
+
+void PassiveStreamMonitor::removePort(int port) {
+    std::lock_guard<std::mutex> lock(m_watchMutex);
+    auto it = m_watches.find(port);
+    if (it == m_watches.end()) {
+        return;
+    }
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, it->second->socketFd, nullptr);
+    close(it->second->socketFd);
+    m_watches.erase(it);
+}
+
+void PassiveStreamMonitor::receiveLoop() {
+    epoll_event events[MAX_EPOLL_EVENTS];
+    while (m_running.load()) {
+        int count = epoll_wait(m_epollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Monitor: epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        std::lock_guard<std::mutex> lock(m_watchMutex);
+        for (int i = 0; i < count; ++i) {
+            Watch* watch = static_cast<Watch*>(events[i].data.ptr);
+            if (!watch) {
+                uint64_t value;
+                ssize_t drained = read(m_wakeFd, &value, sizeof(value));
+                (void)drained;
+                continue;
+            }
+            // A port removed between epoll_wait() and taking the lock leaves
+            // a stale pointer, so only trust watches still in the table
+            auto it = m_watches.end();
+            for (auto entry = m_watches.begin(); entry != m_watches.end(); ++entry) {
+                if (entry->second.get() == watch) {
+                    it = entry;
+                    break;
+                }
+            }
+            if (it != m_watches.end()) {
+                drain(*watch);
+            }
+        }
+    }
+}
+
+void PassiveStreamMonitor::drain(Watch& watch) {
+    // Parsed in place and never kept: one shared set of buffers is enough
+    static thread_local std::vector<uint8_t> buffers(RECV_BATCH * RECV_BUFFER_SIZE);
+    static thread_local TimestampControl controls[RECV_BATCH];
+    mmsghdr messages[RECV_BATCH];
+    iovec iovecs[RECV_BATCH];
+
+    // Level-triggered, but emptying the socket now saves epoll round trips
+    while (true) {
+        for (unsigned i = 0; i < RECV_BATCH; ++i) {
+            iovecs[i].iov_base = &buffers[i * RECV_BUFFER_SIZE];
+            iovecs[i].iov_len = RECV_BUFFER_SIZE;
+            messages[i] = mmsghdr{};
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = controls[i].data;
+            messages[i].msg_hdr.msg_controllen = sizeof(controls[i].data);
+        }
+        int received = recvmmsg(watch.socketFd, messages, RECV_BATCH, MSG_DONTWAIT, nullptr);
+        if (received <= 0) {
+            break;
+        }
+        uint64_t bytes = 0;
+        for (int i = 0; i < received; ++i) {
+            bytes += messages[i].msg_len;
+            analyze(watch, &buffers[i * RECV_BUFFER_SIZE], messages[i].msg_len, arrivalNs(messages[i].msg_hdr));
+        }
+        PortActivity& activity = *watch.activity;
+        int64_t now = steadyNowNs();
+        activity.m_packets.fetch_add(received, std::memory_order_relaxed);
+        activity.m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        activity.countRate(now, received, bytes);
+        activity.m_lastPacketNs.store(now, std::memory_order_relaxed);
+        if (received < static_cast<int>(RECV_BATCH)) {
+            break;
+        }
+    }
+}
+
+void PassiveStreamMonitor::analyze(Watch& watch, const uint8_t* data, size_t size, int64_t arrivalNs) {
+    if (size < RTP_HEADER_SIZE || (data[0] >> 6) != 2) {
+        return;                                         // not RTP version 2
+    }
+    uint16_t seq = static_cast<uint16_t>((data[2] << 8) | data[3]);
+    uint32_t timestamp = (static_cast<uint32_t>(data[4]) << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+    uint32_t ssrc = (static_cast<uint32_t>(data[8]) << 24) | (data[9] << 16) | (data[10] << 8) | data[11];
+    RtpTracker& rtp = watch.rtp;
+    PortActivity& activity = *watch.activity;
+
+    // Sequence accounting as in RFC 3550 A.1, resyncing on a new SSRC or a
+    // jump that only a restarted sender explains
+    uint16_t delta = static_cast<uint16_t>(seq - rtp.maxSeq);
+    bool resync = !rtp.synced || ssrc != rtp.ssrc ||
+                  (delta >= MAX_DROPOUT && delta <= 65535 - MAX_MISORDER);
+    if (resync) {
+        uint64_t expected = rtp.cycles + rtp.maxSeq - rtp.baseSeq + 1;
+        if (rtp.synced && expected > rtp.received) {
+            rtp.lostBefore += expected - rtp.received;
+        }
+        rtp.synced = true;
+        rtp.ssrc = ssrc;
+        rtp.baseSeq = seq;
+        rtp.maxSeq = seq;
+        rtp.cycles = 0;
+        rtp.received = 0;
+        rtp.haveTransit = false;
+        rtp.haveKeyframe = false;
+    } else if (delta > 0 && delta < MAX_DROPOUT) {
+        if (seq < rtp.maxSeq) {
+            rtp.cycles += 65536;
+        }
+        rtp.maxSeq = seq;
+    } else if (delta != 0) {
+        activity.m_reordered.fetch_add(1, std::memory_order_relaxed);
+    }
+    ++rtp.received;
+    uint64_t expected = rtp.cycles + rtp.maxSeq - rtp.baseSeq + 1;
+    uint64_t lost = expected > rtp.received ? expected - rtp.received : 0;
+    activity.m_lost.store(rtp.lostBefore + lost, std::memory_order_relaxed);
+
+    // Interarrival jitter, in RTP timestamp units until published
+    uint32_t arrival = static_cast<uint32_t>(arrivalNs / 1000 * (RTP_CLOCK_RATE / 1000) / 1000);
+    uint32_t transit = arrival - timestamp;
+    if (rtp.haveTransit) {
+        int32_t difference = static_cast<int32_t>(transit - rtp.lastTransit);
+        rtp.jitter += (std::abs(static_cast<double>(difference)) - rtp.jitter) / 16.0;
+        activity.m_jitterMs.store(rtp.jitter * 1000.0 / RTP_CLOCK_RATE, std::memory_order_relaxed);
+    }
+    rtp.lastTransit = transit;
+    rtp.haveTransit = true;
+
+    // Keyframe spacing, once per IDR access unit
+    size_t offset = RTP_HEADER_SIZE + 4 * (data[0] & 0x0f);
+    if ((data[0] & 0x10) && offset + 4 <= size) {
+        offset += 4 + 4 * ((data[offset + 2] << 8) | data[offset + 3]);
+    }
+    if (offset >= size || !carriesIdr(data + offset, size - offset)) {
+        return;
+    }
+    if (rtp.haveKeyframe && timestamp == rtp.keyframeTimestamp) {
+        return;
+    }
+    if (rtp.haveKeyframe) {
+        activity.m_keyframeIntervalMs.store((arrivalNs - rtp.keyframeArrivalNs) / 1e6, std::memory_order_relaxed);
+    }
+    activity.m_keyframes.fetch_add(1, std::memory_order_relaxed);
+    rtp.haveKeyframe = true;
+    rtp.keyframeTimestamp = timestamp;
+    rtp.keyframeArrivalNs = arrivalNs;
+}
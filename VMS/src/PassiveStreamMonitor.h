@@ -1,30 +1,121 @@
-#pragma once
-
-#include <thread>
-#include <atomic>
-#include <chrono>
-
-class PassiveStreamMonitor {
-public:
-    PassiveStreamMonitor(int streamId, int port);
-    ~PassiveStreamMonitor();
-
-    bool start();
-    void stop();
-
-    // Active if we have received packets within the last 2 seconds
-    bool isActive() const;
-    int port() const { return m_port; }
-
-private:
-    void receiveLoop();
-
-    int m_streamId;
-    int m_port;
-    int m_socketFd;
-    std::thread m_thread;
-    std::atomic<bool> m_running{false};
-    std::atomic<std::chrono::steady_clock::time_point> m_lastActivity;
-};
-
-
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+// Live receive statistics for one monitored stream port, from the RTP
+// headers and H.264 payload headers of what arrives. The monitor thread is
+// the only writer; readers (HTTP workers) load the atomics without locking.
+class PortActivity {
+public:
+    explicit PortActivity(int port) : m_port(port) {}
+
+    // Active if packets arrived within the last 2 seconds
+    bool isActive() const;
+    int port() const { return m_port; }
+    uint64_t packets() const { return m_packets.load(std::memory_order_relaxed); }
+    uint64_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+    // Sequence numbers never seen (RFC 3550 cumulative loss); a late packet
+    // fills its gap again
+    uint64_t lost() const { return m_lost.load(std::memory_order_relaxed); }
+    // Packets that arrived after a higher sequence number
+    uint64_t reordered() const { return m_reordered.load(std::memory_order_relaxed); }
+    // RFC 3550 interarrival jitter
+    double jitterMs() const { return m_jitterMs.load(std::memory_order_relaxed); }
+    uint64_t keyframes() const { return m_keyframes.load(std::memory_order_relaxed); }
+    // Between the last two IDR frames; 0 until two have arrived
+    double keyframeIntervalMs() const { return m_keyframeIntervalMs.load(std::memory_order_relaxed); }
+    // Over the last complete second; 0 once packets stop
+    double packetsPerSecond() const;
+    double bytesPerSecond() const;
+
+private:
+    friend class PassiveStreamMonitor;
+
+    // One slice of the sliding rate window, reused once it falls out of it
+    struct RateBucket {
+        std::atomic<int64_t> slot{-1};
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+    static constexpr int RATE_BUCKETS = 11;         // 100 ms each; the one filling is not counted
+
+    int m_port;
+    std::atomic<int64_t> m_lastPacketNs{0};         // steady_clock, 0 before the first packet
+    std::atomic<uint64_t> m_packets{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::atomic<uint64_t> m_lost{0};
+    std::atomic<uint64_t> m_reordered{0};
+    std::atomic<double> m_jitterMs{0};
+    std::atomic<uint64_t> m_keyframes{0};
+    std::atomic<double> m_keyframeIntervalMs{0};
+    RateBucket m_rates[RATE_BUCKETS];
+
+    void countRate(int64_t nowNs, uint64_t packets, uint64_t bytes);
+    // Sum of the complete buckets in the window
+    uint64_t windowTotal(bool bytes) const;
+};
+
+// Confirms streams are really leaving the process by receiving what they
+// send to local UDP ports, and measures their health: loss, jitter,
+// reordering, rates and keyframe spacing. Every port is one socket in a
+// single epoll set, drained with recvmmsg() by one thread, so watching 64
+// ports costs one thread and no polling.
+class PassiveStreamMonitor {
+public:
+    PassiveStreamMonitor();
+    ~PassiveStreamMonitor();
+
+    bool start();
+    void stop();
+
+    // Bind and watch a port; returns its counters, or null if it cannot be
+    // bound. Watching a port twice returns the same counters.
+    std::shared_ptr<const PortActivity> addPort(int port);
+    // After this returns the port's socket is closed; its counters stay
+    // valid for whoever still holds them
+    void removePort(int port);
+
+private:
+    // Receive-side RTP state for one port; only the monitor thread uses it
+    struct RtpTracker {
+        bool synced{false};
+        uint32_t ssrc{0};
+        uint16_t maxSeq{0};
+        uint32_t cycles{0};             // sequence number wraps times 65536
+        uint32_t baseSeq{0};
+        uint64_t received{0};           // since the last resync
+        uint64_t lostBefore{0};         // carried over resyncs
+        bool haveTransit{false};
+        uint32_t lastTransit{0};        // 90 kHz units, wraps with the RTP timestamp
+        double jitter{0};               // 90 kHz units
+        bool haveKeyframe{false};
+        uint32_t keyframeTimestamp{0};  // RTP timestamp of the last IDR frame
+        int64_t keyframeArrivalNs{0};
+    };
+
+    struct Watch {
+        int socketFd;
+        std::shared_ptr<PortActivity> activity;
+        RtpTracker rtp;
+    };
+
+    void receiveLoop();
+    void drain(Watch& watch);
+    // One datagram; arrivalNs is the kernel receive time
+    static void analyze(Watch& watch, const uint8_t* data, size_t size, int64_t arrivalNs);
+
+    int m_epollFd;
+    int m_wakeFd;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    // Held by the monitor thread while it handles a batch of events, so a
+    // removed watch is never touched after removePort() returns
+    std::mutex m_watchMutex;
+    std::map<int, std::unique_ptr<Watch>> m_watches;    // by port
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <string_view>
+#include <cstddef>
+#include <climits>
+
+// Compile-time route table for the HTTP server.
+//
+// Patterns are '/'-separated segments; a segment is either a literal or a
+// placeholder: "{int}" matches a non-negative decimal that fits in an int,
+// "{word}" matches [A-Za-z0-9_]+. Routes are tried in declaration order and
+// matching walks the path once per candidate without allocating; placeholder
+// values come back as typed parameters.
+
+enum class RouteId {
+    None,
+    ApiStreams,
+    ApiStreamStart,
+    ApiStreamStop,
+    ApiStreamStatus,
+    ApiStreamViewers,
+    ApiStreamEncoder,
+    ApiStreamKeyframe,
+    ApiStreamRenditions,
+    ApiStreamDestinations,
+    ApiStreamDestinationAdd,
+    ApiStreamDestinationRemove,
+    StreamMjpeg,
+    HlsPlaylist,
+    HlsInit,
+    HlsSegment,
+    HlsPart,
+    WsStream,
+    StreamPage
+};
+
+struct Route {
+    std::string_view method;   // empty matches any method
+    std::string_view pattern;
+    RouteId id;
+};
+
+struct RouteParam {
+    std::string_view text;
+    int value;                 // parsed value for {int}, 0 for {word}
+};
+
+struct RouteMatch {
+    static constexpr size_t MAX_PARAMS = 4;
+
+    RouteId id{RouteId::None};
+    RouteParam params[MAX_PARAMS]{};
+    size_t paramCount{0};
+
+    constexpr explicit operator bool() const { return id != RouteId::None; }
+    constexpr int intParam(size_t index) const { return params[index].value; }
+    constexpr std::string_view textParam(size_t index) const { return params[index].text; }
+};
+
+namespace routing {
+
+constexpr std::string_view INT_PLACEHOLDER = "{int}";
+constexpr std::string_view WORD_PLACEHOLDER = "{word}";
+
+// Split off the next segment after a leading '/'; returns false at the end
+constexpr bool nextSegment(std::string_view& rest, std::string_view& segment) {
+    if (rest.empty() || rest.front() != '/') return false;
+    rest.remove_prefix(1);
+    size_t slash = rest.find('/');
+    segment = rest.substr(0, slash);
+    rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash);
+    return true;
+}
+
+constexpr bool parseInt(std::string_view text, int& value) {
+    if (text.empty() || text.size() > 10) return false;
+    long long result = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        result = result * 10 + (c - '0');
+    }
+    if (result > INT_MAX) return false;
+    value = static_cast<int>(result);
+    return true;
+}
+
+constexpr bool isWord(std::string_view text) {
+    if (text.empty()) return false;
+    for (char c : text) {
+        bool word = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                    (c >= '0' && c <= '9') || c == '_';
+        if (!word) return false;
+    }
+    return true;
+}
+
+constexpr bool matchPattern(std::string_view pattern, std::string_view path, RouteMatch& match) {
+    match.paramCount = 0;
+    std::string_view patternSegment;
+    std::string_view pathSegment;
+    while (nextSegment(pattern, patternSegment)) {
+        if (!nextSegment(path, pathSegment)) return false;
+        if (patternSegment == INT_PLACEHOLDER) {
+            int value = 0;
+            if (!parseInt(pathSegment, value)) return false;
+            match.params[match.paramCount++] = RouteParam{pathSegment, value};
+        } else if (patternSegment == WORD_PLACEHOLDER) {
+            if (!isWord(pathSegment)) return false;
+            match.params[match.paramCount++] = RouteParam{pathSegment, 0};
+        } else if (patternSegment != pathSegment) {
+            return false;
+        }
+    }
+    return path.empty();
+}
+
+// Rejects malformed patterns when the table is compiled
+constexpr bool validPattern(std::string_view pattern) {
+    if (pattern.empty() || pattern.front() != '/') return false;
+    size_t params = 0;
+    std::string_view segment;
+    while (nextSegment(pattern, segment)) {
+        if (segment.empty()) return false;
+        if (segment.front() == '{') {
+            if (segment != INT_PLACEHOLDER && segment != WORD_PLACEHOLDER) return false;
+            ++params;
+        }
+    }
+    return params <= RouteMatch::MAX_PARAMS;
+}
+
+template <size_t N>
+constexpr bool validTable(const Route (&routes)[N]) {
+    for (size_t i = 0; i < N; ++i) {
+        if (!validPattern(routes[i].pattern) || routes[i].id == RouteId::None) return false;
+    }
+    return true;
+}
+
+template <size_t N>
+constexpr RouteMatch match(const Route (&routes)[N], std::string_view method, std::string_view path) {
+    RouteMatch result;
+    for (size_t i = 0; i < N; ++i) {
+        if (!routes[i].method.empty() && routes[i].method != method) continue;
+        if (matchPattern(routes[i].pattern, path, result)) {
+            result.id = routes[i].id;
+            return result;
+        }
+    }
+    return RouteMatch();
+}
+
+} // namespace routing
+
+inline constexpr Route HTTP_ROUTES[] = {
+    {"", "/api/streams",                  RouteId::ApiStreams},
+    {"", "/api/stream/{int}/start",       RouteId::ApiStreamStart},
+    {"", "/api/stream/{int}/stop",        RouteId::ApiStreamStop},
+    {"", "/api/stream/{int}/status",      RouteId::ApiStreamStatus},
+    {"GET", "/api/stream/{int}/viewers",  RouteId::ApiStreamViewers},
+    {"PATCH", "/api/stream/{int}/encoder", RouteId::ApiStreamEncoder},
+    {"POST", "/api/stream/{int}/keyframe", RouteId::ApiStreamKeyframe},
+    {"GET", "/api/stream/{int}/renditions", RouteId::ApiStreamRenditions},
+    {"GET", "/api/stream/{int}/destinations", RouteId::ApiStreamDestinations},
+    {"POST", "/api/stream/{int}/destinations", RouteId::ApiStreamDestinationAdd},
+    {"DELETE", "/api/stream/{int}/destinations", RouteId::ApiStreamDestinationRemove},
+    {"", "/stream/{int}/mjpeg",           RouteId::StreamMjpeg},
+    {"GET", "/stream/{int}/hls/index.m3u8", RouteId::HlsPlaylist},
+    {"GET", "/stream/{int}/hls/init/{int}", RouteId::HlsInit},
+    {"GET", "/stream/{int}/hls/segment/{int}", RouteId::HlsSegment},
+    {"GET", "/stream/{int}/hls/part/{int}/{int}", RouteId::HlsPart},
+    {"GET", "/ws/stream/{int}",           RouteId::WsStream},
+    {"", "/stream/{int}/{word}",          RouteId::StreamPage},
+    {"", "/stream/{int}",                 RouteId::StreamPage},
+};
+
+static_assert(routing::validTable(HTTP_ROUTES), "malformed route pattern in HTTP_ROUTES");
+static_assert(routing::match(HTTP_ROUTES, "POST", "/api/stream/7/start").intParam(0) == 7,
+              "route table self-check failed");
+
+inline RouteMatch matchRoute(std::string_view method, std::string_view path) {
+    return routing::match(HTTP_ROUTES, method, path);
+}
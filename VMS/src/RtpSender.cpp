@@ -0,0 +1,254 @@
+#include "RtpSender.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <net/if.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103     // linux/udp.h, Linux 4.18+
+#endif
+
+namespace {
+// sendmmsg() messages per call, and GSO segments per message (kernel limit 64)
+constexpr size_t MAX_BATCH = 64;
+constexpr size_t MAX_GSO_SEGMENTS = 64;
+constexpr size_t MAX_GSO_BYTES = 65000;
+// Packets per paced burst, and how much faster than the stream's average
+// bitrate bursts may go; a keyframe several times the average frame size
+// then spreads over a few frame intervals instead of leaving in one go
+constexpr size_t PACING_BURST = 8;
+constexpr double PACING_HEADROOM = 4.0;
+
+struct GsoControl {
+    alignas(cmsghdr) char data[CMSG_SPACE(sizeof(uint16_t))];
+};
+
+// Packets that can share one GSO datagram: all as long as the first, except
+// that a shorter one may end the run
+size_t gsoRun(const iovec* packets, size_t count) {
+    size_t segment = packets[0].iov_len;
+    size_t bytes = 0;
+    size_t run = 0;
+    while (run < count && run < MAX_GSO_SEGMENTS && packets[run].iov_len <= segment &&
+           bytes + packets[run].iov_len <= MAX_GSO_BYTES) {
+        bytes += packets[run].iov_len;
+        if (packets[run++].iov_len < segment) {
+            break;
+        }
+    }
+    return run;
+}
+}
+
+RtpSender::RtpSender(RtpEgress mode, int multicastTtl, const std::string& multicastInterface)
+    : m_mode(mode), m_multicastTtl(multicastTtl), m_multicastInterface(multicastInterface),
+      m_targets(std::make_shared<const std::vector<Target>>()) {
+    m_messages.reserve(MAX_BATCH);
+}
+
+RtpSender::~RtpSender() {
+    for (int fd : m_sockets) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool RtpSender::addDestination(const RtpDestination& destination, std::string& error) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    int status = getaddrinfo(destination.host.c_str(), std::to_string(destination.port).c_str(), &hints, &result);
+    if (status != 0) {
+        error = "Cannot resolve " + destination.host + ": " + gai_strerror(status);
+        return false;
+    }
+    Target target{destination, -1, {}, 0};
+    std::memcpy(&target.address, result->ai_addr, result->ai_addrlen);
+    target.addressLength = result->ai_addrlen;
+    freeaddrinfo(result);
+    
+    std::lock_guard<std::mutex> lock(m_targetsMutex);
+    for (const Target& existing : *m_targets) {
+        if (existing.destination == destination) {
+            error = "Already sending to " + destination.host + ":" + std::to_string(destination.port);
+            return false;
+        }
+    }
+    target.socket = socketFor(target.address.ss_family, error);
+    if (target.socket < 0) {
+        return false;
+    }
+    auto targets = std::make_shared<std::vector<Target>>(*m_targets);
+    targets->push_back(target);
+    std::atomic_store(&m_targets, std::shared_ptr<const std::vector<Target>>(std::move(targets)));
+    return true;
+}
+
+bool RtpSender::removeDestination(const RtpDestination& destination) {
+    std::lock_guard<std::mutex> lock(m_targetsMutex);
+    auto targets = std::make_shared<std::vector<Target>>(*m_targets);
+    auto it = std::find_if(targets->begin(), targets->end(),
+                           [&](const Target& target) { return target.destination == destination; });
+    if (it == targets->end()) {
+        return false;
+    }
+    targets->erase(it);
+    std::atomic_store(&m_targets, std::shared_ptr<const std::vector<Target>>(std::move(targets)));
+    return true;
+}
+
+std::vector<RtpDestination> RtpSender::destinations() const {
+    std::shared_ptr<const std::vector<Target>> targets = std::atomic_load(&m_targets);
+    std::vector<RtpDestination> destinations;
+    for (const Target& target : *targets) {
+        destinations.push_back(target.destination);
+    }
+    return destinations;
+}
+
+int RtpSender::socketFor(int family, std::string& error) {
+    int& fd = m_sockets[family == AF_INET6 ? 1 : 0];
+    if (fd >= 0) {
+        return fd;
+    }
+    fd = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::string("Failed to create RTP socket: ") + std::strerror(errno);
+        return -1;
+    }
+    // Only consulted for multicast destinations; unicast ones ignore it
+    unsigned interfaceIndex = m_multicastInterface.empty() ? 0 : if_nametoindex(m_multicastInterface.c_str());
+    if (!m_multicastInterface.empty() && interfaceIndex == 0) {
+        std::cerr << "Unknown multicast interface " << m_multicastInterface << ", using the default route" << std::endl;
+    }
+    if (family == AF_INET6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &m_multicastTtl, sizeof(m_multicastTtl));
+        if (interfaceIndex > 0) {
+            setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &interfaceIndex, sizeof(interfaceIndex));
+        }
+    } else {
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &m_multicastTtl, sizeof(m_multicastTtl));
+        if (interfaceIndex > 0) {
+            ip_mreqn request{};
+            request.imr_ifindex = static_cast<int>(interfaceIndex);
+            setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &request, sizeof(request));
+        }
+    }
+    return fd;
+}
+
+void RtpSender::setPacing(int bitrateKbps) {
+    m_pacingRate.store(bitrateKbps > 0 ? bitrateKbps * 1000.0 / 8.0 * PACING_HEADROOM : 0.0,
+                       std::memory_order_relaxed);
+}
+
+void RtpSender::send(const iovec* packets, size_t count) {
+    std::shared_ptr<const std::vector<Target>> targets = std::atomic_load(&m_targets);
+    double rate = m_pacingRate.load(std::memory_order_relaxed);
+    bool paced = rate > 0;
+    size_t done = 0;
+    while (done < count) {
+        size_t burst = std::min(count - done, paced ? PACING_BURST : count - done);
+        if (paced) {
+            size_t bytes = 0;
+            for (size_t i = done; i < done + burst; ++i) {
+                bytes += packets[i].iov_len;
+            }
+            pace(bytes, rate);
+        }
+        // Pacing is per destination: each receiver sees the same rate
+        for (const Target& target : *targets) {
+            sendAll(packets + done, burst, target);
+        }
+        done += burst;
+    }
+}
+
+void RtpSender::sendAll(const iovec* packets, size_t count, const Target& target) {
+    size_t done = 0;
+    while (done < count) {
+        size_t sent = sendBatch(packets + done, count - done, target);
+        if (sent == 0) {
+            // Nothing a retry would fix within this burst; other destinations still get it
+            m_errors.fetch_add(count - done, std::memory_order_relaxed);
+            return;
+        }
+        done += sent;
+    }
+}
+
+size_t RtpSender::sendBatch(const iovec* packets, size_t count, const Target& target) {
+    // msghdr wants mutable iovecs; the payload itself is not copied
+    m_iovecs.assign(packets, packets + count);
+    static thread_local GsoControl controls[MAX_BATCH];
+    size_t runs[MAX_BATCH];
+    m_messages.clear();
+    size_t used = 0;
+    while (used < count && m_messages.size() < MAX_BATCH) {
+        size_t run = m_mode == RtpEgress::Gso ? gsoRun(packets + used, count - used) : 1;
+        mmsghdr message{};
+        message.msg_hdr.msg_name = const_cast<sockaddr_storage*>(&target.address);
+        message.msg_hdr.msg_namelen = target.addressLength;
+        message.msg_hdr.msg_iov = &m_iovecs[used];
+        message.msg_hdr.msg_iovlen = run;
+        if (run > 1) {
+            GsoControl& control = controls[m_messages.size()];
+            message.msg_hdr.msg_control = control.data;
+            message.msg_hdr.msg_controllen = sizeof(control.data);
+            cmsghdr* header = CMSG_FIRSTHDR(&message.msg_hdr);
+            header->cmsg_level = SOL_UDP;
+            header->cmsg_type = UDP_SEGMENT;
+            header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment = static_cast<uint16_t>(packets[used].iov_len);
+            std::memcpy(CMSG_DATA(header), &segment, sizeof(segment));
+        }
+        runs[m_messages.size()] = run;
+        m_messages.push_back(message);
+        used += run;
+    }
+
+    int sent = sendmmsg(target.socket, m_messages.data(), m_messages.size(), 0);
+    m_syscalls.fetch_add(1, std::memory_order_relaxed);
+    if (sent < 0) {
+        if (m_mode == RtpEgress::Gso && (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+            // Kernel or route without UDP GSO; plain batches still work
+            std::cerr << "UDP GSO unavailable (" << std::strerror(errno) << "), using sendmmsg" << std::endl;
+            m_mode = RtpEgress::SendMmsg;
+            return sendBatch(packets, count, target);
+        }
+        return 0;
+    }
+    size_t packetsSent = 0;
+    size_t bytesSent = 0;
+    for (int i = 0; i < sent; ++i) {
+        packetsSent += runs[i];
+        bytesSent += m_messages[i].msg_len;
+    }
+    m_packets.fetch_add(packetsSent, std::memory_order_relaxed);
+    m_bytes.fetch_add(bytesSent, std::memory_order_relaxed);
+    return packetsSent;
+}
+
+void RtpSender::pace(size_t bytes, double rate) {
+    auto now = std::chrono::steady_clock::now();
+    // Idle time does not bank credit for a later burst
+    if (m_nextSend < now) {
+        m_nextSend = now;
+    } else {
+        std::this_thread::sleep_until(m_nextSend);
+    }
+    double seconds = bytes / rate;
+    m_nextSend += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+RtpSender::Stats RtpSender::stats() const {
+    return Stats{m_packets.load(std::memory_order_relaxed), m_bytes.load(std::memory_order_relaxed),
+                 m_syscalls.load(std::memory_order_relaxed), m_errors.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "Config.h"
+
+// Sends one payloader's RTP packets to a list of UDP destinations (unicast
+// or multicast) a frame at a time. Instead of a system call per packet, a
+// frame's packets go out with one sendmmsg() per destination, or as UDP GSO
+// super-packets (UDP_SEGMENT) that the kernel splits after the stack has
+// been walked once. With pacing on, large frames (keyframes) are spread out
+// in small bursts at a multiple of the stream's bitrate rather than hitting
+// the network and the receivers all at once.
+// One streaming thread sends; destinations may be edited from any thread
+// and take effect from the next frame.
+class RtpSender {
+public:
+    struct Stats {
+        uint64_t packets;
+        uint64_t bytes;
+        uint64_t syscalls;
+        uint64_t errors;            // packets dropped by a failed send
+    };
+
+    explicit RtpSender(RtpEgress mode, int multicastTtl = 1, const std::string& multicastInterface = "");
+    ~RtpSender();
+    RtpSender(const RtpSender&) = delete;
+    RtpSender& operator=(const RtpSender&) = delete;
+
+    bool addDestination(const RtpDestination& destination, std::string& error);
+    bool removeDestination(const RtpDestination& destination);
+    std::vector<RtpDestination> destinations() const;
+    // Average rate a frame's packets are sent at, from the stream bitrate;
+    // 0 sends them back to back
+    void setPacing(int bitrateKbps);
+    // One frame's packets, in order
+    void send(const iovec* packets, size_t count);
+
+    RtpEgress mode() const { return m_mode; }
+    // Safe to read from any thread
+    Stats stats() const;
+
+private:
+    struct Target {
+        RtpDestination destination;
+        int socket;
+        sockaddr_storage address;
+        socklen_t addressLength;
+    };
+
+    RtpEgress m_mode;
+    int m_multicastTtl;
+    std::string m_multicastInterface;
+    int m_sockets[2]{-1, -1};                           // IPv4, IPv6; opened on first use
+    // Replaced whole on every edit; the sending thread loads it once per frame
+    std::shared_ptr<const std::vector<Target>> m_targets;
+    mutable std::mutex m_targetsMutex;                  // serialises edits
+
+    std::atomic<double> m_pacingRate{0};                // bytes/s
+    std::chrono::steady_clock::time_point m_nextSend;
+
+    std::vector<mmsghdr> m_messages;                    // reused between frames
+    std::vector<iovec> m_iovecs;
+
+    std::atomic<uint64_t> m_packets{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::atomic<uint64_t> m_syscalls{0};
+    std::atomic<uint64_t> m_errors{0};
+
+    int socketFor(int family, std::string& error);
+    void sendAll(const iovec* packets, size_t count, const Target& target);
+    size_t sendBatch(const iovec* packets, size_t count, const Target& target);
+    void pace(size_t bytes, double rate);
+};
@@ -0,0 +1,621 @@
+#include "StaticAssetCache.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <openssl/evp.h>
+#include <zlib.h>
+#ifdef VMS_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace {
+// Compressed variants are kept only if they save at least this fraction
+constexpr double MIN_COMPRESSION_SAVING = 0.1;
+constexpr size_t HASH_CHUNK_SIZE = 64 * 1024;
+
+bool isCompressible(const std::string& mimeType) {
+    return mimeType.compare(0, 5, "text/") == 0 ||
+           mimeType == "application/javascript" ||
+           mimeType == "application/json" ||
+           mimeType == "image/svg+xml";
+}
+
+bool endsWith(const std::string& value, const std::string& suffix) {
+    return value.length() >= suffix.length() &&
+           value.compare(value.length() - suffix.length(), suffix.length(), suffix) == 0;
+}
+
+// Files that are editor droppings or pre-compressed siblings of real assets
+bool isIgnored(const std::string& name) {
+    return name.empty() || name[0] == '.' || endsWith(name, "~") ||
+           endsWith(name, ".br") || endsWith(name, ".gz") || endsWith(name, ".swp");
+}
+
+std::string toHex(const unsigned char* data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(length * 2, '0');
+    for (size_t i = 0; i < length; ++i) {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 0x0F];
+    }
+    return hex;
+}
+
+// SHA-1 of the identity body, either from memory or streamed from an fd
+std::string contentHash(const std::string* body, int fd) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLength = 0;
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, EVP_sha1(), nullptr);
+    if (body) {
+        EVP_DigestUpdate(ctx, body->data(), body->size());
+    } else {
+        std::vector<char> chunk(HASH_CHUNK_SIZE);
+        off_t offset = 0;
+        ssize_t n;
+        while ((n = pread(fd, chunk.data(), chunk.size(), offset)) > 0) {
+            EVP_DigestUpdate(ctx, chunk.data(), n);
+            offset += n;
+        }
+    }
+    EVP_DigestFinal_ex(ctx, digest, &digestLength);
+    EVP_MD_CTX_free(ctx);
+    return toHex(digest, digestLength);
+}
+
+bool gzipCompress(const std::string& input, std::string& output) {
+    z_stream stream{};
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    output.resize(deflateBound(&stream, input.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = input.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = output.size();
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+bool brotliCompress(const std::string& input, std::string& output) {
+#ifdef VMS_HAVE_BROTLI
+    size_t encodedSize = BrotliEncoderMaxCompressedSize(input.size());
+    if (encodedSize == 0) return false;
+    output.resize(encodedSize);
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               input.size(), reinterpret_cast<const uint8_t*>(input.data()),
+                               &encodedSize, reinterpret_cast<uint8_t*>(&output[0]))) {
+        return false;
+    }
+    output.resize(encodedSize);
+    return true;
+#else
+    (void)input;
+    (void)output;
+    return false;
+#endif
+}
+
+bool readFile(const std::string& filePath, std::string& content) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+// Copies a file into an anonymous memfd so an asset served by sendfile()
+// cannot change underneath its cached headers if the file is rewritten in place
+int snapshotFile(const std::string& filePath, size_t& size, time_t& lastModified) {
+    int source = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source < 0) return -1;
+    struct stat info;
+    if (fstat(source, &info) != 0) {
+        close(source);
+        return -1;
+    }
+    int snapshot = memfd_create("vms-asset", MFD_CLOEXEC);
+    if (snapshot < 0) {
+        close(source);
+        return -1;
+    }
+    size_t copied = 0;
+    while (copied < static_cast<size_t>(info.st_size)) {
+        ssize_t n = sendfile(snapshot, source, nullptr, info.st_size - copied);
+        if (n <= 0) break;
+        copied += n;
+    }
+    close(source);
+    if (copied != static_cast<size_t>(info.st_size)) {
+        close(snapshot);
+        return -1;
+    }
+    size = copied;
+    lastModified = info.st_mtime;
+    return snapshot;
+}
+
+std::string httpDate(time_t time) {
+    char buffer[64];
+    tm gmt;
+    gmtime_r(&time, &gmt);
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return buffer;
+}
+
+time_t parseHttpDate(std::string_view value) {
+    tm parsed{};
+    std::string text(value);
+    const char* end = strptime(text.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &parsed);
+    if (!end || *end != '\0') return -1;
+    return timegm(&parsed);
+}
+
+// "/js/app.js" -> "/js/app.<hash prefix>.js"
+std::string fingerprintedPath(const std::string& urlPath, const std::string& etag) {
+    size_t slash = urlPath.rfind('/');
+    size_t dot = urlPath.rfind('.');
+    std::string fingerprint = etag.substr(0, 10);
+    if (dot == std::string::npos || dot < slash) {
+        return urlPath + "." + fingerprint;
+    }
+    return urlPath.substr(0, dot) + "." + fingerprint + urlPath.substr(dot);
+}
+
+// Parse the q-value of one Accept-Encoding element; 1.0 when absent
+double qualityOf(std::string_view element) {
+    size_t q = element.find("q=");
+    if (q == std::string_view::npos) return 1.0;
+    return std::strtod(std::string(element.substr(q + 2)).c_str(), nullptr);
+}
+}
+
+StaticAsset::~StaticAsset() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+StaticAssetCache::StaticAssetCache(const std::string& rootDir)
+    : m_rootDir(rootDir), m_assets(std::make_shared<const AssetMap>()) {
+}
+
+StaticAssetCache::~StaticAssetCache() {
+    stop();
+}
+
+void StaticAssetCache::setCachePolicy(const StaticCachePolicy& policy) {
+    std::lock_guard<std::mutex> lock(m_reloadMutex);
+    m_policy = policy;
+}
+
+void StaticAssetCache::start() {
+    loadAll();
+
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_inotifyFd < 0 || m_wakeFd < 0) {
+        std::cerr << "Static asset watcher unavailable; changes to " << m_rootDir
+                  << " need a restart" << std::endl;
+        if (m_inotifyFd >= 0) close(m_inotifyFd);
+        if (m_wakeFd >= 0) close(m_wakeFd);
+        m_inotifyFd = m_wakeFd = -1;
+        return;
+    }
+    addWatch(m_rootDir);
+
+    m_running = true;
+    m_watchThread = std::thread(&StaticAssetCache::watchLoop, this);
+}
+
+void StaticAssetCache::stop() {
+    if (m_running.exchange(false)) {
+        uint64_t one = 1;
+        ssize_t ignored = write(m_wakeFd, &one, sizeof(one));
+        (void)ignored;
+        if (m_watchThread.joinable()) {
+            m_watchThread.join();
+        }
+    }
+    if (m_inotifyFd >= 0) {
+        close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+    if (m_wakeFd >= 0) {
+        close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+    m_watchDirs.clear();
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::find(std::string_view path) const {
+    std::shared_ptr<const AssetMap> assets = std::atomic_load(&m_assets);
+    auto it = assets->find(path);
+    if (it == assets->end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+StaticAsset::Encoding StaticAssetCache::chooseEncoding(const StaticAsset& asset, std::string_view acceptEncoding) {
+    bool acceptsGzip = false;
+    bool acceptsBrotli = false;
+    while (!acceptEncoding.empty()) {
+        size_t comma = acceptEncoding.find(',');
+        std::string_view element = acceptEncoding.substr(0, comma);
+        while (!element.empty() && element.front() == ' ') element.remove_prefix(1);
+        std::string_view coding = element.substr(0, element.find(';'));
+        while (!coding.empty() && coding.back() == ' ') coding.remove_suffix(1);
+        if (qualityOf(element) > 0) {
+            if (coding == "br") acceptsBrotli = true;
+            if (coding == "gzip") acceptsGzip = true;
+        }
+        if (comma == std::string_view::npos) break;
+        acceptEncoding.remove_prefix(comma + 1);
+    }
+
+    if (acceptsBrotli && asset.hasEncoding[StaticAsset::BROTLI]) return StaticAsset::BROTLI;
+    if (acceptsGzip && asset.hasEncoding[StaticAsset::GZIP]) return StaticAsset::GZIP;
+    return StaticAsset::IDENTITY;
+}
+
+bool StaticAssetCache::isNotModified(const StaticAsset& asset, std::string_view ifNoneMatch,
+                                     std::string_view ifModifiedSince) {
+    if (!ifNoneMatch.empty()) {
+        // Weak comparison over the list; any encoding of the same content matches
+        while (!ifNoneMatch.empty()) {
+            size_t comma = ifNoneMatch.find(',');
+            std::string_view tag = ifNoneMatch.substr(0, comma);
+            while (!tag.empty() && tag.front() == ' ') tag.remove_prefix(1);
+            while (!tag.empty() && tag.back() == ' ') tag.remove_suffix(1);
+            if (tag == "*") return true;
+            if (tag.substr(0, 2) == "W/") tag.remove_prefix(2);
+            if (tag.size() >= 2 && tag.front() == '"' && tag.back() == '"') {
+                tag = tag.substr(1, tag.size() - 2);
+                if (tag.substr(0, tag.find('-')) == asset.etag) return true;
+            }
+            if (comma == std::string_view::npos) break;
+            ifNoneMatch.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    if (!ifModifiedSince.empty()) {
+        time_t since = parseHttpDate(ifModifiedSince);
+        return since >= 0 && asset.lastModified <= since;
+    }
+    return false;
+}
+
+std::string StaticAssetCache::getMimeType(const std::string& path) {
+    if (endsWith(path, ".html")) return "text/html";
+    if (endsWith(path, ".css")) return "text/css";
+    if (endsWith(path, ".js")) return "application/javascript";
+    if (endsWith(path, ".json")) return "application/json";
+    if (endsWith(path, ".png")) return "image/png";
+    if (endsWith(path, ".jpg") || endsWith(path, ".jpeg")) return "image/jpeg";
+    if (endsWith(path, ".gif")) return "image/gif";
+    if (endsWith(path, ".svg")) return "image/svg+xml";
+    return "text/plain";
+}
+
+void StaticAssetCache::loadAll() {
+    std::lock_guard<std::mutex> lock(m_reloadMutex);
+    m_files.clear();
+    size_t totalBytes = 0;
+
+    std::vector<std::string> pending{m_rootDir};
+    while (!pending.empty()) {
+        std::string dir = pending.back();
+        pending.pop_back();
+        DIR* handle = opendir(dir.c_str());
+        if (!handle) continue;
+        while (dirent* entry = readdir(handle)) {
+            std::string name = entry->d_name;
+            if (isIgnored(name)) continue;
+            std::string filePath = dir + "/" + name;
+            struct stat info;
+            if (stat(filePath.c_str(), &info) != 0) continue;
+            if (S_ISDIR(info.st_mode)) {
+                pending.push_back(filePath);
+            } else if (S_ISREG(info.st_mode)) {
+                std::string urlPath = urlPathFor(filePath);
+                auto asset = loadAsset(filePath, urlPath);
+                if (asset) {
+                    totalBytes += asset->bodies[StaticAsset::IDENTITY].size();
+                    m_files[urlPath] = std::move(asset);
+                }
+            }
+        }
+        closedir(handle);
+    }
+
+    publish();
+    std::cout << "Static asset cache loaded " << m_files.size()
+              << " files (" << totalBytes << " bytes in memory) from " << m_rootDir << std::endl;
+}
+
+void StaticAssetCache::reloadFile(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(m_reloadMutex);
+    std::string urlPath = urlPathFor(filePath);
+
+    struct stat info;
+    if (stat(filePath.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+        auto asset = loadAsset(filePath, urlPath);
+        if (!asset) return;
+        m_files[urlPath] = std::move(asset);
+        std::cout << "Static asset reloaded: " << urlPath << std::endl;
+    } else if (m_files.erase(urlPath) > 0) {
+        std::cout << "Static asset removed: " << urlPath << std::endl;
+    } else {
+        return;
+    }
+    publish();
+}
+
+void StaticAssetCache::publish() {
+    // Every asset is reachable by its plain path and its fingerprinted path.
+    // HTML is the entry point, so it is only served under its plain path and
+    // is rewritten to reference the fingerprinted URLs of the current files.
+    auto assets = std::make_shared<AssetMap>();
+    for (const auto& pair : m_files) {
+        const std::shared_ptr<const StaticAsset>& asset = pair.second;
+        if (asset->mimeType == "text/html" && asset->fd < 0) {
+            std::string rewritten = rewriteHtmlReferences(*asset);
+            if (rewritten != asset->bodies[StaticAsset::IDENTITY]) {
+                (*assets)[pair.first] = buildAsset(asset->path, std::move(rewritten), asset->lastModified);
+                continue;
+            }
+            (*assets)[pair.first] = asset;
+            continue;
+        }
+        (*assets)[pair.first] = asset;
+        (*assets)[asset->fingerprintPath] = asset;
+    }
+    std::atomic_store(&m_assets, std::shared_ptr<const AssetMap>(std::move(assets)));
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::loadAsset(const std::string& filePath,
+                                                               const std::string& urlPath) {
+    struct stat info;
+    if (stat(filePath.c_str(), &info) != 0) {
+        return nullptr;
+    }
+
+    if (static_cast<size_t>(info.st_size) < LARGE_ASSET_THRESHOLD) {
+        std::string content;
+        if (!readFile(filePath, content)) {
+            std::cerr << "Failed to read static asset " << filePath << std::endl;
+            return nullptr;
+        }
+        auto asset = buildAsset(urlPath, std::move(content), info.st_mtime);
+
+        // Prefer a brotli file produced offline at maximum effort, if one ships
+        std::string brotli;
+        if (isCompressible(asset->mimeType) && readFile(filePath + ".br", brotli) &&
+            brotli.size() < asset->size) {
+            asset->bodies[StaticAsset::BROTLI] = std::move(brotli);
+            asset->hasEncoding[StaticAsset::BROTLI] = true;
+            renderHeads(*asset);
+        }
+        return asset;
+    }
+
+    auto asset = std::make_shared<StaticAsset>();
+    asset->path = urlPath;
+    asset->mimeType = getMimeType(urlPath);
+    asset->lastModified = info.st_mtime;
+    asset->size = info.st_size;
+    asset->fd = snapshotFile(filePath, asset->size, asset->lastModified);
+    if (asset->fd < 0) {
+        std::cerr << "Failed to snapshot static asset " << filePath << std::endl;
+        return nullptr;
+    }
+    asset->etag = contentHash(nullptr, asset->fd);
+    asset->hasEncoding[StaticAsset::IDENTITY] = true;
+    asset->fingerprintPath = fingerprintedPath(urlPath, asset->etag);
+    renderHeads(*asset);
+    return asset;
+}
+
+std::shared_ptr<StaticAsset> StaticAssetCache::buildAsset(const std::string& urlPath, std::string content,
+                                                          time_t lastModified) {
+    auto asset = std::make_shared<StaticAsset>();
+    asset->path = urlPath;
+    asset->mimeType = getMimeType(urlPath);
+    asset->lastModified = lastModified;
+    asset->size = content.size();
+    asset->etag = contentHash(&content, -1);
+    asset->fingerprintPath = fingerprintedPath(urlPath, asset->etag);
+    asset->bodies[StaticAsset::IDENTITY] = std::move(content);
+    asset->hasEncoding[StaticAsset::IDENTITY] = true;
+
+    if (isCompressible(asset->mimeType)) {
+        const std::string& identity = asset->bodies[StaticAsset::IDENTITY];
+        size_t worthwhile = static_cast<size_t>(identity.size() * (1.0 - MIN_COMPRESSION_SAVING));
+        std::string& gzip = asset->bodies[StaticAsset::GZIP];
+        asset->hasEncoding[StaticAsset::GZIP] = gzipCompress(identity, gzip) && gzip.size() < worthwhile;
+        std::string& brotli = asset->bodies[StaticAsset::BROTLI];
+        asset->hasEncoding[StaticAsset::BROTLI] = brotliCompress(identity, brotli) && brotli.size() < worthwhile;
+
+        for (int encoding : {StaticAsset::GZIP, StaticAsset::BROTLI}) {
+            if (!asset->hasEncoding[encoding]) {
+                asset->bodies[encoding].clear();
+                asset->bodies[encoding].shrink_to_fit();
+            }
+        }
+    }
+
+    renderHeads(*asset);
+    return asset;
+}
+
+void StaticAssetCache::renderHeads(StaticAsset& asset) const {
+    static const char* const encodingNames[] = {"", "gzip", "br"};
+    bool negotiated = asset.hasEncoding[StaticAsset::GZIP] || asset.hasEncoding[StaticAsset::BROTLI];
+    std::string lastModified = httpDate(asset.lastModified);
+
+    for (int variant = 0; variant < StaticAsset::VARIANT_COUNT; ++variant) {
+        const std::string& cacheControl =
+            variant == StaticAsset::IMMUTABLE ? m_policy.fingerprinted : m_policy.revalidate;
+
+        for (int encoding = 0; encoding < StaticAsset::ENCODING_COUNT; ++encoding) {
+            if (!asset.hasEncoding[encoding]) continue;
+            size_t length = asset.fd >= 0 ? asset.size : asset.bodies[encoding].size();
+
+            // Validators and caching headers shared by the 200 and the 304
+            std::ostringstream validators;
+            // Strong ETags must differ between representations
+            validators << "ETag: \"" << asset.etag;
+            if (encoding != StaticAsset::IDENTITY) {
+                validators << "-" << encodingNames[encoding];
+            }
+            validators << "\"\r\n";
+            validators << "Last-Modified: " << lastModified << "\r\n";
+            if (!cacheControl.empty()) {
+                validators << "Cache-Control: " << cacheControl << "\r\n";
+            }
+            if (negotiated) {
+                validators << "Vary: Accept-Encoding\r\n";
+            }
+            validators << "Access-Control-Allow-Origin: *\r\n";
+
+            std::ostringstream head;
+            head << "HTTP/1.1 200 OK\r\n";
+            head << "Content-Type: " << asset.mimeType << "\r\n";
+            head << "Content-Length: " << length << "\r\n";
+            if (encoding != StaticAsset::IDENTITY) {
+                head << "Content-Encoding: " << encodingNames[encoding] << "\r\n";
+            }
+            head << validators.str() << "\r\n";
+            asset.heads[variant][encoding] = head.str();
+
+            asset.notModifiedHeads[variant][encoding] =
+                "HTTP/1.1 304 Not Modified\r\n" + validators.str() + "\r\n";
+        }
+    }
+}
+
+std::string StaticAssetCache::rewriteHtmlReferences(const StaticAsset& html) const {
+    const std::string& source = html.bodies[StaticAsset::IDENTITY];
+    std::string baseDir = html.path.substr(0, html.path.rfind('/') + 1);
+    std::string result;
+    result.reserve(source.size());
+
+    size_t copied = 0;
+    size_t pos = 0;
+    while ((pos = source.find('=', pos)) != std::string::npos) {
+        // Only look at src="..." and href="..." attribute values
+        bool isSrc = pos >= 3 && source.compare(pos - 3, 3, "src") == 0;
+        bool isHref = pos >= 4 && source.compare(pos - 4, 4, "href") == 0;
+        ++pos;
+        if ((!isSrc && !isHref) || pos >= source.size() || (source[pos] != '"' && source[pos] != '\'')) {
+            continue;
+        }
+        char quote = source[pos];
+        size_t valueStart = pos + 1;
+        size_t valueEnd = source.find(quote, valueStart);
+        if (valueEnd == std::string::npos) break;
+        pos = valueEnd + 1;
+
+        std::string value = source.substr(valueStart, valueEnd - valueStart);
+        if (value.empty() || value.find("//") != std::string::npos || value[0] == '#' ||
+            value.find(':') != std::string::npos || value.find('?') != std::string::npos) {
+            continue;
+        }
+        std::string target = value[0] == '/' ? value : baseDir + value;
+        auto it = m_files.find(target);
+        if (it == m_files.end() || it->second->mimeType == "text/html") {
+            continue;
+        }
+
+        result.append(source, copied, valueStart - copied);
+        result.append(it->second->fingerprintPath);
+        copied = valueEnd;
+    }
+    result.append(source, copied, std::string::npos);
+    return result;
+}
+
+std::string StaticAssetCache::urlPathFor(const std::string& filePath) const {
+    return filePath.substr(m_rootDir.length());
+}
+
+void StaticAssetCache::addWatch(const std::string& dir) {
+    int wd = inotify_add_watch(m_inotifyFd, dir.c_str(),
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE);
+    if (wd < 0) {
+        std::cerr << "Failed to watch " << dir << " for asset changes" << std::endl;
+        return;
+    }
+    m_watchDirs[wd] = dir;
+
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) return;
+    while (dirent* entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == ".." || name[0] == '.') continue;
+        std::string path = dir + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            addWatch(path);
+        }
+    }
+    closedir(handle);
+}
+
+void StaticAssetCache::watchLoop() {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{m_inotifyFd, POLLIN, 0}, {m_wakeFd, POLLIN, 0}};
+
+    while (m_running) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!m_running || (fds[1].revents & POLLIN)) break;
+
+        ssize_t length;
+        while ((length = read(m_inotifyFd, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len) {
+                const inotify_event* event = reinterpret_cast<inotify_event*>(p);
+                auto dir = m_watchDirs.find(event->wd);
+                if (dir == m_watchDirs.end() || event->len == 0) continue;
+
+                std::string name = event->name;
+                std::string path = dir->second + "/" + name;
+                if (event->mask & IN_ISDIR) {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        addWatch(path);
+                        loadAll();
+                    }
+                    continue;
+                }
+                // A file being created is picked up once its writer closes it
+                if (event->mask == IN_CREATE) continue;
+
+                if (endsWith(name, ".br")) {
+                    reloadFile(path.substr(0, path.length() - 3));
+                } else if (!isIgnored(name)) {
+                    reloadFile(path);
+                }
+            }
+        }
+    }
+}
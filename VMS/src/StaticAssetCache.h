@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <ctime>
+#include <sys/types.h>
+
+// One file from the web root, fully prepared at load time. Instances are
+// immutable once published; a reload builds a new one and swaps it in, so
+// senders holding a shared_ptr keep a consistent body (and open fd) until done.
+struct StaticAsset {
+    enum Encoding { IDENTITY = 0, GZIP = 1, BROTLI = 2, ENCODING_COUNT = 3 };
+    // Which Cache-Control policy a head carries: plain URLs are revalidated,
+    // fingerprinted URLs never change and may be cached forever
+    enum Variant { REVALIDATE = 0, IMMUTABLE = 1, VARIANT_COUNT = 2 };
+
+    std::string path;                       // URL path, e.g. "/script.js"
+    std::string fingerprintPath;            // e.g. "/script.3f2a9c01d4.js"
+    std::string mimeType;
+    std::string etag;                       // strong validator of the identity body
+    time_t lastModified{0};
+    size_t size{0};
+
+    // Small assets live in memory, with compressed variants when they pay off
+    std::string bodies[ENCODING_COUNT];
+    bool hasEncoding[ENCODING_COUNT]{};
+
+    // Large assets are snapshotted into a memfd and go out with sendfile()
+    int fd{-1};
+
+    // Pre-rendered 200 and 304 response heads (everything except the
+    // Connection header) per cache policy and available encoding
+    std::string heads[VARIANT_COUNT][ENCODING_COUNT];
+    std::string notModifiedHeads[VARIANT_COUNT][ENCODING_COUNT];
+
+    ~StaticAsset();
+};
+
+struct StaticCachePolicy {
+    std::string revalidate = "no-cache";
+    std::string fingerprinted = "public, max-age=31536000, immutable";
+};
+
+class StaticAssetCache {
+public:
+    static constexpr size_t LARGE_ASSET_THRESHOLD = 256 * 1024;
+
+    explicit StaticAssetCache(const std::string& rootDir);
+    ~StaticAssetCache();
+
+    // Takes effect on the next (re)load; call before start()
+    void setCachePolicy(const StaticCachePolicy& policy);
+
+    // Load every file below the root and start watching it for changes
+    void start();
+    void stop();
+
+    // Lock-free lookup in the current snapshot; null if the path is unknown
+    std::shared_ptr<const StaticAsset> find(std::string_view path) const;
+
+    // Best encoding the client accepts among those the asset has
+    static StaticAsset::Encoding chooseEncoding(const StaticAsset& asset, std::string_view acceptEncoding);
+    // Evaluate If-None-Match, or If-Modified-Since when no ETags were sent
+    static bool isNotModified(const StaticAsset& asset, std::string_view ifNoneMatch,
+                              std::string_view ifModifiedSince);
+    static std::string getMimeType(const std::string& path);
+
+private:
+    using AssetMap = std::map<std::string, std::shared_ptr<const StaticAsset>, std::less<>>;
+
+    std::string m_rootDir;
+    std::shared_ptr<const AssetMap> m_assets;   // accessed with std::atomic_load/store
+    std::mutex m_reloadMutex;                   // serialises writers only
+    AssetMap m_files;                           // assets as loaded from disk, before HTML rewriting
+    StaticCachePolicy m_policy;
+
+    int m_inotifyFd{-1};
+    int m_wakeFd{-1};
+    std::map<int, std::string> m_watchDirs;     // inotify watch descriptor -> directory
+    std::atomic<bool> m_running{false};
+    std::thread m_watchThread;
+
+    void loadAll();
+    void reloadFile(const std::string& filePath);
+    void publish();
+    void addWatch(const std::string& dir);
+    void watchLoop();
+    std::shared_ptr<const StaticAsset> loadAsset(const std::string& filePath, const std::string& urlPath);
+    std::shared_ptr<StaticAsset> buildAsset(const std::string& urlPath, std::string content, time_t lastModified);
+    void renderHeads(StaticAsset& asset) const;
+    std::string rewriteHtmlReferences(const StaticAsset& html) const;
+    std::string urlPathFor(const std::string& filePath) const;
+};
@@ -3,8 +3,78 @@
 #include <sstream>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
-StreamManager::StreamManager() : m_nextPort(8081) {
+namespace {
+// Streams younger than this have not settled enough to measure
+constexpr double MIN_COST_SAMPLE_SECONDS = 2.0;
+// Bounds startup time when many streams have their own profile
+constexpr size_t MAX_CALIBRATIONS = 4;
+// Downgrade steps below the requested height, and the bitrate floor
+constexpr int DOWNGRADE_HEIGHTS[] = {720, 540, 360, 270};
+constexpr int MIN_DOWNGRADE_BITRATE = 250;
+
+double budgetFor(const VmsConfig& config, const CpuTopology& topology) {
+    return topology.cpuCount() * config.encodeBudgetPercent / 100.0;
+}
+
+// Cheaper variants of a profile, mildest first: the fastest preset, then
+// smaller sizes of the same aspect ratio with bitrate scaled to the pixels
+std::vector<StreamProfile> downgradeLadder(const StreamProfile& profile) {
+    std::vector<StreamProfile> ladder;
+    StreamProfile base = profile;
+    if (base.encoderPreset != "ultrafast") {
+        base.encoderPreset = "ultrafast";
+        ladder.push_back(base);
+    }
+    for (int height : DOWNGRADE_HEIGHTS) {
+        if (height >= profile.height) {
+            continue;
+        }
+        StreamProfile smaller = base;
+        smaller.height = height;
+        smaller.width = (profile.width * height / profile.height) & ~1;     // even for 4:2:0
+        double scale = static_cast<double>(smaller.width) * smaller.height / (profile.width * profile.height);
+        smaller.bitrate = std::max(MIN_DOWNGRADE_BITRATE, static_cast<int>(profile.bitrate * scale));
+        ladder.push_back(smaller);
+    }
+    return ladder;
+}
+
+// Source/convert thread plus the threads of every encoder in the ladder; 0
+// when x264 picks its own thread count, which only makes sense unpinned
+int coresFor(const StreamProfile& profile) {
+    int encoders = static_cast<int>(profile.renditions().size());
+    return profile.encoderThreads > 0 ? profile.encoderThreads * encoders + 1 : 0;
+}
+
+// Only RTP sent to this host arrives on a port the monitor can bind
+bool isLocalHost(const std::string& host) {
+    return host == "localhost" || host == "::1" || host.compare(0, 4, "127.") == 0;
+}
+}
+
+const StreamInfo* StreamSnapshot::find(int streamId) const {
+    auto it = std::lower_bound(streams.begin(), streams.end(), streamId,
+                               [](const StreamInfo& info, int id) { return info.streamId < id; });
+    return it != streams.end() && it->streamId == streamId ? &*it : nullptr;
+}
+
+StreamManager::StreamManager(const VmsConfig& config)
+    : m_config(config), m_placement(CpuTopology::detect()) {
+    m_busDispatcher.start();
+    m_monitor.start();
+    m_encodeBudget = budgetFor(m_config, m_placement.topology());
+    std::cout << "CPU topology: " << m_placement.topology().describe()
+              << (m_config.cpuPinning ? "" : ", pinning disabled") << std::endl;
+    if (m_config.admission != AdmissionPolicy::Off) {
+        std::cout << "Encode budget: " << m_encodeBudget << " cores" << std::endl;
+    }
+    calibrateCostModel();
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        publishSnapshot();
+    }
     std::cout << "StreamManager initialized" << std::endl;
 }
 
@@ -12,74 +82,633 @@ StreamManager::~StreamManager() {
     stopAllStreams();
 }
 
-bool StreamManager::startStream(int streamId, int width, int height, int framerate) {
-    std::lock_guard<std::mutex> lock(m_streamsMutex);
-
-    // If already running, nothing to do
-    if (m_streams.find(streamId) != m_streams.end()) {
-        std::cout << "Stream " << streamId << " already running" << std::endl;
-        return true;
+StreamStartResult StreamManager::startStream(int streamId) {
+    StreamProfile profile;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        profile = m_config.profileFor(streamId);
     }
+    return startStream(streamId, profile);
+}
 
-    // Allocate a new UDP port and create a pipeline
-    int port = getNextAvailablePort();
-    auto pipeline = std::make_unique<GStreamerPipeline>(streamId, port, width, height, framerate);
-    if (!pipeline->initialize()) {
-        std::cerr << "Failed to start GStreamer pipeline for stream " << streamId << std::endl;
-        return false;
+StreamStartResult StreamManager::startStream(int streamId, const StreamProfile& profile) {
+    return startStreams({StreamConfig{streamId, profile}}).front();
+}
+
+std::vector<StreamStartResult> StreamManager::startConfiguredStreams() {
+    std::vector<StreamConfig> streams;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        for (int i = 0; i < m_config.streamCount; ++i) {
+            streams.push_back(StreamConfig{i, m_config.profileFor(i)});
+        }
     }
-    m_streams[streamId] = std::move(pipeline);
-    std::cout << "Started GStreamer pipeline for stream " << streamId << " on UDP port " << port << std::endl;
-    return true;
+    return startStreams(streams);
 }
 
-bool StreamManager::stopStream(int streamId) {
-    std::lock_guard<std::mutex> lock(m_streamsMutex);
+void StreamManager::applyConfig(const VmsConfig& config) {
+    std::vector<int> toStop;
+    std::vector<StreamConfig> toStart;
+    int unchanged = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        int oldCount = m_config.streamCount;
+        m_config = config;
+        m_encodeBudget = budgetFor(m_config, m_placement.topology());
+        
+        // Queued streams go through admission again with their new profile
+        for (const StreamConfig& queued : m_queue) {
+            m_info.erase(queued.streamId);
+            if (queued.streamId >= config.streamCount && queued.streamId < oldCount) {
+                continue;
+            }
+            toStart.push_back(StreamConfig{queued.streamId, queued.streamId < config.streamCount
+                                                                ? config.profileFor(queued.streamId)
+                                                                : queued.profile});
+        }
+        m_queue.clear();
+        
+        for (const auto& entry : m_info) {
+            const StreamInfo& info = entry.second;
+            if (info.state != StreamState::Playing) continue;
+            if (info.streamId >= config.streamCount && info.streamId < oldCount) {
+                // Dropped from the configured set
+                toStop.push_back(info.streamId);
+            } else if (info.streamId < config.streamCount) {
+                // Compared with what was asked for, so a downgraded stream is not restarted
+                StreamProfile profile = config.profileFor(info.streamId);
+                if (profile != info.requested) {
+                    toStop.push_back(info.streamId);
+                    toStart.push_back(StreamConfig{info.streamId, profile});
+                } else {
+                    ++unchanged;
+                }
+            }
+        }
+        // Streams the new count adds; ones stopped by hand below the old count stay stopped
+        for (int i = oldCount; i < config.streamCount; ++i) {
+            if (m_info.find(i) == m_info.end()) {
+                toStart.push_back(StreamConfig{i, config.profileFor(i)});
+            }
+        }
+    }
+    
+    std::cout << "Applying config: " << toStop.size() << " stream(s) to stop, " << toStart.size()
+              << " to start, " << unchanged << " unchanged" << std::endl;
+    for (int streamId : toStop) {
+        stopStream(streamId);
+    }
+    if (!toStart.empty()) {
+        startStreams(toStart);
+    }
+}
 
-    auto it = m_streams.find(streamId);
-    if (it != m_streams.end()) {
-        it->second->stop();
-        m_streams.erase(it);
-        std::cout << "Stopped stream " << streamId << std::endl;
-        return true;
+std::vector<StreamStartResult> StreamManager::startStreams(const std::vector<StreamConfig>& streams) {
+    auto batchStart = std::chrono::steady_clock::now();
+    std::vector<StreamStartResult> results;
+    std::vector<std::unique_ptr<GStreamerPipeline>> pipelines;
+    
+    // Reserve ids, ports and cores under the lock; building pipelines happens outside it
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        measureStreamCosts();
+        for (const StreamConfig& config : streams) {
+            results.emplace_back();
+            StreamStartResult& result = results.back();
+            result.streamId = config.streamId;
+            result.profile = config.profile;
+            auto existing = m_info.find(config.streamId);
+            if (existing != m_info.end()) {
+                if (existing->second.state == StreamState::Stopping) {
+                    std::cerr << "Stream " << config.streamId << " is still stopping" << std::endl;
+                } else if (existing->second.state == StreamState::Queued) {
+                    std::cout << "Stream " << config.streamId << " already queued" << std::endl;
+                    result.admission = Admission::Queued;
+                } else {
+                    std::cout << "Stream " << config.streamId << " already running" << std::endl;
+                    result.success = true;
+                    result.profile = existing->second.profile;
+                }
+                pipelines.push_back(nullptr);
+                continue;
+            }
+            
+            StreamProfile profile = config.profile;
+            result.admission = admit(profile);
+            result.profile = profile;
+            if (result.admission == Admission::Rejected) {
+                ++m_rejectedTotal;
+                pipelines.push_back(nullptr);
+                continue;
+            }
+            StreamInfo& info = m_info[config.streamId];
+            info.streamId = config.streamId;
+            info.port = profile.sinkPort;
+            info.profile = profile;
+            info.requested = config.profile;
+            info.downgraded = result.admission == Admission::Downgraded;
+            info.cost = m_costModel.cost(profile);
+            if (result.admission == Admission::Queued) {
+                info.state = StreamState::Queued;
+                m_queue.push_back(config);
+                pipelines.push_back(nullptr);
+                continue;
+            }
+            info.state = StreamState::Starting;
+            info.cpus.clear();
+            int cores = coresFor(profile);
+            if (m_config.cpuPinning && cores > 0) {
+                info.cpus = m_placement.place(config.streamId, cores, info.cost);
+            }
+            pipelines.push_back(std::make_unique<GStreamerPipeline>(
+                config.streamId, profile, m_busDispatcher));
+            pipelines.back()->setCpuAffinity(info.cpus);
+        }
+        publishSnapshot();
+    }
+    
+    // Pipeline bring-up mostly waits on state changes, so start them side by side
+    std::vector<std::thread> starters;
+    for (size_t i = 0; i < pipelines.size(); ++i) {
+        if (!pipelines[i]) continue;
+        starters.emplace_back([&, i]() {
+            auto start = std::chrono::steady_clock::now();
+            results[i].success = pipelines[i]->initialize();
+            results[i].startupMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        });
+    }
+    for (std::thread& starter : starters) {
+        starter.join();
+    }
+    
+    // Publish every pipeline that came up in one step
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        for (size_t i = 0; i < pipelines.size(); ++i) {
+            if (!pipelines[i]) continue;
+            int streamId = results[i].streamId;
+            if (results[i].success) {
+                StreamInfo& info = m_info[streamId];
+                info.state = StreamState::Playing;
+                info.startupMs = results[i].startupMs;
+                info.startedAt = std::chrono::system_clock::now();
+                info.mjpeg = pipelines[i]->getMjpegFanout();
+                info.mse = pipelines[i]->getMseFanout();
+                info.hls = pipelines[i]->getHlsPackager();
+                info.destinations = pipelines[i]->getDestinations();
+                monitorStream(info);
+                m_streams[streamId] = std::move(pipelines[i]);
+                ++m_startsTotal;
+            } else {
+                m_info.erase(streamId);
+                m_placement.release(streamId);
+                ++m_failedStartsTotal;
+            }
+        }
+        publishSnapshot();
+    }
+    
+    double totalMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - batchStart).count();
+    double sumMs = 0;
+    for (const StreamStartResult& result : results) {
+        if (result.admission != Admission::Admitted) {
+            std::cout << "Stream " << result.streamId << " " << admissionName(result.admission);
+            if (result.admission == Admission::Downgraded) {
+                std::cout << " to " << result.profile.width << "x" << result.profile.height << ", "
+                          << result.profile.bitrate << " kbit/s, " << result.profile.encoderPreset;
+            }
+            std::cout << " by admission control" << std::endl;
+        }
+        if (result.startupMs == 0) continue;    // was already running, queued or rejected
+        sumMs += result.startupMs;
+        if (result.success) {
+            std::cout << "Started GStreamer pipeline for stream " << result.streamId
+                      << " in " << result.startupMs << " ms" << std::endl;
+        } else {
+            std::cerr << "Failed to start GStreamer pipeline for stream " << result.streamId
+                      << " after " << result.startupMs << " ms" << std::endl;
+        }
+    }
+    if (streams.size() > 1) {
+        std::cout << "Stream startup: " << streams.size() << " streams in " << totalMs
+                  << " ms (" << sumMs << " ms if started one by one)" << std::endl;
     }
-    std::cout << "Stream " << streamId << " not found" << std::endl;
-    return false;
+    
+    // A failed start gave its budget back
+    bool anyFailed = std::any_of(results.begin(), results.end(), [](const StreamStartResult& result) {
+        return result.startupMs > 0 && !result.success;
+    });
+    if (anyFailed) {
+        startQueuedStreams();
+    }
+    
+    // Failed pipelines are torn down here, still outside the lock
+    return results;
 }
 
-bool StreamManager::isStreamActive(int streamId) {
-    std::lock_guard<std::mutex> lock(m_streamsMutex);
-    return m_streams.find(streamId) != m_streams.end();
+bool StreamManager::stopStream(int streamId) {
+    std::shared_ptr<GStreamerPipeline> pipeline;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        auto it = m_streams.find(streamId);
+        if (it == m_streams.end()) {
+            auto queued = std::find_if(m_queue.begin(), m_queue.end(),
+                                       [streamId](const StreamConfig& config) { return config.streamId == streamId; });
+            if (queued != m_queue.end()) {
+                m_queue.erase(queued);
+                m_info.erase(streamId);
+                publishSnapshot();
+                std::cout << "Removed stream " << streamId << " from the start queue" << std::endl;
+                return true;
+            }
+            std::cout << "Stream " << streamId << " not found" << std::endl;
+            return false;
+        }
+        pipeline = std::move(it->second);
+        m_streams.erase(it);
+        m_info[streamId].state = StreamState::Stopping;
+        publishSnapshot();
+    }
+    
+    // Tear down without the lock so readers and other streams are not held up
+    pipeline->stop();
+    pipeline.reset();
+    
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        if (m_info[streamId].rtp) {
+            m_monitor.removePort(m_info[streamId].port);
+        }
+        m_info.erase(streamId);
+        m_placement.release(streamId);
+        ++m_stopsTotal;
+        publishSnapshot();
+    }
+    std::cout << "Stopped stream " << streamId << std::endl;
+    startQueuedStreams();
+    return true;
 }
 
 void StreamManager::stopAllStreams() {
-    std::lock_guard<std::mutex> lock(m_streamsMutex);
-    for (auto& s : m_streams) {
+    std::map<int, std::shared_ptr<GStreamerPipeline>> stopping;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        stopping.swap(m_streams);
+        for (const StreamConfig& queued : m_queue) {
+            m_info.erase(queued.streamId);
+        }
+        m_queue.clear();
+        for (const auto& s : stopping) {
+            m_info[s.first].state = StreamState::Stopping;
+        }
+        publishSnapshot();
+    }
+    
+    for (auto& s : stopping) {
         s.second->stop();
         std::cout << "Stopped stream " << s.first << std::endl;
     }
-    m_streams.clear();
+    
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        for (const auto& s : stopping) {
+            if (m_info[s.first].rtp) {
+                m_monitor.removePort(m_info[s.first].port);
+            }
+            m_info.erase(s.first);
+            m_placement.release(s.first);
+            ++m_stopsTotal;
+        }
+        publishSnapshot();
+    }
+    stopping.clear();
     std::cout << "All streams stopped" << std::endl;
 }
 
-std::map<int, bool> StreamManager::getStreamStatus() {
+GStreamerPipeline::EncoderChange StreamManager::updateEncoder(int streamId, const EncoderUpdate& update,
+                                                              std::string& error) {
+    using EncoderChange = GStreamerPipeline::EncoderChange;
+    std::shared_ptr<GStreamerPipeline> pipeline;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        auto it = m_streams.find(streamId);
+        auto info = m_info.find(streamId);
+        if (it == m_streams.end() || info == m_info.end() || info->second.state != StreamState::Playing) {
+            error = "Stream not found or inactive";
+            return EncoderChange::Failed;
+        }
+        // A slower preset costs more; it must still fit next to the other streams
+        if (update.encoderPreset && m_config.admission != AdmissionPolicy::Off) {
+            StreamProfile profile = info->second.profile;
+            profile.encoderPreset = *update.encoderPreset;
+            double others = committedLoad() - info->second.cost;
+            if (others + m_costModel.cost(profile) > m_encodeBudget) {
+                error = "Preset " + profile.encoderPreset + " exceeds the encode budget";
+                return EncoderChange::Failed;
+            }
+        }
+        pipeline = it->second;
+    }
+    
+    // Outside the lock: the pipeline's own locks may be held across a state
+    // change. A reopen finishes on the streaming thread and reports back.
+    std::weak_ptr<GStreamerPipeline> weak = pipeline;
+    EncoderChange change = pipeline->updateEncoder(update, [this, streamId, weak](const StreamProfile& profile) {
+        if (std::shared_ptr<GStreamerPipeline> reopened = weak.lock()) {
+            applyProfile(streamId, reopened, profile);
+        }
+    });
+    if (change == EncoderChange::Busy) {
+        error = "An encoder change is still in progress";
+    } else if (change == EncoderChange::Failed) {
+        error = "Encoder update failed";
+    } else {
+        // Bitrate is applied either way; a pending reopen follows later
+        applyProfile(streamId, pipeline, pipeline->getProfile());
+    }
+    return change;
+}
+
+void StreamManager::applyProfile(int streamId, const std::shared_ptr<GStreamerPipeline>& pipeline,
+                                 const StreamProfile& profile) {
     std::lock_guard<std::mutex> lock(m_streamsMutex);
-    std::map<int, bool> status;
-    for (const auto& s : m_streams) {
-        status[s.first] = true;
+    auto it = m_streams.find(streamId);
+    auto info = m_info.find(streamId);
+    if (it == m_streams.end() || it->second != pipeline || info == m_info.end() ||
+        info->second.state != StreamState::Playing) {
+        return;
     }
-    return status;
+    if (profile.encoderPreset != info->second.profile.encoderPreset) {
+        // Estimated again until the next measurement
+        info->second.cost = m_costModel.cost(profile);
+        m_placement.updateCost(streamId, info->second.cost);
+    }
+    info->second.profile = profile;
+    publishSnapshot();
 }
 
-std::string StreamManager::getStreamUrl(int streamId) {
+bool StreamManager::addDestination(int streamId, size_t rendition, const RtpDestination& destination,
+                                   std::string& error) {
+    return editDestinations(streamId, rendition, destination, true, error);
+}
+
+bool StreamManager::removeDestination(int streamId, size_t rendition, const RtpDestination& destination,
+                                      std::string& error) {
+    return editDestinations(streamId, rendition, destination, false, error);
+}
+
+void StreamManager::monitorStream(StreamInfo& info) {
+    info.rtp.reset();
+    if (!m_config.rtpMonitor || !isLocalHost(info.profile.sinkHost)) {
+        return;
+    }
+    info.rtp = m_monitor.addPort(info.port);
+}
+
+bool StreamManager::editDestinations(int streamId, size_t rendition, const RtpDestination& destination, bool add,
+                                     std::string& error) {
+    std::shared_ptr<GStreamerPipeline> pipeline;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        auto it = m_streams.find(streamId);
+        if (it == m_streams.end()) {
+            error = "Stream not found or inactive";
+            return false;
+        }
+        pipeline = it->second;
+    }
+    
+    // Outside the lock: the pipeline's lock can be held across a state change
+    bool changed = add ? pipeline->addDestination(rendition, destination, error)
+                       : pipeline->removeDestination(rendition, destination, error);
+    if (!changed) {
+        return false;
+    }
+    std::cout << (add ? "Added " : "Removed ") << "RTP destination " << destination.host << ":" << destination.port
+              << " for stream " << streamId << std::endl;
+    
+    // Read before retaking the stream lock: the pipeline's lock can be held
+    // across a state change
+    std::vector<std::vector<RtpDestination>> destinations = pipeline->getDestinations();
     std::lock_guard<std::mutex> lock(m_streamsMutex);
     auto it = m_streams.find(streamId);
-    if (it != m_streams.end()) {
-        return it->second->getStreamUrl();
+    auto info = m_info.find(streamId);
+    if (it != m_streams.end() && it->second == pipeline && info != m_info.end() &&
+        info->second.state == StreamState::Playing) {
+        info->second.destinations = std::move(destinations);
+        publishSnapshot();
+    }
+    return true;
+}
+
+bool StreamManager::forceKeyframe(int streamId) {
+    std::shared_ptr<GStreamerPipeline> pipeline;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        auto it = m_streams.find(streamId);
+        if (it == m_streams.end()) {
+            return false;
+        }
+        pipeline = it->second;
+    }
+    return pipeline->forceKeyframe();
+}
+
+std::shared_ptr<const StreamSnapshot> StreamManager::getSnapshot() const {
+    return std::atomic_load(&m_snapshot);
+}
+
+bool StreamManager::isStreamActive(int streamId) const {
+    std::shared_ptr<const StreamSnapshot> snapshot = getSnapshot();
+    const StreamInfo* info = snapshot->find(streamId);
+    return info && info->state == StreamState::Playing;
+}
+
+std::map<int, bool> StreamManager::getStreamStatus() const {
+    std::shared_ptr<const StreamSnapshot> snapshot = getSnapshot();
+    std::map<int, bool> status;
+    for (const StreamInfo& info : snapshot->streams) {
+        if (info.state == StreamState::Playing) {
+            status[info.streamId] = true;
+        }
+    }
+    return status;
+}
+
+std::string StreamManager::getStreamUrl(int streamId) const {
+    std::shared_ptr<const StreamSnapshot> snapshot = getSnapshot();
+    const StreamInfo* info = snapshot->find(streamId);
+    if (info && info->state == StreamState::Playing) {
+        return "udp://" + info->profile.sinkHost + ":" + std::to_string(info->port);
     }
     return "";
 }
 
-int StreamManager::getNextAvailablePort() {
-    return m_nextPort++;
+std::shared_ptr<FrameFanout> StreamManager::getMjpegFanout(int streamId) const {
+    std::shared_ptr<const StreamSnapshot> snapshot = getSnapshot();
+    const StreamInfo* info = snapshot->find(streamId);
+    if (info && info->state == StreamState::Playing) {
+        return info->mjpeg;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<FrameFanout> StreamManager::getMseFanout(int streamId) const {
+    std::shared_ptr<const StreamSnapshot> snapshot = getSnapshot();
+    const StreamInfo* info = snapshot->find(streamId);
+    if (info && info->state == StreamState::Playing) {
+        return info->mse;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<HlsPackager> StreamManager::getHlsPackager(int streamId) const {
+    std::shared_ptr<const StreamSnapshot> snapshot = getSnapshot();
+    const StreamInfo* info = snapshot->find(streamId);
+    if (info && info->state == StreamState::Playing) {
+        return info->hls;
+    }
+    return nullptr;
+}
+
+void StreamManager::publishSnapshot() {
+    auto snapshot = std::make_shared<StreamSnapshot>();
+    snapshot->version = ++m_version;
+    snapshot->startsTotal = m_startsTotal;
+    snapshot->failedStartsTotal = m_failedStartsTotal;
+    snapshot->stopsTotal = m_stopsTotal;
+    snapshot->rejectedTotal = m_rejectedTotal;
+    snapshot->encodeBudget = m_encodeBudget;
+    snapshot->encodeLoad = committedLoad();
+    snapshot->streams.reserve(m_info.size());
+    for (const auto& entry : m_info) {
+        snapshot->streams.push_back(entry.second);
+    }
+    std::shared_ptr<const StreamSnapshot> previous = std::atomic_load(&m_snapshot);
+    std::atomic_store(&m_snapshot, std::shared_ptr<const StreamSnapshot>(snapshot));
+    
+    if (!m_stateListener || !previous) {
+        return;
+    }
+    // Both lists are sorted by id
+    auto before = previous->streams.begin();
+    for (const StreamInfo& stream : snapshot->streams) {
+        for (; before != previous->streams.end() && before->streamId < stream.streamId; ++before) {
+            m_stateListener(before->streamId, before->state, false);
+        }
+        if (before != previous->streams.end() && before->streamId == stream.streamId) {
+            if (before->state != stream.state) {
+                m_stateListener(stream.streamId, stream.state, true);
+            }
+            ++before;
+        } else {
+            m_stateListener(stream.streamId, stream.state, true);
+        }
+    }
+    for (; before != previous->streams.end(); ++before) {
+        m_stateListener(before->streamId, before->state, false);
+    }
+}
+
+void StreamManager::setStateListener(StateListener listener) {
+    std::lock_guard<std::mutex> lock(m_streamsMutex);
+    m_stateListener = std::move(listener);
+}
+
+void StreamManager::measureStreamCosts() {
+    auto now = std::chrono::system_clock::now();
+    for (const auto& entry : m_streams) {
+        StreamInfo& info = m_info[entry.first];
+        // cpuSeconds() cannot see x264 worker threads, so only single-threaded
+        // encodes are measured; the others keep their calibrated cost
+        if (info.profile.encoderThreads != 1) {
+            continue;
+        }
+        double age = std::chrono::duration<double>(now - info.startedAt).count();
+        if (age < MIN_COST_SAMPLE_SECONDS) {
+            continue;
+        }
+        double cost = entry.second->cpuSeconds() / age;
+        if (cost <= 0) {
+            continue;
+        }
+        info.cost = cost;
+        m_placement.updateCost(entry.first, cost);
+        m_costModel.observe(info.profile, cost);
+    }
+}
+
+void StreamManager::calibrateCostModel() {
+    std::vector<StreamProfile> calibrated;
+    for (int i = 0; i < m_config.streamCount && calibrated.size() < MAX_CALIBRATIONS; ++i) {
+        StreamProfile profile = m_config.profileFor(i);
+        // Where a stream is sent does not change what it costs to encode
+        profile.sinkHost = StreamProfile().sinkHost;
+        profile.sinkPort = 0;
+        if (std::find(calibrated.begin(), calibrated.end(), profile) == calibrated.end()) {
+            m_costModel.calibrate(profile);
+            calibrated.push_back(profile);
+        }
+    }
+}
+
+Admission StreamManager::admit(StreamProfile& profile) {
+    if (m_config.admission == AdmissionPolicy::Off) {
+        return Admission::Admitted;
+    }
+    double available = m_encodeBudget - committedLoad();
+    if (m_costModel.cost(profile) <= available) {
+        return Admission::Admitted;
+    }
+    switch (m_config.admission) {
+        case AdmissionPolicy::Downgrade:
+            for (const StreamProfile& candidate : downgradeLadder(profile)) {
+                if (m_costModel.cost(candidate) <= available) {
+                    profile = candidate;
+                    return Admission::Downgraded;
+                }
+            }
+            return Admission::Rejected;
+        case AdmissionPolicy::Queue:
+            return Admission::Queued;
+        default:
+            return Admission::Rejected;
+    }
+}
+
+double StreamManager::committedLoad() const {
+    double load = 0;
+    for (const auto& entry : m_info) {
+        if (entry.second.state == StreamState::Starting || entry.second.state == StreamState::Playing) {
+            load += entry.second.cost;
+        }
+    }
+    return load;
+}
+
+void StreamManager::startQueuedStreams() {
+    std::vector<StreamConfig> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        double available = m_encodeBudget - committedLoad();
+        // In arrival order; a large stream at the front is not overtaken
+        while (!m_queue.empty()) {
+            double cost = m_costModel.cost(m_queue.front().profile);
+            if (cost > available) {
+                break;
+            }
+            available -= cost;
+            ready.push_back(m_queue.front());
+            m_info.erase(m_queue.front().streamId);
+            m_queue.pop_front();
+        }
+        if (ready.empty()) {
+            return;
+        }
+        publishSnapshot();
+    }
+    std::cout << "Starting " << ready.size() << " queued stream(s)" << std::endl;
+    startStreams(ready);
 }
@@ -1,29 +1,186 @@
-#pragma once
-
-#include <map>
-#include <memory>
-#include <mutex>
-#include <atomic>
-#include "GStreamerPipeline.h"
-
-class StreamManager {
-public:
-    StreamManager();
-    ~StreamManager();
-    
-    bool startStream(int streamId, int width, int height, int framerate);
-    bool stopStream(int streamId);
-    bool isStreamActive(int streamId);
-    void stopAllStreams();
-    
-    std::map<int, bool> getStreamStatus();
-    std::string getStreamUrl(int streamId);
-    
-private:
-    std::map<int, std::unique_ptr<GStreamerPipeline>> m_streams;
-    std::mutex m_streamsMutex;
-    std::atomic<int> m_nextPort;
-    
-    int getNextAvailablePort();
-};
-
+#pragma once
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "GStreamerPipeline.h"
+#include "BusDispatcher.h"
+#include "Config.h"
+#include "CpuPlacement.h"
+#include "EncoderCostModel.h"
+#include "PassiveStreamMonitor.h"
+
+struct StreamConfig {
+    int streamId;
+    StreamProfile profile;
+};
+
+// Admission control's decision for a stream that asked to start
+enum class Admission { Admitted, Downgraded, Queued, Rejected };
+
+inline const char* admissionName(Admission admission) {
+    switch (admission) {
+        case Admission::Admitted: return "admitted";
+        case Admission::Downgraded: return "downgraded";
+        case Admission::Queued: return "queued";
+        case Admission::Rejected: return "rejected";
+    }
+    return "unknown";
+}
+
+struct StreamStartResult {
+    int streamId{0};
+    bool success{false};
+    double startupMs{0};    // time spent bringing the pipeline to PLAYING
+    Admission admission{Admission::Admitted};
+    StreamProfile profile;  // as started, after any downgrade
+};
+
+enum class StreamState { Queued, Starting, Playing, Stopping };
+
+inline const char* streamStateName(StreamState state) {
+    switch (state) {
+        case StreamState::Queued: return "queued";
+        case StreamState::Starting: return "starting";
+        case StreamState::Playing: return "playing";
+        case StreamState::Stopping: return "stopping";
+    }
+    return "unknown";
+}
+
+// One stream as of the snapshot it belongs to
+struct StreamInfo {
+    int streamId{0};
+    int port{0};
+    StreamProfile profile;                          // what the pipeline runs
+    StreamProfile requested;                        // as configured, before any downgrade
+    StreamState state{StreamState::Starting};
+    bool downgraded{false};                         // by admission control
+    double cost{0};                                 // cores; estimated until measured
+    std::vector<int> cpus;                          // empty when not pinned
+    double startupMs{0};                            // 0 until playing
+    std::chrono::system_clock::time_point startedAt;
+    std::shared_ptr<FrameFanout> mjpeg;             // null until playing
+    std::shared_ptr<FrameFanout> mse;               // fMP4 over WebSocket; null until playing
+    std::shared_ptr<HlsPackager> hls;               // null until playing, or with hls off
+    std::vector<std::vector<RtpDestination>> destinations;  // RTP receivers per rendition; empty until playing
+    std::shared_ptr<const PortActivity> rtp;        // received on the sink port; null unless monitored
+};
+
+// Immutable view of every known stream, sorted by id. StreamManager
+// publishes a new one after each change; readers load the current pointer
+// without taking the stream lock, so polls never wait on a pipeline state
+// change and lookups do not allocate.
+struct StreamSnapshot {
+    uint64_t version{0};
+    uint64_t startsTotal{0};
+    uint64_t failedStartsTotal{0};
+    uint64_t stopsTotal{0};
+    uint64_t rejectedTotal{0};
+    double encodeBudget{0};                         // cores admission control may fill
+    double encodeLoad{0};                           // cores committed to starting/playing streams
+    std::vector<StreamInfo> streams;
+
+    const StreamInfo* find(int streamId) const;
+};
+
+class StreamManager {
+public:
+    explicit StreamManager(const VmsConfig& config = VmsConfig());
+    ~StreamManager();
+    
+    // Start with the stream's profile from the current config. Subject to
+    // admission control, which may downgrade, queue or reject the stream.
+    StreamStartResult startStream(int streamId);
+    StreamStartResult startStream(int streamId, const StreamProfile& profile);
+    // Start streams 0..count-1 of the current config
+    std::vector<StreamStartResult> startConfiguredStreams();
+    // Hot reload: restart only playing streams whose profile changed, start
+    // streams the new count adds and stop the ones it removes
+    void applyConfig(const VmsConfig& config);
+    // Bring several pipelines up concurrently, outside the stream map lock;
+    // each one becomes visible only once it is playing
+    std::vector<StreamStartResult> startStreams(const std::vector<StreamConfig>& streams);
+    bool stopStream(int streamId);
+    void stopAllStreams();
+    
+    // Retune a playing stream's encoder without restarting it. A GOP or
+    // preset change returns Pending and reaches the snapshot once the
+    // encoder has switched; `error` is set for Busy and Failed.
+    GStreamerPipeline::EncoderChange updateEncoder(int streamId, const EncoderUpdate& update, std::string& error);
+    bool forceKeyframe(int streamId);
+    // Add or drop a receiver of one rendition of a playing stream. Edits
+    // last until the stream restarts; config/vms.conf holds permanent ones.
+    bool addDestination(int streamId, size_t rendition, const RtpDestination& destination, std::string& error);
+    bool removeDestination(int streamId, size_t rendition, const RtpDestination& destination, std::string& error);
+    
+    // Called with the stream lock held whenever a stream appears, changes
+    // state or goes away (exists false); must not call back into the manager
+    using StateListener = std::function<void(int streamId, StreamState state, bool exists)>;
+    void setStateListener(StateListener listener);
+    
+    // Lock-free readers
+    std::shared_ptr<const StreamSnapshot> getSnapshot() const;
+    bool isStreamActive(int streamId) const;
+    std::map<int, bool> getStreamStatus() const;
+    std::string getStreamUrl(int streamId) const;
+    // Null if the stream is not playing
+    std::shared_ptr<FrameFanout> getMjpegFanout(int streamId) const;
+    std::shared_ptr<HlsPackager> getHlsPackager(int streamId) const;
+    std::shared_ptr<FrameFanout> getMseFanout(int streamId) const;
+    
+private:
+    // Declared first so it outlives every pipeline watching through it
+    BusDispatcher m_busDispatcher;
+    // One thread receiving every monitored stream port
+    PassiveStreamMonitor m_monitor;
+    
+    // Writer state, guarded by m_streamsMutex. The lock is never held across
+    // a pipeline state change.
+    // Shared so an encoder update can finish while the stream is being stopped
+    std::map<int, std::shared_ptr<GStreamerPipeline>> m_streams;
+    std::map<int, StreamInfo> m_info;       // every stream starting, playing or stopping
+    uint64_t m_startsTotal{0};
+    uint64_t m_failedStartsTotal{0};
+    uint64_t m_stopsTotal{0};
+    uint64_t m_rejectedTotal{0};
+    uint64_t m_version{0};
+    VmsConfig m_config;
+    CpuPlacement m_placement;
+    EncoderCostModel m_costModel;
+    double m_encodeBudget{0};               // cores
+    std::deque<StreamConfig> m_queue;       // waiting for budget, first come first served
+    std::mutex m_streamsMutex;
+    
+    std::shared_ptr<const StreamSnapshot> m_snapshot;   // accessed with std::atomic_load/store
+    StateListener m_stateListener;                      // guarded by m_streamsMutex
+    
+    // Caller holds m_streamsMutex
+    void publishSnapshot();
+    // Feed each running stream's measured CPU use back into the placement
+    // and the cost model. Caller holds m_streamsMutex.
+    void measureStreamCosts();
+    // Benchmark each distinct configured profile once; before any stream runs
+    void calibrateCostModel();
+    // Decide whether a stream fits the budget, possibly lowering its
+    // profile. Caller holds m_streamsMutex.
+    Admission admit(StreamProfile& profile);
+    // Cores used by starting and playing streams. Caller holds m_streamsMutex.
+    double committedLoad() const;
+    // Start queued streams that fit now that a stream went away
+    void startQueuedStreams();
+    // Watch the stream's RTP if it is sent to this host and monitoring is
+    // on. Caller holds m_streamsMutex.
+    void monitorStream(StreamInfo& info);
+    bool editDestinations(int streamId, size_t rendition, const RtpDestination& destination, bool add,
+                          std::string& error);
+    // Record the profile a pipeline reports as running, if it is still the
+    // stream's. Takes m_streamsMutex.
+    void applyProfile(int streamId, const std::shared_ptr<GStreamerPipeline>& pipeline, const StreamProfile& profile);
+};
+
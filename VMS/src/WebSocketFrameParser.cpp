@@ -0,0 +1,107 @@
+#include "WebSocketFrameParser.h"
+
+namespace {
+constexpr size_t MAX_CONTROL_PAYLOAD = 125;
+
+bool isControl(uint8_t opcode) {
+    return (opcode & 0x8) != 0;
+}
+
+bool isKnown(uint8_t opcode) {
+    return opcode <= 0x2 || (opcode >= 0x8 && opcode <= 0xA);
+}
+}
+
+WebSocketFrameParser::Result WebSocketFrameParser::parse(char* data, size_t size, WebSocketMessage& message,
+                                                         size_t& consumed) {
+    if (m_errorCode != 0) {
+        return Result::Error;
+    }
+    
+    consumed = 0;
+    if (m_fragmentOpcode == WebSocketOpcode::Continuation) {
+        m_fragments.clear();                    // the last message has been handled
+    }
+    while (true) {
+        const uint8_t* frame = reinterpret_cast<const uint8_t*>(data + consumed);
+        size_t available = size - consumed;
+        if (available < 2) {
+            return Result::Incomplete;
+        }
+        
+        bool fin = (frame[0] & 0x80) != 0;
+        uint8_t opcode = frame[0] & 0x0F;
+        if ((frame[0] & 0x70) != 0 || !isKnown(opcode)) {
+            return fail(CLOSE_PROTOCOL_ERROR);  // no extensions are negotiated
+        }
+        if ((frame[1] & 0x80) == 0) {
+            return fail(CLOSE_PROTOCOL_ERROR);  // clients must mask every frame
+        }
+        
+        size_t headerSize = 2;
+        uint64_t length = frame[1] & 0x7F;
+        if (length == 126) {
+            headerSize = 4;
+            if (available < headerSize) return Result::Incomplete;
+            length = (static_cast<uint64_t>(frame[2]) << 8) | frame[3];
+        } else if (length == 127) {
+            headerSize = 10;
+            if (available < headerSize) return Result::Incomplete;
+            length = 0;
+            for (int i = 2; i < 10; ++i) {
+                length = (length << 8) | frame[i];
+            }
+            if (length >> 63) {
+                return fail(CLOSE_PROTOCOL_ERROR);
+            }
+        }
+        
+        if (isControl(opcode) && (!fin || length > MAX_CONTROL_PAYLOAD)) {
+            return fail(CLOSE_PROTOCOL_ERROR);
+        }
+        if (!isControl(opcode)) {
+            bool continuation = opcode == 0x0;
+            bool inMessage = m_fragmentOpcode != WebSocketOpcode::Continuation;
+            if (continuation != inMessage) {
+                return fail(CLOSE_PROTOCOL_ERROR);  // stray continuation or unfinished message
+            }
+            if (length > MAX_MESSAGE_SIZE - m_fragments.size()) {
+                return fail(CLOSE_TOO_BIG);
+            }
+        }
+        
+        headerSize += 4;                            // masking key
+        if (available < headerSize || available - headerSize < length) {
+            return Result::Incomplete;
+        }
+        const uint8_t* mask = frame + headerSize - 4;
+        char* payload = data + consumed + headerSize;
+        for (size_t i = 0; i < length; ++i) {
+            payload[i] ^= static_cast<char>(mask[i & 3]);
+        }
+        consumed += headerSize + length;
+        std::string_view bytes(payload, length);
+        
+        if (isControl(opcode) || (fin && opcode != 0x0)) {
+            // Control frames and unfragmented messages need no copy
+            message.opcode = static_cast<WebSocketOpcode>(opcode);
+            message.payload = bytes;
+            return Result::Complete;
+        }
+        if (opcode != 0x0) {
+            m_fragmentOpcode = static_cast<WebSocketOpcode>(opcode);
+        }
+        m_fragments.append(bytes);
+        if (fin) {
+            message.opcode = m_fragmentOpcode;
+            message.payload = m_fragments;
+            m_fragmentOpcode = WebSocketOpcode::Continuation;
+            return Result::Complete;
+        }
+    }
+}
+
+WebSocketFrameParser::Result WebSocketFrameParser::fail(uint16_t code) {
+    m_errorCode = code;
+    return Result::Error;
+}
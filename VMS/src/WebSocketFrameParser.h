@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+// RFC 6455 frame opcodes
+enum class WebSocketOpcode : uint8_t {
+    Continuation = 0x0,
+    Text = 0x1,
+    Binary = 0x2,
+    Close = 0x8,
+    Ping = 0x9,
+    Pong = 0xA
+};
+
+// A message or control frame from a client. The payload is unmasked and
+// stays valid only until the next parse() call or until the receive buffer
+// is compacted.
+struct WebSocketMessage {
+    WebSocketOpcode opcode{WebSocketOpcode::Text};
+    std::string_view payload;
+};
+
+// Incremental reader of client frames. Checks masking and framing rules,
+// reassembles fragmented messages, and hands control frames (which may
+// arrive between fragments) back as they come.
+class WebSocketFrameParser {
+public:
+    // Dashboard clients only send small JSON commands
+    static constexpr size_t MAX_MESSAGE_SIZE = 64 * 1024;
+
+    // RFC 6455 close status codes
+    static constexpr uint16_t CLOSE_NORMAL = 1000;
+    static constexpr uint16_t CLOSE_PROTOCOL_ERROR = 1002;
+    static constexpr uint16_t CLOSE_TOO_BIG = 1009;
+
+    enum class Result {
+        Incomplete,   // need more bytes
+        Complete,     // message filled in, `consumed` bytes belong to it
+        Error         // protocol violation, see errorCode()
+    };
+
+    // Parse from the start of data[0, size), unmasking payloads in place.
+    // Fragments are copied aside as they arrive, so `consumed` bytes must be
+    // dropped from the buffer whatever the result, Incomplete included.
+    Result parse(char* data, size_t size, WebSocketMessage& message, size_t& consumed);
+
+    // Close status to send after an Error
+    uint16_t errorCode() const { return m_errorCode; }
+
+private:
+    std::string m_fragments;                    // payload of an unfinished message
+    WebSocketOpcode m_fragmentOpcode{WebSocketOpcode::Continuation};    // Continuation when none
+    uint16_t m_errorCode{0};
+
+    Result fail(uint16_t code);
+};
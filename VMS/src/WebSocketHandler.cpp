@@ -1,37 +1,50 @@
 #include "WebSocketHandler.h"
 #include "StreamManager.h"
+#include "Router.h"
 #include <iostream>
 #include <sstream>
-#include <regex>
+#include <chrono>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
 #include <openssl/bio.h>
 #include <openssl/buffer.h>
-#include <unistd.h>
-#include <sys/socket.h>
 
 WebSocketHandler::WebSocketHandler(StreamManager* streamManager)
     : m_streamManager(streamManager) {
+    m_flushThread = std::thread(&WebSocketHandler::flushLoop, this);
+    if (m_streamManager) {
+        // Push every state change instead of having the dashboard poll
+        m_streamManager->setStateListener([this](int streamId, StreamState state, bool exists) {
+            bool active = exists && state == StreamState::Playing;
+            broadcastStreamUpdate(streamId, active, exists ? streamStateName(state) : "stopped");
+        });
+    }
 }
 
 WebSocketHandler::~WebSocketHandler() {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
-    for (auto& pair : m_connections) {
-        close(pair.first);
+    if (m_streamManager) {
+        m_streamManager->setStateListener(nullptr);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_updatesMutex);
+        m_stopping = true;
     }
+    m_updatesCondition.notify_one();
+    if (m_flushThread.joinable()) {
+        m_flushThread.join();
+    }
+    // The sockets belong to the HTTP server, which closes them
+    std::lock_guard<std::mutex> lock(m_connectionsMutex);
     m_connections.clear();
 }
 
-std::string WebSocketHandler::handleWebSocketUpgrade(const std::string& request) {
+std::string WebSocketHandler::handleWebSocketUpgrade(const HttpRequest& request) {
     // Extract WebSocket key
-    std::regex keyRegex("Sec-WebSocket-Key: ([A-Za-z0-9+/=]+)");
-    std::smatch matches;
-    
-    if (!std::regex_search(request, matches, keyRegex)) {
-        return "HTTP/1.1 400 Bad Request\r\n\r\n";
+    std::string key = generateWebSocketKey(request);
+    if (key.empty()) {
+        return "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
     }
     
-    std::string key = matches[1].str();
     std::string accept = createWebSocketAccept(key);
     
     // Create WebSocket response
@@ -45,27 +58,118 @@ std::string WebSocketHandler::handleWebSocketUpgrade(const std::string& request)
     return response.str();
 }
 
-void WebSocketHandler::broadcastStreamUpdate(int streamId, bool active) {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
-    
-    std::ostringstream message;
-    message << "{\"type\":\"stream_update\",\"streamId\":" << streamId 
-            << ",\"active\":" << (active ? "true" : "false") << "}";
-    
-    for (auto& pair : m_connections) {
-        sendWebSocketMessage(pair.first, message.str());
+void WebSocketHandler::broadcastStreamUpdate(int streamId, bool active, std::string_view state) {
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(m_updatesMutex);
+        first = m_pendingUpdates.empty();
+        StreamUpdate& update = m_pendingUpdates[streamId];
+        update.active = active;
+        update.state.assign(state);
+    }
+    if (first) {
+        m_updatesCondition.notify_one();
     }
 }
 
-std::string WebSocketHandler::generateWebSocketKey(const std::string& request) {
-    std::regex keyRegex("Sec-WebSocket-Key: ([A-Za-z0-9+/=]+)");
-    std::smatch matches;
+void WebSocketHandler::flushLoop() {
+    std::unique_lock<std::mutex> lock(m_updatesMutex);
+    while (true) {
+        m_updatesCondition.wait(lock, [this] { return m_stopping || !m_pendingUpdates.empty(); });
+        if (m_stopping) {
+            return;
+        }
+        // Let the rest of a burst (start all, stop all) arrive first
+        m_updatesCondition.wait_for(lock, std::chrono::milliseconds(COALESCE_INTERVAL_MS),
+                                    [this] { return m_stopping; });
+        std::map<int, StreamUpdate> updates;
+        updates.swap(m_pendingUpdates);
+        lock.unlock();
+        deliverUpdates(updates);
+        lock.lock();
+    }
+}
+
+void WebSocketHandler::deliverUpdates(const std::map<int, StreamUpdate>& updates) {
+    std::vector<std::pair<int, std::shared_ptr<Peer>>> peers;
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        peers.reserve(m_connections.size());
+        for (const auto& pair : m_connections) {
+            peers.emplace_back(pair.second.streamId, pair.second.peer);
+        }
+    }
     
-    if (std::regex_search(request, matches, keyRegex)) {
-        return matches[1].str();
+    // Encoded once per distinct subscription, not per session
+    std::map<int, std::shared_ptr<const std::string>> frames;
+    for (const auto& peer : peers) {
+        int streamId = peer.first;
+        if (streamId >= 0 && updates.find(streamId) == updates.end()) {
+            continue;
+        }
+        std::shared_ptr<const std::string>& frame = frames[streamId];
+        if (!frame) {
+            frame = std::make_shared<const std::string>(encodeUpdates(updates, streamId));
+        }
+        peer.second->send(frame);
+    }
+}
+
+std::string WebSocketHandler::encodeUpdates(const std::map<int, StreamUpdate>& updates, int streamId) {
+    auto appendUpdate = [](std::string& json, int id, const StreamUpdate& update) {
+        json += "\"streamId\":";
+        json += std::to_string(id);
+        json += ",\"active\":";
+        json += update.active ? "true" : "false";
+        json += ",\"state\":\"";
+        json += update.state;
+        json += "\"";
+    };
+    
+    // A lone change keeps the single-update message; bursts become a list
+    std::string json;
+    if (streamId >= 0 || updates.size() == 1) {
+        auto it = streamId >= 0 ? updates.find(streamId) : updates.begin();
+        json = "{\"type\":\"stream_update\",";
+        appendUpdate(json, it->first, it->second);
+        json += "}";
+    } else {
+        json = "{\"type\":\"stream_updates\",\"updates\":[";
+        bool first = true;
+        for (const auto& entry : updates) {
+            json += first ? "{" : ",{";
+            appendUpdate(json, entry.first, entry.second);
+            json += "}";
+            first = false;
+        }
+        json += "]}";
     }
     
-    return "";
+    std::string frame;
+    appendFrame(frame, WebSocketOpcode::Text, json);
+    return frame;
+}
+
+void WebSocketHandler::addConnection(uint64_t id, std::shared_ptr<Peer> peer) {
+    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+    m_connections[id].peer = std::move(peer);
+}
+
+void WebSocketHandler::removeConnection(uint64_t id) {
+    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+    m_connections.erase(id);
+}
+
+std::string WebSocketHandler::generateWebSocketKey(const HttpRequest& request) {
+    std::string_view key = request.header("Sec-WebSocket-Key");
+    for (char c : key) {
+        bool base64 = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                      (c >= '0' && c <= '9') || c == '+' || c == '/' || c == '=';
+        if (!base64) {
+            return "";
+        }
+    }
+    return std::string(key);
 }
 
 std::string WebSocketHandler::createWebSocketAccept(const std::string& key) {
@@ -96,46 +200,53 @@ std::string WebSocketHandler::base64Encode(const std::string& input) {
     return result;
 }
 
-void WebSocketHandler::handleWebSocketMessage(int clientSocket, const std::string& message) {
+void WebSocketHandler::handleWebSocketMessage(uint64_t id, std::string_view message) {
     // Simple JSON message handling
-    if (message.find("\"type\":\"subscribe\"") != std::string::npos) {
-        std::regex streamRegex("\"streamId\":(\\d+)");
-        std::smatch matches;
-        if (std::regex_search(message, matches, streamRegex)) {
-            int streamId = std::stoi(matches[1].str());
-            std::lock_guard<std::mutex> lock(m_connectionsMutex);
-            m_connections[clientSocket] = streamId;
+    if (message.find("\"type\":\"subscribe\"") != std::string_view::npos) {
+        const std::string_view key = "\"streamId\":";
+        size_t pos = message.find(key);
+        if (pos != std::string_view::npos) {
+            size_t start = pos + key.length();
+            size_t end = message.find_first_not_of("0123456789", start);
+            int streamId = 0;
+            if (routing::parseInt(message.substr(start, end - start), streamId)) {
+                std::lock_guard<std::mutex> lock(m_connectionsMutex);
+                auto it = m_connections.find(id);
+                if (it != m_connections.end()) {
+                    it->second.streamId = streamId;
+                }
+            }
         }
     }
 }
 
-void WebSocketHandler::sendWebSocketMessage(int clientSocket, const std::string& message) {
-    // Simple WebSocket frame (no masking for server)
-    std::ostringstream frame;
-    
-    // FIN + opcode (text frame)
-    frame << static_cast<char>(0x81);
+void WebSocketHandler::appendFrame(std::string& out, WebSocketOpcode opcode, std::string_view payload) {
+    // FIN + opcode; server frames are never masked
+    out.reserve(out.size() + payload.size() + 10);
+    out.push_back(static_cast<char>(0x80 | static_cast<uint8_t>(opcode)));
     
     // Payload length
-    if (message.length() < 126) {
-        frame << static_cast<char>(message.length());
-    } else if (message.length() < 65536) {
-        frame << static_cast<char>(126);
-        frame << static_cast<char>((message.length() >> 8) & 0xFF);
-        frame << static_cast<char>(message.length() & 0xFF);
+    uint64_t length = payload.size();
+    if (length < 126) {
+        out.push_back(static_cast<char>(length));
+    } else if (length < 65536) {
+        out.push_back(static_cast<char>(126));
+        out.push_back(static_cast<char>((length >> 8) & 0xFF));
+        out.push_back(static_cast<char>(length & 0xFF));
+    } else {
+        out.push_back(static_cast<char>(127));
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<char>((length >> shift) & 0xFF));
+        }
     }
     
     // Payload
-    frame << message;
-    
-    send(clientSocket, frame.str().c_str(), frame.str().length(), 0);
+    out.append(payload);
 }
 
-void WebSocketHandler::closeConnection(int clientSocket) {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
-    auto it = m_connections.find(clientSocket);
-    if (it != m_connections.end()) {
-        m_connections.erase(it);
-    }
-    close(clientSocket);
+std::string WebSocketHandler::closeFrame(uint16_t code) {
+    char status[2] = {static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+    std::string frame;
+    appendFrame(frame, WebSocketOpcode::Close, std::string_view(status, sizeof(status)));
+    return frame;
 }
@@ -1,32 +1,87 @@
-#pragma once
-
-#include <string>
-#include <map>
-#include <functional>
-#include <thread>
-#include <atomic>
-#include <mutex>
-
-class StreamManager;
-
-class WebSocketHandler {
-public:
-    WebSocketHandler(StreamManager* streamManager);
-    ~WebSocketHandler();
-    
-    std::string handleWebSocketUpgrade(const std::string& request);
-    void broadcastStreamUpdate(int streamId, bool active);
-    
-private:
-    StreamManager* m_streamManager;
-    std::map<int, int> m_connections;  // client socket -> stream id
-    std::mutex m_connectionsMutex;
-    
-    std::string generateWebSocketKey(const std::string& request);
-    std::string createWebSocketAccept(const std::string& key);
-    std::string base64Encode(const std::string& input);
-    void handleWebSocketMessage(int clientSocket, const std::string& message);
-    void sendWebSocketMessage(int clientSocket, const std::string& message);
-    void closeConnection(int clientSocket);
-};
-
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdint>
+#include "HttpRequestParser.h"
+#include "WebSocketFrameParser.h"
+
+class StreamManager;
+
+// Dashboard WebSocket sessions. The HTTP server keeps upgraded sockets in
+// its event loop and reads their frames; this class tracks the open
+// sessions, answers their commands and pushes stream state changes to them.
+// Changes are coalesced per tick: each tick's updates are encoded into one
+// shared frame (one per distinct subscription) and handed to every session.
+class WebSocketHandler {
+public:
+    // Updates arriving within this long of the first go out as one frame
+    static constexpr int COALESCE_INTERVAL_MS = 50;
+
+    // One open session, as seen from here. send() may be called from any
+    // thread; the frame is shared, not copied, and the owning worker writes
+    // it out.
+    class Peer {
+    public:
+        virtual ~Peer() = default;
+        virtual void send(std::shared_ptr<const std::string> frame) = 0;
+    };
+
+    WebSocketHandler(StreamManager* streamManager);
+    ~WebSocketHandler();
+    
+    std::string handleWebSocketUpgrade(const HttpRequest& request);
+    // Queue a state change for the next tick; cheap enough to call with the
+    // stream lock held. A later change of the same stream replaces it.
+    void broadcastStreamUpdate(int streamId, bool active, std::string_view state);
+    
+    // Sessions come and go with their sockets
+    void addConnection(uint64_t id, std::shared_ptr<Peer> peer);
+    void removeConnection(uint64_t id);
+    // A complete text message from a session
+    void handleWebSocketMessage(uint64_t id, std::string_view message);
+    
+    // Append one unmasked, unfragmented server frame; payloads of any size
+    // get the 16- or 64-bit extended length
+    static void appendFrame(std::string& out, WebSocketOpcode opcode, std::string_view payload);
+    // Close frame carrying a status code
+    static std::string closeFrame(uint16_t code);
+    
+private:
+    struct Connection {
+        std::shared_ptr<Peer> peer;
+        int streamId{-1};               // updates of this stream only; -1 for all
+    };
+
+    struct StreamUpdate {
+        bool active{false};
+        std::string state;
+    };
+
+    StreamManager* m_streamManager;
+    std::map<uint64_t, Connection> m_connections;  // session id -> session
+    std::mutex m_connectionsMutex;
+    
+    std::map<int, StreamUpdate> m_pendingUpdates;  // stream id -> latest change this tick
+    std::mutex m_updatesMutex;
+    std::condition_variable m_updatesCondition;
+    bool m_stopping{false};
+    std::thread m_flushThread;
+    
+    void flushLoop();
+    void deliverUpdates(const std::map<int, StreamUpdate>& updates);
+    // One text frame with the updates, or only `streamId`'s when it is not -1
+    static std::string encodeUpdates(const std::map<int, StreamUpdate>& updates, int streamId);
+    
+    std::string generateWebSocketKey(const HttpRequest& request);
+    std::string createWebSocketAccept(const std::string& key);
+    std::string base64Encode(const std::string& input);
+};
@@ -3,37 +3,81 @@
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <vector>
+#include <string>
+#include <fstream>
 #include "HttpServer.h"
 #include "StreamManager.h"
+#include "Config.h"
 #include <gst/gst.h>
 
 std::unique_ptr<HttpServer> g_server;
 std::unique_ptr<StreamManager> g_streamManager;
 static volatile sig_atomic_t g_shutdownRequested = 0;
+static volatile sig_atomic_t g_reloadRequested = 0;
 
 void signalHandler(int /*signum*/) {
     g_shutdownRequested = 1;
 }
 
-int main() {
+void reloadHandler(int /*signum*/) {
+    g_reloadRequested = 1;
+}
+
+// Re-read the config and restart only the streams whose settings changed
+void reloadConfig(const std::string& configPath, const VmsConfig& current) {
+    VmsConfig config;
+    std::string error;
+    if (!ConfigLoader::loadFile(configPath, config, error)) {
+        std::cerr << "Config reload failed, keeping current settings: " << error << std::endl;
+        return;
+    }
+    if (config.host != current.host || config.port != current.port ||
+        config.httpThreads != current.httpThreads || config.cacheControl != current.cacheControl ||
+        config.cacheControlImmutable != current.cacheControlImmutable) {
+        std::cout << "[server] and thread_pool_size changes take effect after a restart" << std::endl;
+    }
+    g_streamManager->applyConfig(config);
+}
+
+int main(int argc, char* argv[]) {
     // Set up signal handlers
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
+    // kill -HUP <pid> reloads the config file
+    signal(SIGHUP, reloadHandler);
+    // Peers closing mid-response must surface as EPIPE, not kill the process
+    signal(SIGPIPE, SIG_IGN);
     
     std::cout << "Starting Video Management System..." << std::endl;
     
+    // Optional first argument: config file path
+    std::string configPath = argc > 1 ? argv[1] : ConfigLoader::DEFAULT_PATH;
+    VmsConfig config;
+    std::string configError;
+    if (ConfigLoader::loadFile(configPath, config, configError)) {
+        std::cout << "Loaded configuration from " << configPath << std::endl;
+    } else if (argc > 1 || std::ifstream(configPath)) {
+        // An explicit or existing but broken config is fatal; a missing default is not
+        std::cerr << "Error: " << configError << std::endl;
+        return 1;
+    } else {
+        std::cout << "No configuration at " << configPath << ", using defaults" << std::endl;
+    }
+    
     try {
         // Initialize GStreamer once
         gst_init(nullptr, nullptr);
         
         // Initialize stream manager
-        g_streamManager = std::make_unique<StreamManager>();
+        g_streamManager = std::make_unique<StreamManager>(config);
         
-        // Initialize HTTP server for Ubuntu deployment
-        std::string host = "0.0.0.0";  // Bind to all interfaces
-        int port = 8080;
+        // Initialize HTTP server ([server] host/port, 0.0.0.0 binds to all interfaces)
+        std::string host = config.host;
+        int port = config.port;
         
-        g_server = std::make_unique<HttpServer>(host, port, g_streamManager.get());
+        g_server = std::make_unique<HttpServer>(host, port, g_streamManager.get(), config.httpThreads);
+        g_server->setCacheControl(config.cacheControl, config.cacheControlImmutable);
         
         // Start HTTP server
         std::cout << "Starting HTTP server on " << host << ":" << port << "..." << std::endl;
@@ -42,22 +86,30 @@ int main() {
         // Start server in background thread
         g_server->start();
         
-        // Start all streams after server is up
-        std::cout << "Starting 8 video streams..." << std::endl;
-        for (int i = 0; i < 8; ++i) {
-            std::cout << "Starting stream " << i << "..." << std::endl;
-            bool success = g_streamManager->startStream(i, 1920, 1080, 30);
-            if (success) {
-                std::cout << "Stream " << i << " started successfully" << std::endl;
+        // Start all configured streams after server is up; they come up in parallel
+        std::cout << "Starting " << config.streamCount << " video streams..." << std::endl;
+        int started = 0;
+        for (const StreamStartResult& result : g_streamManager->startConfiguredStreams()) {
+            if (result.success) {
+                ++started;
+            } else if (result.admission == Admission::Queued || result.admission == Admission::Rejected) {
+                std::cout << "Stream " << result.streamId << " " << admissionName(result.admission)
+                          << " by admission control" << std::endl;
             } else {
-                std::cerr << "Failed to start stream " << i << std::endl;
+                std::cerr << "Failed to start stream " << result.streamId << std::endl;
             }
         }
+        std::cout << started << " of " << config.streamCount << " streams started" << std::endl;
 
         // Keep main thread alive and react to Ctrl+C
         std::cout << "VMS is running. Press Ctrl+C to stop." << std::endl;
         while (!g_shutdownRequested) {
             std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (g_reloadRequested) {
+                g_reloadRequested = 0;
+                std::cout << "Reloading configuration from " << configPath << std::endl;
+                reloadConfig(configPath, config);
+            }
         }
         std::cout << "Received shutdown request. Stopping services..." << std::endl;
         if (g_server) g_server->stop();
@@ -3,6 +3,8 @@ class VideoManagementSystem {
         // Auto-detect server URL based on current location
         this.baseUrl = window.location.origin;
         this.websocket = null;
+        this.reconnectDelay = 1000;
+        this.wasConnected = false;
         this.streams = new Map();
         this.activeStreams = 0;
         
@@ -57,6 +59,12 @@ class VideoManagementSystem {
             this.websocket.onopen = () => {
                 this.updateConnectionStatus(true);
                 console.log('WebSocket connected');
+                this.reconnectDelay = 1000;
+                // Updates pushed while disconnected were missed; resync once
+                if (this.wasConnected) {
+                    this.loadStreams();
+                }
+                this.wasConnected = true;
             };
             
             this.websocket.onmessage = (event) => {
@@ -71,8 +79,10 @@ class VideoManagementSystem {
             this.websocket.onclose = () => {
                 this.updateConnectionStatus(false);
                 console.log('WebSocket disconnected');
-                // Attempt to reconnect after 3 seconds
-                setTimeout(() => this.initializeWebSocket(), 3000);
+                // The server keeps sessions open, so this only happens when it
+                // restarts or the network drops; back off up to 30 seconds
+                setTimeout(() => this.initializeWebSocket(), this.reconnectDelay);
+                this.reconnectDelay = Math.min(this.reconnectDelay * 2, 30000);
             };
             
             this.websocket.onerror = (error) => {
@@ -104,6 +114,8 @@ class VideoManagementSystem {
     handleWebSocketMessage(data) {
         if (data.type === 'stream_update') {
             this.updateStreamStatus(data.streamId, data.active);
+        } else if (data.type === 'stream_updates') {
+            data.updates.forEach(update => this.updateStreamStatus(update.streamId, update.active));
         }
     }
     
@@ -192,9 +204,16 @@ class VideoManagementSystem {
             
             const data = await response.json();
             
-            if (data.success) {
+            if (data.success && data.admission === 'downgraded') {
+                this.updateStreamStatus(streamId, true);
+                this.showSuccess(`Stream ${streamId + 1} started at ${data.width}x${data.height} (CPU budget)`);
+            } else if (data.success) {
                 this.updateStreamStatus(streamId, true);
                 this.showSuccess(`Stream ${streamId + 1} started successfully`);
+            } else if (data.admission === 'queued') {
+                this.showSuccess(`Stream ${streamId + 1} queued until CPU budget frees up`);
+            } else if (data.admission === 'rejected') {
+                this.showError(`Stream ${streamId + 1} rejected: CPU budget exhausted`);
             } else {
                 this.showError(`Failed to start stream ${streamId + 1}`);
             }